@@ -0,0 +1,93 @@
+
+/*! \file  ColFormat.h
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    file format of the col_file export module
+
+    A file is a sequence of row groups. Each group describes itself, so
+    groups of different tasks and modules can follow each other in one
+    file and files can be appended to or concatenated. A group is
+
+        colGroupHeader_t   header
+        colColumn_t        column[ncols]
+        char               names[namesLen]
+        ...                column data
+
+    The name block holds the NUL terminated names of the task, of the
+    packet processing module and of all columns. The data of each column
+    starts at an offset aligned to 8 bytes from the start of the group.
+    Columns with a fixed width hold nrows values one after another,
+    STRING and BINARY columns hold nrows+1 uint32_t offsets followed by
+    the concatenated values (value i is between offset i and i+1).
+    Numbers are in the byte order of the meter (see byteOrder), addresses
+    in network byte order.
+
+    A reader maps the file and walks from group to group using size, no
+    parsing of the data is needed.
+
+    $Id$
+*/
+
+#ifndef __COLFORMAT_H
+#define __COLFORMAT_H
+
+
+#include <stdint.h>
+
+
+//! magic number at the start of each row group
+#define COLFILE_MAGIC       "NMCG"
+
+//! version of the format
+#define COLFILE_VERSION     1
+
+//! written as uint16_t, tells the reader the byte order
+#define COLFILE_BYTEORDER   0x0102
+
+//! alignment of column data
+#define COLFILE_ALIGN       8
+
+
+/*! \short   header of a row group */
+typedef struct {
+    char     magic[4];      //!< COLFILE_MAGIC
+    uint16_t version;       //!< COLFILE_VERSION
+    uint16_t byteOrder;     //!< COLFILE_BYTEORDER
+    uint32_t ncols;         //!< number of columns
+    uint32_t nrows;         //!< number of rows (flows)
+    uint64_t size;          //!< size of the group including this header
+    uint32_t list;          //!< export list of the module the data is from
+    uint32_t namesLen;      //!< size of the name block (multiple of 8)
+} colGroupHeader_t;
+
+/*! \short   description of a column of a row group */
+typedef struct {
+    uint32_t type;          //!< DataType_e of the values
+    uint32_t width;         //!< size of a value, 0 for STRING and BINARY
+    uint32_t name;          //!< offset of the column name in the name block
+    uint32_t reserved;
+    uint64_t offset;        //!< offset of the data from the start of the group
+    uint64_t size;          //!< size of the data
+} colColumn_t;
+
+
+#endif /* __COLFORMAT_H */
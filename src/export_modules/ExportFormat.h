@@ -0,0 +1,245 @@
+
+/*! \file  ExportFormat.h
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    text formatting of export data for the comma separated export modules
+
+    The output is the same as with ostream operator<< in the classic
+    locale, but numbers are converted without streams and a row is
+    collected in one buffer which is written with a single call.
+
+    $Id$
+*/
+
+#ifndef __EXPORTFORMAT_H
+#define __EXPORTFORMAT_H
+
+
+#include "stdincpp.h"
+#include "ProcModuleInterface.h"
+
+
+/*! \short   buffer for one row of text export data */
+
+class TextRow
+{
+  private:
+
+    char *buf;
+    unsigned long len, size;
+
+    //! make room for n more characters
+    inline char *reserve(unsigned long n)
+    {
+        if (len + n > size) {
+            while (len + n > size) {
+                size *= 2;
+            }
+
+            char *nbuf = new char[size];
+            memcpy(nbuf, buf, len);
+            delete[] buf;
+            buf = nbuf;
+        }
+
+        return buf + len;
+    }
+
+    //! write the decimal digits of v to p, returns end of the number
+    static inline char *formatUInt(char *p, unsigned long long v)
+    {
+        char tmp[20];
+        int n = 0;
+
+        do {
+            tmp[n++] = '0' + (char) (v % 10);
+            v /= 10;
+        } while (v > 0);
+
+        while (n > 0) {
+            *p++ = tmp[--n];
+        }
+
+        return p;
+    }
+
+    static inline char *formatInt(char *p, long long v)
+    {
+        if (v < 0) {
+            *p++ = '-';
+            // no overflow for the smallest value
+            return formatUInt(p, 0ULL - (unsigned long long) v);
+        }
+
+        return formatUInt(p, v);
+    }
+
+  public:
+
+    TextRow(unsigned long initSize = 1024)
+      : len(0), size(initSize)
+    {
+        buf = new char[size];
+    }
+
+    ~TextRow()
+    {
+        delete[] buf;
+    }
+
+    //! start a new row
+    void clear()
+    {
+        len = 0;
+    }
+
+    const char *getData()
+    {
+        return buf;
+    }
+
+    unsigned long getLength()
+    {
+        return len;
+    }
+
+    void addChar(char c)
+    {
+        *reserve(1) = c;
+        len++;
+    }
+
+    void addString(const char *s, unsigned long n)
+    {
+        memcpy(reserve(n), s, n);
+        len += n;
+    }
+
+    void addInt(long long v)
+    {
+        len = formatInt(reserve(24), v) - buf;
+    }
+
+    void addUInt(unsigned long long v)
+    {
+        len = formatUInt(reserve(24), v) - buf;
+    }
+
+    //! add a value like %g (the default format of ostream)
+    void addDouble(double v)
+    {
+        len += snprintf(reserve(32), 32, "%g", v);
+    }
+
+    //! add a data field of a processing module
+    void addData(DataType_e type, const char *dpos)
+    {
+        switch (type) {
+        case CHAR:
+            addChar(*dpos);
+            break;
+        case INT8:
+            addInt(*((signed char *)dpos));
+            break;
+        case UINT8:
+            addUInt(*((unsigned char *)dpos));
+            break;
+        case INT16:
+            addInt(*((int16_t *)dpos));
+            break;
+        case UINT16:
+            addUInt(*((uint16_t *)dpos));
+            break;
+        case INT32:
+            addInt(*((int32_t *)dpos));
+            break;
+        case UINT32:
+            addUInt(*((uint32_t *)dpos));
+            break;
+        case IPV4ADDR:
+          {
+              const unsigned char *a = (const unsigned char *) dpos;
+              char *p = reserve(16);
+
+              for (int i = 0; i < 4; i++) {
+                  if (i > 0) {
+                      *p++ = '.';
+                  }
+                  p = formatUInt(p, a[i]);
+              }
+              len = p - buf;
+          }
+          break;
+        case IPV6ADDR:
+          {
+              char *p = reserve(INET6_ADDRSTRLEN);
+
+              inet_ntop(AF_INET6, dpos, p, INET6_ADDRSTRLEN);
+              len += strlen(p);
+          }
+          break;
+        case INT64:
+            addInt(*((int64_t *)dpos));
+            break;
+        case UINT64:
+            addUInt(*((uint64_t *)dpos));
+            break;
+        case FLOAT:
+            addDouble(*((float *)dpos));
+            break;
+        case DOUBLE:
+            addDouble(*((double *)dpos));
+            break;
+        case STRING:
+            addString(dpos, strlen(dpos));
+            break;
+        case LIST:
+            break;
+        case BINARY:
+          {
+              static const char hexdigits[] = "0123456789abcdef";
+              // get length
+              unsigned int blen = *((unsigned int *)dpos);
+              const unsigned char *b = (const unsigned char *) dpos + sizeof(unsigned int);
+
+              if (blen > 0) {
+                  char *p = reserve(2 + 2*blen);
+
+                  // print binary as hex bytes
+                  *p++ = '0';
+                  *p++ = 'x';
+                  for (unsigned int i = 0; i < blen; i++) {
+                      *p++ = hexdigits[b[i] >> 4];
+                      *p++ = hexdigits[b[i] & 0xf];
+                  }
+                  len = p - buf;
+              }
+          }
+          break;
+        default:
+            break;
+        }
+    }
+};
+
+
+#endif /* __EXPORTFORMAT_H */
@@ -49,3 +49,19 @@ ExportModuleInterface_t func =
       getModuleInfo, 
       getErrorMsg 
 };
+
+
+#ifdef BUILTIN_MODULE
+
+extern "C" {
+
+/*! \short   symbols the meter looks up in a module linked into it */
+builtinSymbol_t builtinSymbols[] =
+{
+    { "magic", &magic },
+    { "func", &func },
+    { NULL, NULL } };
+
+}
+
+#endif
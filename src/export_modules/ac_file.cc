@@ -41,7 +41,9 @@ $Id: ac_file.cc 748 2009-09-10 02:54:03Z szander $
 #include "ConfigManager.h"
 #include "./ExportModule.h"
 #include "Rule.h"
+#include "ExportFormat.h"
 #include "ConfigParser.h"
+#include "ExportFiles.h"
 #include "../netmate/ProcModule.h"
 
 
@@ -62,11 +64,26 @@ typedef struct {
     uid_t exportGID;
     int expFlowId;
     int expFlowStatus;
+    set<string> files;  // export files used by this task
+    compression_t compression;
+    int compThreads;    // number of threads compressing a file
 } exportRecord_t;
 
+// export files, kept open between exports and shared with the other
+// file export modules
+static ExportFiles *exportFiles;
+
+// export records of all tasks using this module, timeout flushes their files
+static set<exportRecord_t *> records;
+
+static timers_t timers[] = { /* handle, ival_msec, flags */
+    { 1, 1000, TM_RECURRING },  // flush export files
+    TIMER_END
+};
+
 
 // FIXME how to throw exceptions from inside the shared lib?
-void die(int code, char *fmt, ...)
+static void die(int code, char *fmt, ...)
 {
     va_list           args;
 
@@ -79,6 +96,21 @@ void die(int code, char *fmt, ...)
     exit(code);
 }
 
+//! get the export file filename used by a task (opened at first use)
+static ostream &getFile(exportRecord_t *rec, string filename)
+{
+    ostream *ofile = NULL;
+
+    try {
+        ofile = &exportFiles->acquire(rec->files, filename, rec->compression,
+                                      rec->compThreads, rec->exportUID, rec->exportGID);
+    } catch (Error &e) {
+        die(1, "Unable to open %s: %s", filename.c_str(), e.getError().c_str());
+    }
+
+    return *ofile;
+}
+
 /* -------------------- initModule -------------------- */
 
 int initModule( ConfigManager *confMan )
@@ -92,6 +124,8 @@ int initModule( ConfigManager *confMan )
     }
     exportFilename = confMan->getValue("ExportFilename", "EXPORTER", "ac_file");
 
+    exportFiles = ExportFiles::getInstance();
+
     return 0;
 }
 
@@ -130,6 +164,14 @@ int initExportRec( configItemList_t conf, void **expRecord )
         rec->exportFilename = exportFilename;
     } 
 
+    // compress the export files (none, gzip or zstd)
+    try {
+        rec->compression = AsyncWriter::parseCompression(conf.getValue("Compression"));
+    } catch (Error &e) {
+        die(1, "%s", e.getError().c_str());
+    }
+    rec->compThreads = atoi(conf.getValue("CompressionThreads").c_str());
+
     // check if we have an ExportUser specified in the config file
     string exportUserName = conf.getValue("ExportUser");
     if (exportUserName.empty()) {
@@ -143,6 +185,9 @@ int initExportRec( configItemList_t conf, void **expRecord )
         }
     }
 
+    AUTOLOCK(1, exportFiles->getLock());
+    records.insert(rec);
+
     *((exportRecord_t **) expRecord) = rec;
 
     return 0;
@@ -153,105 +198,37 @@ int initExportRec( configItemList_t conf, void **expRecord )
 
 int destroyExportRec( void *expRecord )
 {
-    delete (exportRecord_t *) expRecord;
-    return 0;
-}
+    exportRecord_t *rec = (exportRecord_t *) expRecord;
 
+    AUTOLOCK(1, exportFiles->getLock());
 
-/* -------------------- timeout -------------------- */
+    exportFiles->release(rec->files);
+    records.erase(rec);
 
-int timeout( int id )
-{
-    // called by netmate if module has timers defined - in ac_file module unused!
+    delete rec;
     return 0;
 }
 
 
-/* -------------------- writeData (local function) -------------------- */
+/* -------------------- timeout -------------------- */
 
-inline static void writeData( ofstream &ofile, DataType_e type, const char *dpos )
+int timeout( int id )
 {
-    //fprintf(stderr, "%s %x \n", ProcModule::typeLabel(type), dpos);
-
-    switch (type) {
-    case CHAR: 
-        ofile << *dpos;
-        break;
-    case INT8:
-        ofile << (short)*dpos; 
-        break;
-    case UINT8:	
-        ofile << (unsigned short)*((unsigned char*)dpos); 
-        break;
-    case INT16:
-        ofile << *((short*)dpos); 
-        break;
-    case UINT16:
-        ofile << *((unsigned short*)dpos); 
-        break;
-    case INT32:
-        ofile << *((int32_t*)dpos); 
-        break;
-    case UINT32:
-        ofile << *((uint32_t*)dpos); 
-        break;
-    case IPV4ADDR:
-      {
-          char buf[64];
-          ofile << inet_ntop(AF_INET, dpos, buf, sizeof(buf));
-      }
-      break;
-    case IPV6ADDR:
-      {
-          char buf[64];
-          ofile << inet_ntop(AF_INET6, dpos, buf, sizeof(buf));
-      }
-      break;
-    case INT64:
-        ofile << *((long long*)dpos);
-        break;
-    case UINT64:
-        ofile << *((unsigned long long*)dpos); 
-        break;
-    case FLOAT:
-        ofile << *((float*)dpos); 
-        break;
-    case DOUBLE:
-        ofile << *((double*)dpos); 
-        break;
-    case STRING:   
-        ofile << dpos; 
-        break;
-    case LIST:
-        break;
-    case BINARY:
-      {
-	  // get length
-          unsigned int len = *((unsigned int *)dpos);
-          dpos += sizeof(unsigned int);
-
-          if (len > 0) {
-            ofile << "0x" << hex << setfill('0');
-
-            // print binary as hex bytes
-            for (unsigned int i=0; i < len; i++) {
-                  ofile << setw(2) << (short) *((unsigned char *)dpos);
-                  dpos += 1;
-            }
-            ofile << dec;
-          }
-      }
-      break;
-    default:
-        break;
+    AUTOLOCK(1, exportFiles->getLock());
+
+    // write out the buffered data of the files used by this module
+    for (set<exportRecord_t *>::iterator r = records.begin(); r != records.end(); ++r) {
+        exportFiles->flush((*r)->files);
     }
+
+    return 0;
 }
 
 
 /* ------------------- exportMetricData (local function) ------------------- */
 
 static int exportMetricData( string taskName, MetricData *mdata,
-                             ofstream &ofile, int expFlowId, int final, int expFlowStatus )
+                             ostream &ofile, int expFlowId, int final, int expFlowStatus )
 {
     int nrows;
     DataType_e type;
@@ -261,6 +238,7 @@ static int exportMetricData( string taskName, MetricData *mdata,
     const char *str;
     int newFlow;
     unsigned long long flowId;
+    TextRow row;
 
     gettimeofday(&tval,NULL);
     strftime(tstamp, sizeof(tstamp), "%b %d %H:%M:%S", localtime_r((time_t *)&tval.tv_sec, &tm));
@@ -272,31 +250,37 @@ static int exportMetricData( string taskName, MetricData *mdata,
             for (int i=0; i<nrows; i++) {
 	        char c = '\0';
 
+		row.clear();
+
 		if (expFlowId) {
-		  ofile << flowId << ",";
+		  row.addUInt(flowId);
+		  row.addChar(',');
 		}
 		if (expFlowStatus) {
-		  ofile << final << ",";
+		  row.addInt(final);
+		  row.addChar(',');
 		}
                 
                 // print flow key
                 while((str = mdata->getNextFlowKey(&type)) != NULL) {
 		  if (c != '\0') {
-		    ofile << c;
+		    row.addChar(c);
 		  }
 		  c = ',';
-		  writeData(ofile, type, str);
+		  row.addData(type, str);
                 }
                 
                 // print flow data
                 while((str = mdata->getNextFlowDataRow(&type)) != NULL) {
 		  if (c != '\0') {
-                    ofile << c;
+                    row.addChar(c);
 		  }
 		  c = ',';
-		  writeData(ofile, type, str);
+		  row.addData(type, str);
                 }
-                ofile << endl;
+                row.addChar('\n');
+
+                ofile.write(row.getData(), row.getLength());
             }
         }
     }
@@ -304,25 +288,6 @@ static int exportMetricData( string taskName, MetricData *mdata,
 }
 
 
-void createDir(string filename)
-{  
-    int successMkdir = 0;
-    int i = 0;
-
-    // create all directories above the file
-    while ((i = filename.find('/', i+1)) != -1) {
-        struct stat statbuf;
-        if (!(stat(filename.substr(0, i).c_str(), &statbuf) == 0 &&
-              (S_ISDIR(statbuf.st_mode)))) {
-            successMkdir = mkdir(filename.substr(0, i).c_str(), 0777);
-            if (successMkdir != 0) {
-                die(1, "Unable to make directory for %s: %s", filename.c_str(), 
-                    strerror(errno));
-            }
-        }
-    }
-}
-
 /* -------------------- exportData (part of export API) -------------------- */
 
 int exportData( FlowRecord *frec, void *expData ) 
@@ -342,6 +307,8 @@ int exportData( FlowRecord *frec, void *expData )
 
     rec = (exportRecord_t *)expData;
 
+    AUTOLOCK(1, exportFiles->getLock());
+
     // use rule name as export file name if none was supplied explicitly
     if (rec->exportFilename.empty()) {
         filename = exportDir + frec->getRuleName();
@@ -364,12 +331,7 @@ int exportData( FlowRecord *frec, void *expData )
         if (rec->firstTime == 1) {
             // done only at first export for this task
         }
-        createDir(filename);
-        ofstream ofile(filename.c_str(), ios::app);
-        if (!ofile) {
-		die(1, "Unable to open %s", filename.c_str());
-        } 
-        chown( filename.c_str(), rec->exportUID, rec->exportGID );
+        ostream &ofile = getFile(rec, filename);
 
         // data from multiple packet proc modules can be in one FlowRecord
         while ((mdata = frec->getNextData()) != NULL) {
@@ -379,7 +341,6 @@ int exportData( FlowRecord *frec, void *expData )
             result += exportMetricData(frec->getRuleName(), mdata, ofile, rec->expFlowId, frec->isFinal(),
 				       rec->expFlowStatus);
         }
-        ofile.close();
     
     } else {  // multifile == 1
 
@@ -393,16 +354,13 @@ int exportData( FlowRecord *frec, void *expData )
             if (rec->firstTime == 1) {
                 // done only at first export for this task
             }
-            createDir(filename2);
-            ofstream ofile(filename2.c_str(), ios::app);
-            chown( filename.c_str(), rec->exportUID, rec->exportGID );
+            ostream &ofile = getFile(rec, filename2);
 
 #ifdef DEBUG	    
 	    cerr << "export from proc module: " << mdata->getModName() << endl;
 #endif
             result += exportMetricData(frec->getRuleName(), mdata, ofile, rec->expFlowId, frec->isFinal(),
 				       rec->expFlowStatus);
-            ofile.close();
         }
     }
 
@@ -435,6 +393,6 @@ char* getModuleInfo( int i )
 
 timers_t* getTimers()
 {
-    return NULL;
+    return timers;
 }
 
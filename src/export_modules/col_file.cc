@@ -0,0 +1,582 @@
+/*! \file  col_file.cc
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+Description:
+export into typed column oriented binary file(s), see ColFormat.h
+
+The columns are the flow keys and the export data of the packet processing
+modules as described by their type information. Rows are collected per
+task, module and export list and written as a row group every RowGroupSize
+flows, so the data can be loaded without parsing. Rows collected for less
+than a group are written by the flush timer and when the task ends.
+
+$Id$
+
+*/
+
+#include <pwd.h>
+#include <sys/types.h>
+
+#include "stdincpp.h"
+#include "ConfigManager.h"
+#include "./ExportModule.h"
+#include "Rule.h"
+#include "ColFormat.h"
+#include "ConfigParser.h"
+#include "ExportFiles.h"
+#include "../netmate/ProcModule.h"
+
+
+//! default number of flows per row group
+const unsigned long DEF_ROW_GROUP = 65536;
+
+
+// module global variables (common for all rules using the col_file export module)
+
+static string exportDir;
+static string exportFilename;
+
+// data of a column of a row group being collected
+typedef struct {
+    DataType_e type;
+    string label;
+    unsigned int width;         // 0 for variable length values
+    string data;
+    vector<uint32_t> offsets;   // ends of variable length values
+} colData_t;
+
+typedef vector<colData_t>            colDataList_t;
+typedef vector<colData_t>::iterator  colDataListIter_t;
+
+// row group being collected (per task, file, module and export list)
+typedef struct {
+    string filename;
+    string module;
+    int list;
+    colDataList_t cols;
+    unsigned long nrows;
+} rowGroup_t;
+
+typedef map<string, rowGroup_t *>            rowGroupList_t;
+typedef map<string, rowGroup_t *>::iterator  rowGroupListIter_t;
+
+// task specific variables (one such record is stored by netmate per task
+//                          using the col_file export module)
+
+typedef struct {
+    short multifile;
+    string exportFilename;
+    uid_t exportUID;
+    uid_t exportGID;
+    int expFlowId;
+    int expFlowStatus;
+    unsigned long rowGroupSize;
+    string taskName;
+    rowGroupList_t groups;  // row groups not yet written
+    set<string> files;      // export files used by this task
+} exportRecord_t;
+
+// export files, kept open between exports and shared with the other
+// file export modules
+static ExportFiles *exportFiles;
+
+// export records of all tasks using this module, timeout flushes their files
+static set<exportRecord_t *> records;
+
+static timers_t timers[] = { /* handle, ival_msec, flags */
+    { 1, 1000, TM_RECURRING },  // write collected rows, flush export files
+    TIMER_END
+};
+
+
+// FIXME how to throw exceptions from inside the shared lib?
+static void die(int code, const char *fmt, ...)
+{
+    va_list           args;
+
+    fprintf(stderr, "col_file: ");
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    exit(code);
+}
+
+//! get the export file filename used by a task (opened at first use)
+static ostream &getFile(exportRecord_t *rec, string filename)
+{
+    ostream *ofile = NULL;
+
+    try {
+        ofile = &exportFiles->acquire(rec->files, filename, COMPRESS_NONE, 1,
+                                      rec->exportUID, rec->exportGID);
+    } catch (Error &e) {
+        die(1, "Unable to open %s: %s", filename.c_str(), e.getError().c_str());
+    }
+
+    return *ofile;
+}
+
+//! round up to the alignment of column data
+static inline uint64_t colAlign(uint64_t len)
+{
+    return (len + COLFILE_ALIGN - 1) / COLFILE_ALIGN * COLFILE_ALIGN;
+}
+
+//! types stored as columns (lists have no values of their own)
+static inline int isColumn(DataType_e type)
+{
+    return (type >= CHAR) && (type < INVALID2);
+}
+
+static void addColumn(rowGroup_t *g, DataType_e type, string label)
+{
+    colData_t c;
+
+    c.type = type;
+    c.label = label;
+    c.width = ((type == STRING) || (type == BINARY)) ? 0 : DataTypeSize[type];
+    c.offsets.push_back(0);
+    g->cols.push_back(c);
+}
+
+//! append a value in the representation of the export data to a column
+static inline void addValue(colData_t *c, const char *dpos)
+{
+    switch (c->type) {
+    case STRING:
+        c->data.append(dpos, strlen(dpos));
+        c->offsets.push_back(c->data.size());
+        break;
+    case BINARY:
+      {
+          unsigned int len = *((unsigned int *)dpos);
+
+          c->data.append(dpos + sizeof(unsigned int), len);
+          c->offsets.push_back(c->data.size());
+      }
+      break;
+    default:
+        c->data.append(dpos, c->width);
+        break;
+    }
+}
+
+//! a row does not have a value for each column of its group
+static void badRow(rowGroup_t *g)
+{
+    die(1, "export data of module %s (list %d) does not match its type information",
+        g->module.c_str(), g->list);
+}
+
+//! write a row group and start collecting the next one
+static void writeGroup(exportRecord_t *rec, rowGroup_t *g)
+{
+    static const char zeros[COLFILE_ALIGN] = { 0 };
+    colGroupHeader_t hdr;
+    vector<colColumn_t> cols(g->cols.size());
+    string names;
+    uint64_t off;
+    unsigned int i;
+
+    if (g->nrows == 0) {
+        return;
+    }
+
+    ostream &ofile = getFile(rec, g->filename);
+
+    names.append(rec->taskName).append(1, '\0');
+    names.append(g->module).append(1, '\0');
+
+    for (i = 0; i < g->cols.size(); i++) {
+        memset(&cols[i], 0, sizeof(colColumn_t));
+        cols[i].type = g->cols[i].type;
+        cols[i].width = g->cols[i].width;
+        cols[i].name = names.size();
+        names.append(g->cols[i].label).append(1, '\0');
+    }
+    names.append(colAlign(names.size()) - names.size(), '\0');
+
+    // column data follows the name block
+    off = sizeof(colGroupHeader_t) + cols.size() * sizeof(colColumn_t) + names.size();
+
+    for (i = 0; i < g->cols.size(); i++) {
+        cols[i].offset = off;
+        cols[i].size = g->cols[i].data.size();
+        if (g->cols[i].width == 0) {
+            cols[i].size += g->cols[i].offsets.size() * sizeof(uint32_t);
+        }
+        off += colAlign(cols[i].size);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, COLFILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = COLFILE_VERSION;
+    hdr.byteOrder = COLFILE_BYTEORDER;
+    hdr.ncols = cols.size();
+    hdr.nrows = g->nrows;
+    hdr.size = off;
+    hdr.list = g->list;
+    hdr.namesLen = names.size();
+
+    ofile.write((char *) &hdr, sizeof(hdr));
+    if (!cols.empty()) {
+        ofile.write((char *) &cols[0], cols.size() * sizeof(colColumn_t));
+    }
+    ofile.write(names.data(), names.size());
+
+    for (i = 0; i < g->cols.size(); i++) {
+        colData_t &c = g->cols[i];
+
+        if (c.width == 0) {
+            ofile.write((char *) &c.offsets[0], c.offsets.size() * sizeof(uint32_t));
+        }
+        ofile.write(c.data.data(), c.data.size());
+        ofile.write(zeros, colAlign(cols[i].size) - cols[i].size);
+
+        c.data.clear();
+        c.offsets.clear();
+        c.offsets.push_back(0);
+    }
+
+    g->nrows = 0;
+}
+
+//! get the row group for an export list of a module (created at first use)
+static rowGroup_t *getGroup(exportRecord_t *rec, string filename, MetricData *mdata, int list)
+{
+    const char *str;
+    DataType_e type;
+    char tmp[32];
+    rowGroup_t g;
+
+    g.filename = filename;
+    g.module = mdata->getModName();
+    g.list = list;
+    g.nrows = 0;
+
+    if (rec->expFlowId) {
+        addColumn(&g, UINT64, "flowId");
+    }
+    if (rec->expFlowStatus) {
+        addColumn(&g, INT8, "flowStatus");
+    }
+
+    // the columns of the flow keys and the flow data
+    while ((str = mdata->getNextFlowKeyLabel(&type)) != NULL) {
+        if (isColumn(type)) {
+            addColumn(&g, type, str);
+        }
+    }
+    while ((str = mdata->getNextFlowDataLabel(&type)) != NULL) {
+        if (isColumn(type)) {
+            addColumn(&g, type, str);
+        }
+    }
+
+    // groups with a different schema are kept apart
+    snprintf(tmp, sizeof(tmp), "%d", list);
+    string key = filename + '\0' + g.module + '\0' + tmp;
+    for (colDataListIter_t c = g.cols.begin(); c != g.cols.end(); ++c) {
+        key += '\0' + c->label + (char) c->type;
+    }
+
+    rowGroupListIter_t i = rec->groups.find(key);
+    if (i != rec->groups.end()) {
+        return i->second;
+    }
+
+    rowGroup_t *ng = new rowGroup_t(g);
+    rec->groups[key] = ng;
+    return ng;
+}
+
+
+/* -------------------- initModule -------------------- */
+
+int initModule( ConfigManager *confMan )
+{
+    exportDir = confMan->getValue("ExportDir", "EXPORTER", "col_file");
+    // make sure traling / is present
+    if (!exportDir.empty()) {
+        if (exportDir[exportDir.length()-1] != '/') {
+            exportDir += "/";
+        }
+    }
+    exportFilename = confMan->getValue("ExportFilename", "EXPORTER", "col_file");
+
+    exportFiles = ExportFiles::getInstance();
+
+    return 0;
+}
+
+
+/* -------------------- resetModule -------------------- */
+
+int resetModule()
+{
+    return 0;
+}
+
+
+/* -------------------- destroyModule -------------------- */
+
+int destroyModule()
+{
+    return 0;
+}
+
+
+/* -------------------- initExportRec -------------------- */
+
+int initExportRec( configItemList_t conf, void **expRecord )
+{
+    exportRecord_t *rec = new exportRecord_t;
+
+    rec->multifile       = (conf.getValue("Multifile") == "yes") ? 1 : 0;
+    rec->exportFilename  =  conf.getValue("Filename");
+    rec->expFlowId       = (conf.getValue("FlowID") == "yes") ? 1 : 0;
+    rec->expFlowStatus   = (conf.getValue("ExportStatus") == "yes") ? 1 : 0;
+
+    // use filename from netmate config if no name in rule file
+    if (rec->exportFilename.empty()) {
+        rec->exportFilename = exportFilename;
+    }
+
+    // number of flows written as one row group
+    string rgsize = conf.getValue("RowGroupSize");
+    rec->rowGroupSize = rgsize.empty() ? DEF_ROW_GROUP : strtoul(rgsize.c_str(), NULL, 10);
+    if (rec->rowGroupSize == 0) {
+        rec->rowGroupSize = DEF_ROW_GROUP;
+    }
+
+    // check if we have an ExportUser specified in the config file
+    string exportUserName = conf.getValue("ExportUser");
+    if (exportUserName.empty()) {
+        rec->exportUID = 0;
+        rec->exportGID = 0;
+    } else {
+        struct passwd *pwEnt = getpwnam((const char *)exportUserName.c_str());
+        if (pwEnt != NULL) {
+            rec->exportUID = pwEnt->pw_uid;
+            rec->exportGID = pwEnt->pw_gid;
+        }
+    }
+
+    AUTOLOCK(1, exportFiles->getLock());
+    records.insert(rec);
+
+    // store new record in location supplied by caller
+    *((exportRecord_t **) expRecord) = rec;
+
+    return 0;
+}
+
+
+/* -------------------- destroyExportRec -------------------- */
+
+int destroyExportRec( void *expRecord )
+{
+    exportRecord_t *rec = (exportRecord_t *) expRecord;
+
+    AUTOLOCK(1, exportFiles->getLock());
+
+    // write the rows collected since the last row group
+    for (rowGroupListIter_t g = rec->groups.begin(); g != rec->groups.end(); ++g) {
+        writeGroup(rec, g->second);
+        delete g->second;
+    }
+
+    exportFiles->release(rec->files);
+    records.erase(rec);
+
+    delete rec;
+    return 0;
+}
+
+
+/* -------------------- timeout -------------------- */
+
+int timeout( int id )
+{
+    AUTOLOCK(1, exportFiles->getLock());
+
+    // write the rows collected so far (a partial row group) and the
+    // buffered data of the files used by this module
+    for (set<exportRecord_t *>::iterator r = records.begin(); r != records.end(); ++r) {
+        for (rowGroupListIter_t g = (*r)->groups.begin(); g != (*r)->groups.end(); ++g) {
+            writeGroup(*r, g->second);
+        }
+        exportFiles->flush((*r)->files);
+    }
+
+    return 0;
+}
+
+
+/* ------------------- exportMetricData (local function) ------------------- */
+
+static int exportMetricData( exportRecord_t *rec, string filename, MetricData *mdata,
+                             int final )
+{
+    int nrows;
+    int list = 0;
+    DataType_e type;
+    const char *str;
+    int newFlow;
+    unsigned long long flowId;
+    int8_t status = final;
+
+    mdata->initExport();
+
+    while ((nrows = mdata->getNextList()) > -1) {
+        rowGroup_t *g = getGroup(rec, filename, mdata, list);
+        colDataListIter_t end = g->cols.end();
+
+        while ((nrows = mdata->getNextFlow(&flowId, &newFlow)) > -1) {
+            for (int i=0; i<nrows; i++) {
+                colDataListIter_t c = g->cols.begin();
+
+                if (rec->expFlowId) {
+                    (c++)->data.append((char *) &flowId, sizeof(flowId));
+                }
+                if (rec->expFlowStatus) {
+                    (c++)->data.append((char *) &status, sizeof(status));
+                }
+
+                // flow key
+                while((str = mdata->getNextFlowKey(&type)) != NULL) {
+                    if (isColumn(type)) {
+                        if (c == end) {
+                            badRow(g);
+                        }
+                        addValue(&*c++, str);
+                    }
+                }
+
+                // flow data
+                while((str = mdata->getNextFlowDataRow(&type)) != NULL) {
+                    if (isColumn(type)) {
+                        if (c == end) {
+                            badRow(g);
+                        }
+                        addValue(&*c++, str);
+                    }
+                }
+
+                // all columns of a group must have the same number of values
+                if (c != end) {
+                    badRow(g);
+                }
+
+                if (++g->nrows >= rec->rowGroupSize) {
+                    writeGroup(rec, g);
+                }
+            }
+        }
+        list++;
+    }
+
+    return 0;
+}
+
+
+/* -------------------- exportData (part of export API) -------------------- */
+
+int exportData( FlowRecord *frec, void *expData )
+{
+    MetricData *mdata;
+    exportRecord_t *rec;
+    int result = 0;
+    string filename;
+
+#ifdef PROFILING
+    unsigned long long ini = PerfTimer::readTSC();
+#endif
+
+#ifdef DEBUG
+    cerr << "col_file::exportData (rule='" << frec->getRuleName() << "')" << endl;
+#endif
+
+    rec = (exportRecord_t *)expData;
+
+    AUTOLOCK(1, exportFiles->getLock());
+
+    rec->taskName = frec->getRuleName();
+
+    // use rule name as export file name if none was supplied explicitly
+    if (rec->exportFilename.empty()) {
+        filename = exportDir + frec->getRuleName();
+    } else {
+        if (rec->exportFilename[0] == '/') {
+            filename = rec->exportFilename;
+        } else { // relative filename -> prepend export dir
+            filename = exportDir + rec->exportFilename;
+        }
+    }
+
+    // data from multiple packet proc modules can be in one FlowRecord
+    while ((mdata = frec->getNextData()) != NULL) {
+#ifdef DEBUG
+        cerr << "export from proc module: " << mdata->getModName() << endl;
+#endif
+        if (!rec->multifile) {
+            result += exportMetricData(rec, filename, mdata, frec->isFinal());
+        } else {
+            result += exportMetricData(rec, filename + mdata->getModName(), mdata,
+                                       frec->isFinal());
+        }
+    }
+
+#ifdef PROFILING
+    {
+        unsigned long long end = PerfTimer::readTSC();
+        cerr << "col_file::exportData took "
+             << PerfTimer::ticks2ns(end - ini)/1000
+             << " us" << endl;
+    }
+#endif
+
+    return result;
+}
+
+
+// the module interface returns char*, keep the strings writable
+static char errorMsg[] = "200";
+static char moduleInfo[] = "201";
+
+char* getErrorMsg( int )
+{
+    return errorMsg;
+}
+
+
+char* getModuleInfo( int i )
+{
+    return moduleInfo;
+}
+
+
+timers_t* getTimers()
+{
+    return timers;
+}
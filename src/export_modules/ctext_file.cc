@@ -37,6 +37,7 @@ $Id: ctext_file.cc 748 2009-09-10 02:54:03Z szander $
 #include "./ExportModule.h"
 #include "Rule.h"
 #include "ConfigParser.h"
+#include "ExportFiles.h"
 
 
 
@@ -56,8 +57,23 @@ typedef struct {
     uid_t exportGID;
     int expFlowId;
     int expFlowStatus;
+    set<string> files;  // export files used by this task
+    compression_t compression;
+    int compThreads;    // number of threads compressing a file
 } exportRecord_t;
 
+// export files, kept open between exports and shared with the other
+// file export modules
+static ExportFiles *exportFiles;
+
+// export records of all tasks using this module, timeout flushes their files
+static set<exportRecord_t *> records;
+
+static timers_t timers[] = { /* handle, ival_msec, flags */
+    { 1, 1000, TM_RECURRING },  // flush export files
+    TIMER_END
+};
+
 
 // FIXME how to throw exceptions from inside the shared lib?
 void die(int code, char *fmt, ...)
@@ -73,6 +89,21 @@ void die(int code, char *fmt, ...)
     exit(code);
 }
 
+//! get the export file filename used by a task (opened at first use)
+static ostream &getFile(exportRecord_t *rec, string filename)
+{
+    ostream *ofile = NULL;
+
+    try {
+        ofile = &exportFiles->acquire(rec->files, filename, rec->compression,
+                                      rec->compThreads, rec->exportUID, rec->exportGID);
+    } catch (Error &e) {
+        die(1, "Unable to open %s: %s", filename.c_str(), e.getError().c_str());
+    }
+
+    return *ofile;
+}
+
 /* -------------------- initModule -------------------- */
 
 int initModule( ConfigManager *confMan )
@@ -86,6 +117,8 @@ int initModule( ConfigManager *confMan )
     }
     exportFilename = confMan->getValue("ExportFilename", "EXPORTER", "ctext_file");
 
+    exportFiles = ExportFiles::getInstance();
+
     return 0;
 }
 
@@ -124,6 +157,14 @@ int initExportRec( configItemList_t conf, void **expRecord )
         rec->exportFilename = exportFilename;
     } 
 
+    // compress the export files (none, gzip or zstd)
+    try {
+        rec->compression = AsyncWriter::parseCompression(conf.getValue("Compression"));
+    } catch (Error &e) {
+        die(1, "%s", e.getError().c_str());
+    }
+    rec->compThreads = atoi(conf.getValue("CompressionThreads").c_str());
+
     // check if we have an ExportUser specified in the config file
     string exportUserName = conf.getValue("ExportUser");
     if (exportUserName.empty()) {
@@ -137,6 +178,9 @@ int initExportRec( configItemList_t conf, void **expRecord )
         }
     }
 
+    AUTOLOCK(1, exportFiles->getLock());
+    records.insert(rec);
+
     *((exportRecord_t **) expRecord) = rec;
 
     return 0;
@@ -147,7 +191,14 @@ int initExportRec( configItemList_t conf, void **expRecord )
 
 int destroyExportRec( void *expRecord )
 {
-    delete (exportRecord_t *) expRecord;
+    exportRecord_t *rec = (exportRecord_t *) expRecord;
+
+    AUTOLOCK(1, exportFiles->getLock());
+
+    exportFiles->release(rec->files);
+    records.erase(rec);
+
+    delete rec;
     return 0;
 }
 
@@ -156,14 +207,20 @@ int destroyExportRec( void *expRecord )
 
 int timeout( int id )
 {
-    // called by netmate if module has timers defined - in ctext_file module unused!
+    AUTOLOCK(1, exportFiles->getLock());
+
+    // write out the buffered data of the files used by this module
+    for (set<exportRecord_t *>::iterator r = records.begin(); r != records.end(); ++r) {
+        exportFiles->flush((*r)->files);
+    }
+
     return 0;
 }
 
 
 /* -------------------- writeData (local function) -------------------- */
 
-inline static void writeData( ofstream &ofile, DataType_e type, const char *dpos )
+inline static void writeData( ostream &ofile, DataType_e type, const char *dpos )
 {
     // fprintf(stderr, "%s %x \n", ProcModule::typeLabel(type), dpos);
 
@@ -245,7 +302,7 @@ inline static void writeData( ofstream &ofile, DataType_e type, const char *dpos
 /* ------------------- exportMetricData (local function) ------------------- */
 
 static int exportMetricData( string taskName, MetricData *mdata,
-                             ofstream &ofile, int expFlowId, int final, int expFlowStatus )
+                             ostream &ofile, int expFlowId, int final, int expFlowStatus )
 {
     int nrows;
     DataType_e type;
@@ -288,7 +345,7 @@ static int exportMetricData( string taskName, MetricData *mdata,
                     ofile << ",";
                     writeData(ofile, type, str);
                 }
-                ofile << endl;
+                ofile << "\n";
             }
         }
     }
@@ -296,25 +353,6 @@ static int exportMetricData( string taskName, MetricData *mdata,
 }
 
 
-void createDir(string filename)
-{  
-    int successMkdir = 0;
-    int i = 0;
-
-    // create all directories above the file
-    while ((i = filename.find('/', i+1)) != -1) {
-        struct stat statbuf;
-        if (!(stat(filename.substr(0, i).c_str(), &statbuf) == 0 &&
-              (S_ISDIR(statbuf.st_mode)))) {
-            successMkdir = mkdir(filename.substr(0, i).c_str(), 0777);
-            if (successMkdir != 0) {
-                die(1, "Unable to make directory for %s: %s", filename.c_str(), 
-                    strerror(errno));
-            }
-        }
-    }
-}
-
 /* -------------------- exportData (part of export API) -------------------- */
 
 int exportData( FlowRecord *frec, void *expData ) 
@@ -334,6 +372,8 @@ int exportData( FlowRecord *frec, void *expData )
 
     rec = (exportRecord_t *)expData;
 
+    AUTOLOCK(1, exportFiles->getLock());
+
     // use rule name as export file name if none was supplied explicitly
     if (rec->exportFilename.empty()) {
         filename = exportDir + frec->getRuleName();
@@ -356,12 +396,7 @@ int exportData( FlowRecord *frec, void *expData )
         if (rec->firstTime == 1) {
             // done only at first export for this task
         }
-        createDir(filename);
-        ofstream ofile(filename.c_str(), ios::app);
-        if (!ofile) {
-                die(1, "Unable to open %s", filename.c_str());
-        }
-        chown( filename.c_str(), rec->exportUID, rec->exportGID );
+        ostream &ofile = getFile(rec, filename);
 
         // data from multiple packet proc modules can be in one FlowRecord
         while ((mdata = frec->getNextData()) != NULL) {
@@ -371,7 +406,6 @@ int exportData( FlowRecord *frec, void *expData )
             result += exportMetricData(frec->getRuleName(), mdata, ofile, rec->expFlowId, frec->isFinal(), 
 				       rec->expFlowStatus);
         }
-        ofile.close();
     
     } else {  // multifile == 1
 
@@ -385,17 +419,14 @@ int exportData( FlowRecord *frec, void *expData )
             if (rec->firstTime == 1) {
                 // done only at first export for this task
             }
-            createDir(filename2);
-            ofstream ofile(filename2.c_str(), ios::app);
-            chown( filename.c_str(), rec->exportUID, rec->exportGID );
+            ostream &ofile = getFile(rec, filename2);
 
 #ifdef DEBUG	    
             cerr << "export from proc module: " << mdata->getModName() << endl;
 #endif
             result += exportMetricData(frec->getRuleName(), mdata, ofile, rec->expFlowId, frec->isFinal(),
 				       rec->expFlowStatus);
-            ofile << endl << endl;
-            ofile.close();
+            ofile << "\n\n";
         }
     }
 
@@ -428,6 +459,6 @@ char* getModuleInfo( int i )
 
 timers_t* getTimers()
 {
-    return NULL;
+    return timers;
 }
 
@@ -45,6 +45,7 @@ extern "C" {
 #include "ConfigManager.h"
 #include "./ExportModule.h"
 #include "Rule.h"
+#include "ExportFormat.h"
 #include "ConfigParser.h"
 #include "../netmate/ProcModule.h"
 
@@ -292,88 +293,6 @@ int destroyExportRec( void *expRecord )
 }
 
 
-/* -------------------- writeData (local function) -------------------- */
-
-inline static void writeData( ostringstream &str, DataType_e type, const char *dpos )
-{
-    //fprintf(stderr, "%s %x \n", ProcModule::typeLabel(type), dpos);
-
-    switch (type) {
-    case CHAR: 
-        str << *dpos;
-        break;
-    case INT8:
-        str << (short)*dpos; 
-        break;
-    case UINT8:	
-        str << (unsigned short)*((unsigned char*)dpos); 
-        break;
-    case INT16:
-        str << *((short*)dpos); 
-        break;
-    case UINT16:
-        str << *((unsigned short*)dpos); 
-        break;
-    case INT32:
-        str << *((int32_t*)dpos); 
-        break;
-    case UINT32:
-        str << *((uint32_t*)dpos); 
-        break;
-    case IPV4ADDR:
-      {
-          char buf[64];
-          str << inet_ntop(AF_INET, dpos, buf, sizeof(buf));
-      }
-      break;
-    case IPV6ADDR:
-      {
-          char buf[64];
-          str << inet_ntop(AF_INET6, dpos, buf, sizeof(buf));
-      }
-      break;
-    case INT64:
-        str << *((int64_t*)dpos);
-        break;
-    case UINT64:
-        str << *((uint64_t*)dpos); 
-        break;
-    case FLOAT:
-        str << *((float*)dpos); 
-        break;
-    case DOUBLE:
-        str << *((double*)dpos); 
-        break;
-    case STRING:   
-        str << dpos; 
-        break;
-    case LIST:
-        break;
-    case BINARY:
-      {
-	  // get length
-          unsigned int len = *((unsigned int *)dpos);
-          dpos += sizeof(unsigned int);
-
-          if (len > 0) {
-            str << "0x" << hex << setfill('0');
-
-            // print binary as hex bytes
-            for (unsigned int i=0; i < len; i++) {
-                  str << setw(2) << (short) *((unsigned char *)dpos);
-                  dpos += 1;
-            }
-            str << dec;
-          }
-
-      }
-      break;
-    default:
-        break;
-    }
-}
-
-
 /* ------------------- exportMetricData (local function) ------------------- */
 
 static int exportMetricData( string taskName, MetricData *mdata,
@@ -387,6 +306,7 @@ static int exportMetricData( string taskName, MetricData *mdata,
     const char *str;
     int newFlow;
     unsigned long long flowId;
+    TextRow row;
 
     gettimeofday(&tval,NULL);
     strftime(tstamp, sizeof(tstamp), "%b %d %H:%M:%S", localtime_r((time_t *)&tval.tv_sec, &tm));
@@ -397,43 +317,46 @@ static int exportMetricData( string taskName, MetricData *mdata,
         while ((nrows = mdata->getNextFlow(&flowId, &newFlow)) > -1) {
             for (int i=0; i<nrows; i++) {
 	        char c = '\0';
-		ostringstream ostr;
+
+		row.clear();
 
 		if (expFlowId) {
-		  ostr << flowId << ",";
+		  row.addUInt(flowId);
+		  row.addChar(',');
 		}
 		if (expFlowStatus) {
-		  ostr << final << ",";
+		  row.addInt(final);
+		  row.addChar(',');
 		}
                 
                 // print flow key
                 while((str = mdata->getNextFlowKey(&type)) != NULL) {
 		  if (c != '\0') {
-		    ostr << c;
+		    row.addChar(c);
 		  }
 		  c = ',';
-		  writeData(ostr, type, str);
+		  row.addData(type, str);
                 }
                 
                 // print flow data
                 while((str = mdata->getNextFlowDataRow(&type)) != NULL) {
 		  if (c != '\0') {
-                    ostr << c;
+                    row.addChar(c);
 		  }
 		  c = ',';
-		  writeData(ostr, type, str);
+		  row.addData(type, str);
                 }
-                ostr << endl;
+                row.addChar('\n');
 
 		// hand over to UDP socket
-		if ((netBuffer.size() + ostr.tellp()) > 1470) {
+		if ((netBuffer.size() + row.getLength()) > 1470) {
 		  if (send(sock, (void *) netBuffer.c_str(), netBuffer.size(), 0) == -1) {
 		    warn(500, "send(): %s", strerror(errno));
 		  }
 		  
-		  netBuffer = ostr.str();
+		  netBuffer.assign(row.getData(), row.getLength());
 		} else {
-		  netBuffer += ostr.str();
+		  netBuffer.append(row.getData(), row.getLength());
 		}
             }
         }
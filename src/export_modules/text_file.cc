@@ -35,6 +35,7 @@ $Id: text_file.cc 748 2009-09-10 02:54:03Z szander $
 #include "./ExportModule.h"
 #include "Rule.h"
 #include "ConfigParser.h"
+#include "ExportFiles.h"
 
 
 
@@ -54,8 +55,23 @@ typedef struct {
     uid_t exportGID;
     int expFlowId;
     int expFlowStatus;
+    set<string> files;  // export files used by this task
+    compression_t compression;
+    int compThreads;    // number of threads compressing a file
 } exportRecord_t;
 
+// export files, kept open between exports and shared with the other
+// file export modules
+static ExportFiles *exportFiles;
+
+// export records of all tasks using this module, timeout flushes their files
+static set<exportRecord_t *> records;
+
+static timers_t timers[] = { /* handle, ival_msec, flags */
+    { 1, 1000, TM_RECURRING },  // flush export files
+    TIMER_END
+};
+
 
 // FIXME how to throw exceptions from inside the shared lib?
 void die(int code, char *fmt, ...)
@@ -71,6 +87,21 @@ void die(int code, char *fmt, ...)
     exit(code);
 }
 
+//! get the export file filename used by a task (opened at first use)
+static ostream &getFile(exportRecord_t *rec, string filename)
+{
+    ostream *ofile = NULL;
+
+    try {
+        ofile = &exportFiles->acquire(rec->files, filename, rec->compression,
+                                      rec->compThreads, rec->exportUID, rec->exportGID);
+    } catch (Error &e) {
+        die(1, "Unable to open %s: %s", filename.c_str(), e.getError().c_str());
+    }
+
+    return *ofile;
+}
+
 /* -------------------- initModule -------------------- */
 
 int initModule( ConfigManager *confMan )
@@ -84,6 +115,8 @@ int initModule( ConfigManager *confMan )
     }
     exportFilename = confMan->getValue("ExportFilename", "EXPORTER", "text_file");
 
+    exportFiles = ExportFiles::getInstance();
+
     return 0;
 }
 
@@ -122,6 +155,14 @@ int initExportRec( configItemList_t conf, void **expRecord )
         rec->exportFilename = exportFilename;
     } 
 
+    // compress the export files (none, gzip or zstd)
+    try {
+        rec->compression = AsyncWriter::parseCompression(conf.getValue("Compression"));
+    } catch (Error &e) {
+        die(1, "%s", e.getError().c_str());
+    }
+    rec->compThreads = atoi(conf.getValue("CompressionThreads").c_str());
+
     // check if we have an ExportUser specified in the config file
     string exportUserName = conf.getValue("ExportUser");
     if (exportUserName.empty()) {
@@ -135,6 +176,9 @@ int initExportRec( configItemList_t conf, void **expRecord )
         }
     }
 
+    AUTOLOCK(1, exportFiles->getLock());
+    records.insert(rec);
+
     *((exportRecord_t **) expRecord) = rec;
 
     return 0;
@@ -145,7 +189,14 @@ int initExportRec( configItemList_t conf, void **expRecord )
 
 int destroyExportRec( void *expRecord )
 {
-    delete (exportRecord_t *) expRecord;
+    exportRecord_t *rec = (exportRecord_t *) expRecord;
+
+    AUTOLOCK(1, exportFiles->getLock());
+
+    exportFiles->release(rec->files);
+    records.erase(rec);
+
+    delete rec;
     return 0;
 }
 
@@ -154,14 +205,20 @@ int destroyExportRec( void *expRecord )
 
 int timeout( int id )
 {
-    // called by netmate if module has timers defined - in text_file module unused!
+    AUTOLOCK(1, exportFiles->getLock());
+
+    // write out the buffered data of the files used by this module
+    for (set<exportRecord_t *>::iterator r = records.begin(); r != records.end(); ++r) {
+        exportFiles->flush((*r)->files);
+    }
+
     return 0;
 }
 
 
 /* -------------------- writeData (local function) -------------------- */
 
-inline static void writeData( ofstream &ofile, DataType_e type, const char *dpos )
+inline static void writeData( ostream &ofile, DataType_e type, const char *dpos )
 {
     // fprintf(stderr, "%s %x \n", ProcModule::typeLabel(type), dpos);
 
@@ -243,7 +300,7 @@ inline static void writeData( ofstream &ofile, DataType_e type, const char *dpos
 /* ------------------- exportMetricData (local function) ------------------- */
 
 static int exportMetricData( string taskName, MetricData *mdata,
-                             ofstream &ofile, int expFlowId, int final, int expFlowStatus )
+                             ostream &ofile, int expFlowId, int final, int expFlowStatus )
 {
     int nrows;
     DataType_e type;
@@ -286,7 +343,7 @@ static int exportMetricData( string taskName, MetricData *mdata,
             ofile << " " << str;
         }
 
-        ofile << endl;
+        ofile << "\n";
 
         while ((nrows = mdata->getNextFlow(&flowId, &newFlow)) > -1) {
             for (int i=0; i<nrows; i++) {
@@ -314,34 +371,15 @@ static int exportMetricData( string taskName, MetricData *mdata,
                     c = ',';
                     writeData(ofile, type, str);
                 }
-                ofile << endl;
+                ofile << "\n";
             }
         }
-        ofile << endl;
+        ofile << "\n";
     }
     return 0;
 }
 
 
-void createDir(string filename)
-{  
-    int successMkdir = 0;
-    int i = 0;
-
-    // create all directories above the file
-    while ((i = filename.find('/', i+1)) != -1) {
-        struct stat statbuf;
-        if (!(stat(filename.substr(0, i).c_str(), &statbuf) == 0 &&
-              (S_ISDIR(statbuf.st_mode)))) {
-            successMkdir = mkdir(filename.substr(0, i).c_str(), 0777);
-            if (successMkdir != 0) {
-                die(1, "Unable to make directory for %s: %s", filename.c_str(), 
-                    strerror(errno));
-            }
-        }
-    }
-}
-
 /* -------------------- exportData (part of export API) -------------------- */
 
 int exportData( FlowRecord *frec, void *expData ) 
@@ -361,6 +399,8 @@ int exportData( FlowRecord *frec, void *expData )
 
     rec = (exportRecord_t *)expData;
 
+    AUTOLOCK(1, exportFiles->getLock());
+
     // use rule name as export file name if none was supplied explicitly
     if (rec->exportFilename.empty()) {
         filename = exportDir + frec->getRuleName();
@@ -383,12 +423,7 @@ int exportData( FlowRecord *frec, void *expData )
         if (rec->firstTime == 1) {
             // done only at first export for this task
         }
-        createDir(filename);
-        ofstream ofile(filename.c_str(), ios::app);
-        if (!ofile) {
-                die(1, "Unable to open %s", filename.c_str());
-        }
-        chown( filename.c_str(), rec->exportUID, rec->exportGID );
+        ostream &ofile = getFile(rec, filename);
 
         // data from multiple packet proc modules can be in one FlowRecord
         while ((mdata = frec->getNextData()) != NULL) {
@@ -397,9 +432,8 @@ int exportData( FlowRecord *frec, void *expData )
 #endif
             result += exportMetricData(frec->getRuleName(), mdata, ofile, rec->expFlowId,
 				       frec->isFinal(), rec->expFlowStatus);
-            ofile << endl << endl;
+            ofile << "\n\n";
         }
-        ofile.close();
     
     } else {  // multifile == 1
 
@@ -413,17 +447,14 @@ int exportData( FlowRecord *frec, void *expData )
             if (rec->firstTime == 1) {
                 // done only at first export for this task
             }
-            createDir(filename2);
-            ofstream ofile(filename2.c_str(), ios::app);
-            chown( filename.c_str(), rec->exportUID, rec->exportGID );
+            ostream &ofile = getFile(rec, filename2);
 
 #ifdef DEBUG	    
             cerr << "export from proc module: " << mdata->getModName() << endl;
 #endif
             result += exportMetricData(frec->getRuleName(), mdata, ofile, rec->expFlowId,
 				       frec->isFinal(), rec->expFlowStatus);
-            ofile << endl << endl;
-            ofile.close();
+            ofile << "\n\n";
         }
     }
 
@@ -456,6 +487,6 @@ char* getModuleInfo( int i )
 
 timers_t* getTimers()
 {
-    return NULL;
+    return timers;
 }
 
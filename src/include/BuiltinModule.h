@@ -0,0 +1,127 @@
+
+/*! \file  BuiltinModule.h
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    support for modules linked into the meter (--enable-builtin-modules)
+
+    A built-in module is compiled with BUILTIN_MODULE set to its name. Like
+    libtool's preloaded modules all its global symbols get the prefix
+    <module>_LTX_ so that several modules can be linked into one binary.
+    The meter finds the symbols it would otherwise look up with dlsym in
+    the table <module>_LTX_builtinSymbols. This header is included before
+    anything else when such a module is compiled (gcc -include), so names
+    are replaced consistently in all headers the module uses.
+
+    $Id$
+*/
+
+#ifndef __BUILTINMODULE_H
+#define __BUILTINMODULE_H
+
+
+//! name of symbol s of built-in module m
+#define LTX_NAME2(m, s)  m ## _LTX_ ## s
+#define LTX_NAME(m, s)   LTX_NAME2(m, s)
+
+//! symbol table of built-in module m
+#define BUILTIN_SYMBOLS(m)  LTX_NAME(m, builtinSymbols)
+
+/*! modules linked into the meter by configure --enable-builtin-modules,
+    M(m) is expanded for each module m. The meter builds its module table
+    and the direct calls of the module functions from these lists, the
+    objects are listed in BUILTIN_OBJS in src/netmate/Makefile.am */
+#define BUILTIN_PROC_MODULES(M)    M(count) M(netai_flowstats)
+#define BUILTIN_EXPORT_MODULES(M)  M(ac_file) M(netai_arff)
+
+
+/*! symbol of a built-in module (table ends with name NULL) */
+typedef struct {
+    const char *name;
+    void *addr;
+} builtinSymbol_t;
+
+/*! entry of the list of modules linked into the meter */
+typedef struct {
+    const char *name;
+    builtinSymbol_t *symbols;
+} builtinModule_t;
+
+
+#ifdef BUILTIN_MODULE
+
+#define LTX(s)  LTX_NAME(BUILTIN_MODULE, s)
+
+/* symbols of all module types */
+#define magic              LTX(magic)
+#define func               LTX(func)
+#define builtinSymbols     LTX(builtinSymbols)
+#define initModule         LTX(initModule)
+#define destroyModule      LTX(destroyModule)
+#define timeout            LTX(timeout)
+#define getTimers          LTX(getTimers)
+#define exportData         LTX(exportData)
+#define getModuleInfo      LTX(getModuleInfo)
+#define getErrorMsg        LTX(getErrorMsg)
+
+/* processing modules */
+#define exportInfo         LTX(exportInfo)
+#define initFlowRec        LTX(initFlowRec)
+#define destroyFlowRec     LTX(destroyFlowRec)
+#define resetFlowRec       LTX(resetFlowRec)
+#define processPacket      LTX(processPacket)
+#define processPackets     LTX(processPackets)
+#define dumpData           LTX(dumpData)
+#define getTypeInfo        LTX(getTypeInfo)
+#define getFlowRecSize     LTX(getFlowRecSize)
+#define initRuleConfig     LTX(initRuleConfig)
+#define destroyRuleConfig  LTX(destroyRuleConfig)
+#define _dest              LTX(_dest)
+#define _pos               LTX(_pos)
+#define _listlen           LTX(_listlen)
+#define _listpos           LTX(_listpos)
+#define STARTEXPORT        LTX(STARTEXPORT)
+#define ENDEXPORT          LTX(ENDEXPORT)
+#define ADD_CHAR           LTX(ADD_CHAR)
+#define ADD_INT8           LTX(ADD_INT8)
+#define ADD_INT16          LTX(ADD_INT16)
+#define ADD_INT32          LTX(ADD_INT32)
+#define ADD_INT64          LTX(ADD_INT64)
+#define ADD_UINT8          LTX(ADD_UINT8)
+#define ADD_UINT16         LTX(ADD_UINT16)
+#define ADD_UINT32         LTX(ADD_UINT32)
+#define ADD_UINT64         LTX(ADD_UINT64)
+#define ADD_FLOAT          LTX(ADD_FLOAT)
+#define ADD_DOUBLE         LTX(ADD_DOUBLE)
+#define ADD_IPV4ADDR       LTX(ADD_IPV4ADDR)
+#define ADD_LIST           LTX(ADD_LIST)
+#define END_LIST           LTX(END_LIST)
+#define ADD_STRING         LTX(ADD_STRING)
+#define ADD_BINARY         LTX(ADD_BINARY)
+
+/* export modules */
+#define resetModule        LTX(resetModule)
+#define initExportRec      LTX(initExportRec)
+#define destroyExportRec   LTX(destroyExportRec)
+
+#endif /* BUILTIN_MODULE */
+
+#endif /* __BUILTINMODULE_H */
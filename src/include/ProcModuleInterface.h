@@ -44,6 +44,9 @@ typedef struct {
 //! short   the magic number that will be embedded into every action module
 #define PROC_MAGIC   ('N'<<24 | 'M'<<16 | '_'<<8 | 'P')
 
+//! short   version of the module API (modules built for version 3 are still loaded)
+#define PROC_API_VERSION  4
+
 
 /*! 
     DataType_e identifiers are used within the runtime type 
@@ -137,14 +140,40 @@ int initModule();
 int destroyModule();
 
 
-/*! \short   return size of (initial) flow data record for this module
+/*! \short   return size of the flow data record for this module
+
+    If the size is greater than 0 the flow data records are allocated
+    by the meter (auto flows from a pool per flow table) and initFlowRec
+    gets the record in *flowdata and initializes it in place. destroyFlowRec
+    must not free such a record. Modules returning 0 allocate and free 
+    their records themselves.
 
-    A piece of memory with the number of bytes returned by this function
-    will be allocated initially for a new rule that makes use of this action.
-    \returns size required for storage of flow data per rule
+    \returns size of a flow data record, 0 if allocated by the module
 */
-//  int getFlowRecSize();
-//  deprecated!!!  removed from API 2003/04/14
+int getFlowRecSize();
+
+
+/*! \short   parse the module parameters of a rule
+
+    Called once when a rule is added (and when its parameters are checked).
+    The configuration is shared by all flow records of the rule and passed 
+    to initFlowRec, so that parameters need not be parsed and stored again
+    for every new flow. Optional, without it a rule has no configuration.
+
+    \arg \c  params - module parameter text from inside '( )'
+    \arg \c  config - place for the parsed configuration (NULL if none)
+    \returns 0 - on success (parameters are valid), <0 - else
+*/
+int initRuleConfig( configParam_t *params, void **config );
+
+
+/*! \short   free the configuration of a rule created by initRuleConfig
+
+    Called after all flow records of the rule have been destroyed, optional.
+    \arg \c  config - configuration returned by initRuleConfig
+    \returns 0 - on success, <0 - else
+*/
+int destroyRuleConfig( void *config );
 
 
 /*! \short   initialize flow data record for a rule
@@ -154,10 +183,11 @@ int destroyModule();
     module parameter string can be parsed and checked
 
     \arg \c  params - module parameter text from inside '( )'
+    \arg \c  config - configuration of the rule from initRuleConfig
     \arg \c  flowdata  - place for action module specific data from flow table
     \returns 0 - on success (parameters are valid), <0 - else
 */
-int initFlowRec( configParam_t *params, void **flowdata );
+int initFlowRec( configParam_t *params, void *config, void **flowdata );
 
 
 /*! \short   get list of default timers for this proc module
@@ -196,6 +226,32 @@ int resetFlowRec( void *flowdata );
 int processPacket( char *packet, metaData_t *meta, void *flowdata );  
 
 
+/*! packet and flow record handed to processPackets */
+typedef struct {
+    char *packet;
+    metaData_t *meta;
+    void *flowdata;
+} procPacket_t;
+
+typedef int (*proc_packets_func_t)( procPacket_t *pkts, int num );
+
+
+/*! \short   analyse a batch of datagrams (optional)
+
+    Modules may implement this in addition to processPacket. It is looked
+    up by name when the module is loaded and is not part of the function
+    list. The meter then hands over all packets of a rule that it takes
+    from the queue at once (packets of the same flow in order). A module
+    providing it must never request instant retrieval of measurement data
+    (processPacket returning 1), the return value is per batch only.
+
+    \arg \c  pkts  - packets with meta data and flow data, \sa processPacket
+    \arg \c  num   - number of packets
+    \returns 0 - on success, <0 - else
+*/
+int processPackets( procPacket_t *pkts, int num );
+
+
 /*! \short   save flow- and action- specific in TLV-like format
 
     \arg \c  exportdata - store location of export data here
@@ -286,7 +342,7 @@ typedef struct {
     int (*destroyModule)();
 
     /*    int (*getFlowRecSize)(); -- deprecated -- */
-    int (*initFlowRec)( configParam_t *params, void **flowdata );
+    int (*initFlowRec)( configParam_t *params, void *config, void **flowdata );
     timers_t* (*getTimers)( void *flowdata );
     int (*destroyFlowRec)( void *flowdata );
 
@@ -301,6 +357,11 @@ typedef struct {
 
     typeInfo_t* (*getTypeInfo)();
 
+    // since version 4
+    int (*getFlowRecSize)();
+    int (*initRuleConfig)( configParam_t *params, void **config );
+    int (*destroyRuleConfig)( void *config );
+
 } ProcModuleInterface_t;
 
 #endif /* __PROCMODULEINTERFACE_H */
@@ -124,8 +124,13 @@ typedef struct {
     unsigned short match_cnt;
     unsigned int match[MAX_RULES_MATCH]; 
 
-    // pointer to the data
-    unsigned char payload[1];
+    // pointer to the packet data, this points to data below once the 
+    // packet is stored in the packet queue but a net tap may let it point
+    // into its capture buffer before (e.g. during classification)
+    unsigned char *payload;
+
+    // the packet data
+    unsigned char data[1];
 } metaData_t;
 
 #endif
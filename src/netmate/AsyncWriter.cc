@@ -0,0 +1,457 @@
+/*! \file  AsyncWriter.cc
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    buffered file output written (and optionally compressed) by separate
+    threads
+
+    $Id$
+*/
+
+#include "AsyncWriter.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+#ifdef HAVE_ZLIB
+//! window bits for deflate with a gzip header
+const int GZIP_WINDOW_BITS = 15 + 16;
+#endif
+
+#ifdef HAVE_ZSTD
+const int ZSTD_LEVEL = 3;
+#endif
+
+
+/* ------------------------- AsyncWriter ------------------------- */
+
+AsyncWriter::AsyncWriter(string filename, compression_t compression, int nthreads,
+                         unsigned long bsize)
+    : fname(filename), comp(compression), bufSize(bsize), outSize(0), curr(0), err(0)
+{
+    // more than one writer only helps compressing
+    if ((comp == COMPRESS_NONE) || (nthreads < 1)) {
+        nthreads = 1;
+    } else if (nthreads > MAX_WRITER_THREADS) {
+        nthreads = MAX_WRITER_THREADS;
+    }
+
+    switch (comp) {
+#ifdef HAVE_ZLIB
+    case COMPRESS_GZIP:
+        // compressBound is for the zlib wrapper, the gzip wrapper is larger
+        outSize = compressBound(bufSize) + 18;
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+        outSize = ZSTD_compressBound(bufSize);
+        break;
+#endif
+    case COMPRESS_NONE:
+        break;
+    default:
+        throw Error("unsupported compression for %s", fname.c_str());
+    }
+
+    fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw Error("cannot open %s: %s", fname.c_str(), strerror(errno));
+    }
+
+#ifdef ENABLE_THREADS
+    numBufs = nthreads + 1;
+#else
+    numBufs = 1;
+#endif
+
+    bufs = new writerBuf_t[numBufs];
+    for (int i = 0; i < numBufs; i++) {
+        initBuf(&bufs[i]);
+    }
+    setp(bufs[curr].data, bufs[curr].data + bufSize);
+
+#ifdef ENABLE_THREADS
+    numThreads = 0;
+    nextComp = 0;
+    nextWrite = 0;
+    writing = 0;
+    stop = 0;
+    mutexInit(&access);
+    threadCondInit(&workCond);
+    threadCondInit(&doneCond);
+
+    for (; numThreads < nthreads; numThreads++) {
+        int res = threadCreate(&threads[numThreads], writerThread, this);
+        if (res != 0) {
+            if (numThreads > 0) {
+                // continue with fewer writers
+                break;
+            }
+
+            threadCondDestroy(&doneCond);
+            threadCondDestroy(&workCond);
+            mutexDestroy(&access);
+            close(fd);
+            for (int i = 0; i < numBufs; i++) {
+                freeBuf(&bufs[i]);
+            }
+            delete[] bufs;
+            throw Error("cannot create writer thread for %s: %s", fname.c_str(),
+                        strerror(res));
+        }
+    }
+#endif
+}
+
+
+/* ------------------------- ~AsyncWriter ------------------------- */
+
+AsyncWriter::~AsyncWriter()
+{
+    handOver();
+
+#ifdef ENABLE_THREADS
+    mutexLock(&access);
+
+    // wait until all buffers are written
+    for (int i = 0; i < numBufs; i++) {
+        while (bufs[i].state != BUF_FREE) {
+            threadCondWait(&doneCond, &access);
+        }
+    }
+
+    stop = 1;
+    threadCondBroadcast(&workCond);
+    mutexUnlock(&access);
+
+    for (int i = 0; i < numThreads; i++) {
+        threadJoin(threads[i]);
+    }
+
+    threadCondDestroy(&doneCond);
+    threadCondDestroy(&workCond);
+    mutexDestroy(&access);
+#endif
+
+    close(fd);
+
+    for (int i = 0; i < numBufs; i++) {
+        freeBuf(&bufs[i]);
+    }
+    delete[] bufs;
+}
+
+
+void AsyncWriter::initBuf(writerBuf_t *b)
+{
+    b->data = new char[bufSize];
+    b->len = 0;
+    b->out = NULL;
+    b->outLen = 0;
+    b->ctx = NULL;
+    b->state = BUF_FREE;
+
+    switch (comp) {
+#ifdef HAVE_ZLIB
+    case COMPRESS_GZIP:
+      {
+          z_stream *zs = new z_stream;
+
+          memset(zs, 0, sizeof(z_stream));
+          if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS,
+                           8, Z_DEFAULT_STRATEGY) != Z_OK) {
+              delete zs;
+              zs = NULL;
+          }
+          b->ctx = zs;
+      }
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+        b->ctx = ZSTD_createCCtx();
+        break;
+#endif
+    default:
+        break;
+    }
+
+    if (comp != COMPRESS_NONE) {
+        b->out = new char[outSize];
+    }
+}
+
+
+void AsyncWriter::freeBuf(writerBuf_t *b)
+{
+    switch (comp) {
+#ifdef HAVE_ZLIB
+    case COMPRESS_GZIP:
+        if (b->ctx != NULL) {
+            deflateEnd((z_stream *) b->ctx);
+            delete (z_stream *) b->ctx;
+        }
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+        ZSTD_freeCCtx((ZSTD_CCtx *) b->ctx);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    delete[] b->out;
+    delete[] b->data;
+}
+
+
+void AsyncWriter::compressBuf(writerBuf_t *b)
+{
+    b->outLen = 0;
+
+    switch (comp) {
+#ifdef HAVE_ZLIB
+    case COMPRESS_GZIP:
+      {
+          z_stream *zs = (z_stream *) b->ctx;
+
+          if ((zs == NULL) || (deflateReset(zs) != Z_OK)) {
+              err = ENOMEM;
+              return;
+          }
+
+          // one complete gzip member per buffer
+          zs->next_in = (Bytef *) b->data;
+          zs->avail_in = b->len;
+          zs->next_out = (Bytef *) b->out;
+          zs->avail_out = outSize;
+
+          if (deflate(zs, Z_FINISH) != Z_STREAM_END) {
+              err = EIO;
+              return;
+          }
+          b->outLen = outSize - zs->avail_out;
+      }
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+      {
+          if (b->ctx == NULL) {
+              err = ENOMEM;
+              return;
+          }
+
+          // one complete zstd frame per buffer
+          size_t res = ZSTD_compressCCtx((ZSTD_CCtx *) b->ctx, b->out, outSize,
+                                         b->data, b->len, ZSTD_LEVEL);
+          if (ZSTD_isError(res)) {
+              err = EIO;
+              return;
+          }
+          b->outLen = res;
+      }
+      break;
+#endif
+    default:
+        break;
+    }
+}
+
+
+void AsyncWriter::writeBuf(writerBuf_t *b)
+{
+    const char *buf = b->data;
+    unsigned long len = b->len;
+
+    if (comp != COMPRESS_NONE) {
+        buf = b->out;
+        len = b->outLen;
+    }
+
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // drop the data, the error is reported by sync
+            err = errno;
+            return;
+        }
+
+        buf += n;
+        len -= n;
+    }
+}
+
+
+void AsyncWriter::handOver()
+{
+    unsigned long len = pptr() - pbase();
+
+    if (len == 0) {
+        return;
+    }
+
+    bufs[curr].len = len;
+
+#ifdef ENABLE_THREADS
+    {
+        AUTOLOCK(1, &access);
+
+        bufs[curr].state = BUF_READY;
+        threadCondSignal(&workCond);
+
+        // continue in the next buffer when the writers are done with it
+        curr = (curr + 1) % numBufs;
+        while (bufs[curr].state != BUF_FREE) {
+            threadCondWait(&doneCond, &access);
+        }
+    }
+#else
+    compressBuf(&bufs[curr]);
+    writeBuf(&bufs[curr]);
+    bufs[curr].len = 0;
+#endif
+
+    setp(bufs[curr].data, bufs[curr].data + bufSize);
+}
+
+
+int AsyncWriter::overflow(int c)
+{
+    handOver();
+
+    if (c != EOF) {
+        *pptr() = (char) c;
+        pbump(1);
+    }
+
+    return (c == EOF) ? 0 : c;
+}
+
+
+int AsyncWriter::sync()
+{
+    handOver();
+
+    return (err == 0) ? 0 : -1;
+}
+
+
+compression_t AsyncWriter::parseCompression(string name)
+{
+    if (name.empty() || (name == "none") || (name == "no")) {
+        return COMPRESS_NONE;
+    } else if (name == "gzip") {
+#ifdef HAVE_ZLIB
+        return COMPRESS_GZIP;
+#else
+        throw Error("gzip compression is not supported (no zlib)");
+#endif
+    } else if (name == "zstd") {
+#ifdef HAVE_ZSTD
+        return COMPRESS_ZSTD;
+#else
+        throw Error("zstd compression is not supported (no libzstd)");
+#endif
+    }
+
+    throw Error("unknown compression '%s'", name.c_str());
+}
+
+
+string AsyncWriter::getSuffix(compression_t compression)
+{
+    switch (compression) {
+    case COMPRESS_GZIP:
+        return ".gz";
+    case COMPRESS_ZSTD:
+        return ".zst";
+    default:
+        return "";
+    }
+}
+
+
+#ifdef ENABLE_THREADS
+
+void *AsyncWriter::writerThread(void *arg)
+{
+    AsyncWriter *w = (AsyncWriter *) arg;
+
+    mutexLock(&w->access);
+
+    for (;;) {
+        writerBuf_t *b = &w->bufs[w->nextComp];
+
+        if (b->state == BUF_READY) {
+            // compress without holding the lock, the buffer is not touched meanwhile
+            w->nextComp = (w->nextComp + 1) % w->numBufs;
+            b->state = BUF_BUSY;
+            mutexUnlock(&w->access);
+            w->compressBuf(b);
+            mutexLock(&w->access);
+            b->state = BUF_DONE;
+            continue;
+        }
+
+        b = &w->bufs[w->nextWrite];
+
+        if (!w->writing && (b->state == BUF_DONE)) {
+            // only one thread writes, buffers are written in order
+            w->writing = 1;
+            mutexUnlock(&w->access);
+            w->writeBuf(b);
+            mutexLock(&w->access);
+            w->writing = 0;
+
+            b->len = 0;
+            b->state = BUF_FREE;
+            w->nextWrite = (w->nextWrite + 1) % w->numBufs;
+            threadCondBroadcast(&w->doneCond);
+            continue;
+        }
+
+        if (w->stop) {
+            // all buffers are written
+            break;
+        }
+
+        threadCondWait(&w->workCond, &w->access);
+    }
+
+    mutexUnlock(&w->access);
+
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*! \file  AsyncWriter.h
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    buffered file output written (and optionally compressed) by separate
+    threads (used by the file export modules)
+
+    $Id$
+*/
+
+#ifndef _ASYNCWRITER_H_
+#define _ASYNCWRITER_H_
+
+
+#include "stdincpp.h"
+#include "Error.h"
+#include "Threads.h"
+
+
+//! compression of the data written by an AsyncWriter
+typedef enum {
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+} compression_t;
+
+//! default size of each buffer of an AsyncWriter
+const unsigned long DEF_WRITER_BUF = 256*1024;
+
+//! maximum number of writer threads of an AsyncWriter
+const int MAX_WRITER_THREADS = 32;
+
+
+/*! \short   stream buffer appending to a file from writer threads
+
+    Data is collected in a buffer. A full (or flushed) buffer is handed to
+    the writer threads of the file and filling continues in the next free
+    buffer, so the caller only waits if the writers cannot keep up.
+    Use it with an ostream:
+
+        AsyncWriter w("file");
+        ostream out(&w);
+
+    With compression each buffer is compressed into a gzip member or zstd
+    frame of its own. The file is the concatenation of these, which gzip and
+    zstd decompress as a whole. Because the buffers are independent several
+    writer threads can compress them in parallel, they are still written in
+    the order they were filled. Without thread support the buffers are
+    compressed and written synchronously.
+*/
+
+class AsyncWriter : public streambuf
+{
+  private:
+
+    //! file name
+    string fname;
+
+    //! file descriptor
+    int fd;
+
+    compression_t comp;
+
+    //! state of a buffer
+    typedef enum {
+        BUF_FREE = 0,  //!< empty or being filled by the caller
+        BUF_READY,     //!< handed over, waits for compression
+        BUF_BUSY,      //!< being compressed
+        BUF_DONE       //!< waits to be written
+    } bufState_t;
+
+    typedef struct {
+        char *data;
+        unsigned long len;
+        //! compressed data (NULL without compression)
+        char *out;
+        unsigned long outLen;
+        //! compression context (z_stream or ZSTD_CCtx)
+        void *ctx;
+        bufState_t state;
+    } writerBuf_t;
+
+    //! the buffers (one more than writer threads)
+    writerBuf_t *bufs;
+    int numBufs;
+
+    //! size of each buffer and of its compressed data
+    unsigned long bufSize, outSize;
+
+    //! index of the buffer being filled
+    int curr;
+
+    //! errno of the last failed write (0 = no error)
+    int err;
+
+#ifdef ENABLE_THREADS
+    thread_t threads[MAX_WRITER_THREADS];
+    int numThreads;
+    mutex_t access;
+
+    //! next buffer to compress and next buffer to write
+    int nextComp, nextWrite;
+
+    //! set while a thread writes to the file
+    int writing;
+
+    //! signalled when a buffer is handed over or the writers should stop
+    thread_cond_t workCond;
+
+    //! signalled when a buffer is free again
+    thread_cond_t doneCond;
+
+    int stop;
+
+    //! main function of the writer threads
+    static void *writerThread(void *arg);
+#endif
+
+    //! allocate the compression state of a buffer
+    void initBuf(writerBuf_t *b);
+
+    //! free a buffer
+    void freeBuf(writerBuf_t *b);
+
+    //! compress the data of a buffer (nothing to do without compression)
+    void compressBuf(writerBuf_t *b);
+
+    //! write a buffer to the file (does not return before all is written)
+    void writeBuf(writerBuf_t *b);
+
+    //! give the filled part of the current buffer to the writers
+    void handOver();
+
+  protected:
+
+    //! the current buffer is full
+    virtual int overflow(int c);
+
+    //! hand over buffered data (does not wait until it is written)
+    virtual int sync();
+
+  public:
+
+    /*! \short   open a file for appending and start its writers
+        \arg \c filename     file to append to (created if missing)
+        \arg \c compression  compression of the data
+        \arg \c nthreads     number of writer threads (compressing in parallel)
+        \arg \c bsize        size of each buffer
+    */
+    AsyncWriter(string filename, compression_t compression = COMPRESS_NONE,
+                int nthreads = 1, unsigned long bsize = DEF_WRITER_BUF);
+
+    //! write all remaining data, stop the writers and close the file
+    virtual ~AsyncWriter();
+
+    /*! \short   get the compression named by an export preference
+        \arg \c name  none (or empty), gzip or zstd
+        \throws Error if the name is unknown or the compression is not supported
+    */
+    static compression_t parseCompression(string name);
+
+    //! file name suffix of a compression (empty for none)
+    static string getSuffix(compression_t compression);
+
+    //! return the errno of the last failed write or 0
+    int getError()
+    {
+        return err;
+    }
+
+    string getFileName()
+    {
+        return fname;
+    }
+};
+
+
+#endif // _ASYNCWRITER_H_
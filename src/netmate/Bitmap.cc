@@ -30,6 +30,270 @@
 
 #include "Bitmap.h"
 
+// x86 vector versions of the kernels, selected at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define BITMAP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+/* ------------------------- kernels ------------------------- */
+
+/*! and n elements of a and b into r
+    returns the index of the highest non-zero element of r (0 if none)
+*/
+typedef int (*andFunc_t)(const unsigned long long *a, const unsigned long long *b,
+                         unsigned long long *r, int n);
+
+//! test whether n elements of a and b are equal
+typedef int (*equalFunc_t)(const unsigned long long *a, const unsigned long long *b,
+                           int n);
+
+
+/*! index of the highest non-zero element of r from first to last,
+    first if all elements above it are zero
+*/
+static inline int highestElem(const unsigned long long *r, int first, int last)
+{
+    for (int i = last; i > first; i--) {
+        if (r[i] != 0ULL) {
+            return i;
+        }
+    }
+
+    return first;
+}
+
+
+static int andScalar(const unsigned long long *a, const unsigned long long *b,
+                     unsigned long long *r, int n)
+{
+    int top = 0;
+
+    for (int i = 0; i < n; i++) {
+        r[i] = a[i] & b[i];
+        if (r[i] != 0ULL) {
+            top = i;
+        }
+    }
+
+    return top;
+}
+
+
+static int equalScalar(const unsigned long long *a, const unsigned long long *b, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+#ifdef BITMAP_X86_KERNELS
+
+__attribute__((target("sse2")))
+static int andSSE2(const unsigned long long *a, const unsigned long long *b,
+                   unsigned long long *r, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    // first element of the last non-zero block
+    int top = -1;
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (a + i)),
+                                  _mm_loadu_si128((const __m128i *) (b + i)));
+
+        _mm_storeu_si128((__m128i *) (r + i), v);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF) {
+            top = i;
+        }
+    }
+    if (i < n) {
+        r[i] = a[i] & b[i];
+        if (r[i] != 0ULL) {
+            return i;
+        }
+    }
+
+    return (top < 0) ? 0 : highestElem(r, top, top + 1);
+}
+
+
+__attribute__((target("sse2")))
+static int equalSSE2(const unsigned long long *a, const unsigned long long *b, int n)
+{
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+                                   _mm_loadu_si128((const __m128i *) (b + i)));
+
+        if (_mm_movemask_epi8(v) != 0xFFFF) {
+            return 0;
+        }
+    }
+
+    return (i == n) || (a[i] == b[i]);
+}
+
+
+__attribute__((target("avx2")))
+static int andAVX2(const unsigned long long *a, const unsigned long long *b,
+                   unsigned long long *r, int n)
+{
+    // first element of the last non-zero block
+    int top = -1;
+    int last = -1;
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                     _mm256_loadu_si256((const __m256i *) (b + i)));
+
+        _mm256_storeu_si256((__m256i *) (r + i), v);
+        if (!_mm256_testz_si256(v, v)) {
+            top = i;
+        }
+    }
+    for (; i < n; i++) {
+        r[i] = a[i] & b[i];
+        if (r[i] != 0ULL) {
+            last = i;
+        }
+    }
+
+    if (last >= 0) {
+        return last;
+    }
+
+    return (top < 0) ? 0 : highestElem(r, top, top + 3);
+}
+
+
+__attribute__((target("avx2")))
+static int equalAVX2(const unsigned long long *a, const unsigned long long *b, int n)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                     _mm256_loadu_si256((const __m256i *) (b + i)));
+
+        if (!_mm256_testz_si256(v, v)) {
+            return 0;
+        }
+    }
+    for (; i < n; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+#endif // BITMAP_X86_KERNELS
+
+
+//! kernels used by the bitmap functions
+typedef struct {
+    andFunc_t   andElems;
+    equalFunc_t equalElems;
+    const char *name;
+} kernels_t;
+
+static kernels_t selectKernels()
+{
+    kernels_t k = { andScalar, equalScalar, "scalar" };
+
+#ifdef BITMAP_X86_KERNELS
+    // may run before the constructors of libgcc
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        k.andElems = andAVX2;
+        k.equalElems = equalAVX2;
+        k.name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        k.andElems = andSSE2;
+        k.equalElems = equalSSE2;
+        k.name = "sse2";
+    }
+#endif
+
+    return k;
+}
+
+static const kernels_t kernels = selectKernels();
+
+
+/* ------------------------- bitmap ------------------------- */
+
+
+bitmap::bitmap(int nelem)
+  : msb(0), size(nelem)
+{
+    b = new unsigned long long[size];
+    memset(b, 0, size * BITMAP_ELEM_SIZE);
+}
+
+
+bitmap::bitmap(const struct bitmap &bm)
+  : msb(bm.msb), size(bm.size)
+{
+    b = new unsigned long long[size];
+    memcpy(b, bm.b, size * BITMAP_ELEM_SIZE);
+}
+
+
+bitmap::~bitmap()
+{
+    delete[] b;
+}
+
+
+struct bitmap &bitmap::operator=(const struct bitmap &bm)
+{
+    if (this != &bm) {
+        if (size != bm.size) {
+            delete[] b;
+            size = bm.size;
+            b = new unsigned long long[size];
+        }
+        msb = bm.msb;
+        memcpy(b, bm.b, size * BITMAP_ELEM_SIZE);
+    }
+
+    return *this;
+}
+
+
+//! change the number of elements of bm
+void bmResize(bitmap_t *bm, int nelem)
+{
+    unsigned long long *nb = new unsigned long long[nelem];
+    int keep = (nelem < bm->size) ? nelem : bm->size;
+
+    memcpy(nb, bm->b, keep * BITMAP_ELEM_SIZE);
+    memset(nb + keep, 0, (nelem - keep) * BITMAP_ELEM_SIZE);
+    delete[] bm->b;
+    bm->b = nb;
+    bm->size = nelem;
+
+    if (bm->msb >= nelem) {
+        bm->msb = nelem - 1;
+    }
+    while ((bm->msb > 0) && ((bm->b)[bm->msb] == 0ULL)) {
+    	bm->msb -= 1;
+    }
+}
+
 
 //! test if bit bpos is set in bm
 int bmTest(bitmap_t *bm, unsigned long long bpos)
@@ -61,8 +325,8 @@ void bmReset(bitmap_t *bm, unsigned long long bpos)
 //! set all bits in bm
 void bmSet(bitmap_t *bm)
 {
-    bm->msb = BITMAP_SIZE-1;
-    memset((bm->b), 0xFF, BITMAP_SIZE * BITMAP_ELEM_SIZE);
+    bm->msb = bm->size-1;
+    memset((bm->b), 0xFF, bm->size * BITMAP_ELEM_SIZE);
 }
 
 
@@ -70,7 +334,7 @@ void bmSet(bitmap_t *bm)
 void bmReset(bitmap_t *bm)
 {
     bm->msb = 0;
-    memset((bm->b), 0, BITMAP_SIZE * BITMAP_ELEM_SIZE);
+    memset((bm->b), 0, bm->size * BITMAP_ELEM_SIZE);
 }
 
 
@@ -90,14 +354,12 @@ void bmAnd(const bitmap_t *bm1, const bitmap_t *bm2, bitmap_t *bmres)
 {
     int min = (bm1->msb < bm2->msb) ? bm1->msb : bm2->msb;
 
-    bmReset(bmres);
-
-    for (int i = min; i >= 0; i--) {
-        (bmres->b)[i] = (bm1->b)[i] & (bm2->b)[i];
-        if ((bmres->msb == 0) && (bmres->b[i] != 0ULL)) {
-            bmres->msb = i;
-        } 
+    // only the elements up to the old msb of bmres can be non-zero
+    if (bmres->msb > min) {
+        memset(bmres->b + min + 1, 0, (bmres->msb - min) * BITMAP_ELEM_SIZE);
     }
+
+    bmres->msb = kernels.andElems(bm1->b, bm2->b, bmres->b, min + 1);
 }
 
 
@@ -138,3 +400,44 @@ int bmCompare(const bitmap_t *b1, const bitmap_t *b2)
     }
     return 0;
 }
+
+
+//! test whether b1 and b2 have the same bits set
+int bmEqual(const bitmap_t *b1, const bitmap_t *b2)
+{
+    if (b1->msb != b2->msb) {
+        return 0;
+    }
+
+    return kernels.equalElems(b1->b, b2->b, b1->msb + 1);
+}
+
+
+//! hash value of the bits set in bm
+unsigned long bmHash(const bitmap_t *bm)
+{
+    // four independent multiply chains, the elements above msb are zero
+    const unsigned long long mul = 0x9E3779B97F4A7C15ULL;
+    unsigned long long h[4] = { (unsigned long long) bm->msb, 1, 2, 3 };
+    int i = 0;
+
+    for (; i + 4 <= bm->msb + 1; i += 4) {
+        h[0] = (h[0] ^ bm->b[i]) * mul;
+        h[1] = (h[1] ^ bm->b[i+1]) * mul;
+        h[2] = (h[2] ^ bm->b[i+2]) * mul;
+        h[3] = (h[3] ^ bm->b[i+3]) * mul;
+    }
+    for (; i <= bm->msb; i++) {
+        h[0] = (h[0] ^ bm->b[i]) * mul;
+    }
+
+    unsigned long long r = ((h[0] ^ (h[1] >> 17)) * mul) ^ ((h[2] ^ (h[3] >> 29)) * mul);
+
+    return (unsigned long) (r ^ (r >> 32));
+}
+
+
+const char *bmKernelName()
+{
+    return kernels.name;
+}
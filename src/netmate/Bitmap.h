@@ -35,7 +35,6 @@
 
 
 #include "stdincpp.h"
-#include "ClassifierRFCConf.h"
 
 
 //! size of one element
@@ -44,18 +43,39 @@ const int BITMAP_ELEM_SIZE = sizeof(unsigned long long);
 //! bits per element
 const int BITS_PER_ELEM = BITMAP_ELEM_SIZE * 8;
 
-//! bitmap size in bytes
-const int BITMAP_SIZE = MAX_RULES / BITS_PER_ELEM;
 
-
-//! msb is used to speed up the precomputation for small rulesets
-typedef struct {
+/*! msb is used to speed up the precomputation for small rulesets
+    the number of elements is set when the bitmap is created (bmResize
+    changes it), copies get the size of the source
+    all elements above msb are always zero
+*/
+typedef struct bitmap {
     //! index to first non-zero element  
     int msb;
-    unsigned long long b[BITMAP_SIZE];  
+    //! number of elements
+    int size;
+    unsigned long long *b;  
+
+    //! create a bitmap with nelem elements (all bits reset)
+    bitmap(int nelem = 1);
+
+    bitmap(const struct bitmap &bm);
+
+    ~bitmap();
+
+    struct bitmap &operator=(const struct bitmap &bm);
 } bitmap_t;
 
 
+//! number of elements needed for a bitmap with nbits bits
+inline int bmElems(unsigned long long nbits)
+{
+    return (int) ((nbits + BITS_PER_ELEM - 1) / BITS_PER_ELEM);
+}
+
+//! change the number of elements of bm (bits beyond the new size are lost)
+void bmResize(bitmap_t *bm, int nelem);
+
 //! test if bit bpos is set in bm
 int bmTest(bitmap_t *bm, unsigned long long bpos);
 
@@ -82,4 +102,16 @@ void bmPrint(const bitmap_t *bm1);
 
 int bmCompare(const bitmap_t *b1, const bitmap_t *b2);
 
+//! test whether b1 and b2 have the same bits set
+int bmEqual(const bitmap_t *b1, const bitmap_t *b2);
+
+//! hash value of the bits set in bm (equal bitmaps have equal hashes)
+unsigned long bmHash(const bitmap_t *bm);
+
+/*! \short   get the name of the implementation used by bmAnd and bmEqual
+
+    SSE2 or AVX2 versions are selected when the CPU supports them
+*/
+const char *bmKernelName();
+
 #endif // _BITMAP_H_
@@ -28,12 +28,18 @@
 
 #include "Classifier.h"
 #include "Meter.h"
+#include "ParserFcts.h"
+
+
+//! default number of packets read from a tap at once (1 = no batching)
+const int DEF_BATCH_SIZE = 1;
 
 /* ------------------------- Classifier ------------------------- */
 
 Classifier::Classifier( ConfigManager *cnf, string name, Sampler *sa,
 		                PacketQueue *queue, int threaded )
-  : MeterComponent(cnf, name, threaded), sampler(sa), pQueue(queue)
+  : MeterComponent(cnf, name, threaded), sampler(sa), pQueue(queue), dispBuf(NULL),
+    dispWait(0), sinkFull(0), stageSize(1), stageBuf(NULL), stageCnt(0), stageCopy(1)
 {
   
     if (sampler == NULL) {
@@ -45,6 +51,10 @@ Classifier::Classifier( ConfigManager *cnf, string name, Sampler *sa,
     }
      
     maxBufSize = pQueue->getMaxBufSize();
+    queues.push_back(pQueue);
+
+    string txt = cnf->getValue("BatchSize", "CLASSIFIER");
+    batchSize = txt.empty() ? DEF_BATCH_SIZE : ParserFcts::parseInt(txt, 1);
 
     // 2 lines -> support old g++
     auto_ptr<ClassifierStats> _stats(new ClassifierStats());
@@ -59,8 +69,52 @@ Classifier::~Classifier()
     for (tapListIter_t i=taps.begin(); i != taps.end(); ++i) {
         saveDelete(*i);
     }
+
+    if (dispBuf != NULL) {
+        saveDeleteArr(dispBuf);
+    }
+
+    if (stageBuf != NULL) {
+        saveDeleteArr(stageBuf);
+    }
 }
 
+
+void Classifier::addQueue(PacketQueue *queue)
+{
+    if (queue == NULL) {
+        throw Error("Invalid packet queue");
+    }
+
+    if (queue->getMaxBufSize() < maxBufSize) {
+        maxBufSize = queue->getMaxBufSize();
+    }
+
+    queues.push_back(queue);
+
+    if (dispBuf == NULL) {
+        dispBuf = new char[maxBufSize];
+    }
+}
+
+
+void Classifier::setClassifyBatch(int n)
+{
+    if (n > batchSize) {
+        n = batchSize;
+    }
+    if (n > MAX_CLASSIFY_BATCH) {
+        n = MAX_CLASSIFY_BATCH;
+    }
+
+    if (n > 1) {
+        // queues added later only make maxBufSize smaller
+        stageBuf = new char[n * maxBufSize];
+        stageSize = n;
+    }
+}
+
+
 void Classifier::registerTap(NetTap *nt)
 {
     if (nt == NULL) {
@@ -95,7 +149,49 @@ int Classifier::processPacket()
     char *buf;
     static tapListIter_t tapi = taps.begin();
 
-    if (pQueue->getBufferSpace(&buf) != 0) {
+    if (queues.size() > 1) {
+        // the queue is only known after classification, so the tap
+        // fills our own buffer and the packets kept are copied from there
+        stageCopy = !(*tapi)->keepsPayload();
+        // the workers run in their own threads, a capture file is not
+        // read faster than they process it
+        dispWait = !(*tapi)->isOnline();
+        int n = (*tapi)->getPackets(this, batchSize);
+
+        flushPackets();
+
+        if (n > 0) {
+            return 1;
+        }
+    } else if (batchSize > 1) {
+        // read a whole batch of packets into consecutive queue buffers
+        int n = pQueue->reserveBatch(batchSize);
+
+        if (n == 0) {
+#ifdef DEBUG
+            cerr << "packet queue full" << endl;
+#endif
+            return 0;
+        }
+
+        stageCopy = !(*tapi)->keepsPayload();
+        sinkFull = 0;
+        n = (*tapi)->getPackets(this, n);
+        flushPackets();
+
+        // make all matching packets of the batch visible at once
+        pQueue->commitBatch();
+
+        if (n > 0) {
+            return 1;
+        }
+
+        if (sinkFull) {
+            // no packet read because the queue filled up, not at the
+            // end of a capture file
+            return 0;
+        }
+    } else if (pQueue->getBufferSpace(&buf) != 0) {
 #ifdef DEBUG
         cerr << "packet queue full" << endl;
 #endif
@@ -119,8 +215,9 @@ int Classifier::processPacket()
                 }
                 cout << endl;
 #endif   
-                // put packet plus meta-data into queue 
-                pQueue->setBufferOccupied(upkt->len + sizeof(metaData_t));
+                // only now copy the packet plus meta-data into the queue
+                storePayload(upkt);
+                pQueue->setBufferOccupied(upkt->cap_len + sizeof(metaData_t));
                 
                 stats->packets += 1;
                 stats->bytes   += upkt->len;
@@ -128,11 +225,11 @@ int Classifier::processPacket()
 
 	    return 1;
         }
+    }
 
-        tapi++;
-        if (tapi == taps.end()) {
-            tapi = taps.begin();
-        }
+    tapi++;
+    if (tapi == taps.end()) {
+        tapi = taps.begin();
     }
 
     if (!(*tapi)->isOnline()) {
@@ -143,6 +240,201 @@ int Classifier::processPacket()
     return 0;
 }
 
+
+char *Classifier::nextBuffer(unsigned long *len)
+{
+    *len = maxBufSize;
+
+    if (stageSize > 1) {
+        // the queue must be able to take all waiting packets if they match
+        if ((dispBuf == NULL) && !pQueue->hasBatchSpace(stageCnt + 1)) {
+            flushPackets();
+            if (!pQueue->hasBatchSpace(1)) {
+                sinkFull = 1;
+                return NULL;
+            }
+        }
+
+        return stageBuf + stageCnt * maxBufSize;
+    }
+
+    if (dispBuf != NULL) {
+        return dispBuf;
+    }
+
+    char *buf = pQueue->getBatchBuffer();
+
+    if (buf == NULL) {
+        sinkFull = 1;
+    }
+
+    return buf;
+}
+
+
+// hash over source and destination address which is the same for both
+// directions of a flow (non-IP packets all go to the first queue), the
+// packet processor only accepts auto flow rules whose flow key contains
+// both addresses (PacketProcessor::checkWorkerKey)
+static inline unsigned int flowHash(metaData_t *pkt)
+{
+    int soffs, doffs, alen;
+    unsigned int a = 0, b = 0, h;
+
+    switch (pkt->layers[L_NET]) {
+    case N_IP:
+        soffs = 12;
+        doffs = 16;
+        alen = 4;
+        break;
+    case N_IP6:
+        soffs = 8;
+        doffs = 24;
+        alen = 16;
+        break;
+    default:
+        return 0;
+    }
+
+    if ((size_t) (pkt->offs[L_NET] + doffs + alen) > pkt->cap_len) {
+        return 0;
+    }
+
+    unsigned char *net = &pkt->payload[pkt->offs[L_NET]];
+
+    for (int i = 0; i < alen; i++) {
+        a = a * 31 + net[soffs + i];
+        b = b * 31 + net[doffs + i];
+    }
+
+    // symmetric combination, then spread the bits
+    h = a ^ b;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+
+    return h;
+}
+
+
+inline void Classifier::copyPacket(char *buf, metaData_t *pkt)
+{
+    // copy the meta data (only the matches used) and the packet data
+    metaData_t *m = (metaData_t *) buf;
+    memcpy(m, pkt, offsetof(metaData_t, match));
+    memcpy(m->match, pkt->match, pkt->match_cnt * sizeof(pkt->match[0]));
+    m->payload = m->data;
+    memcpy(m->data, pkt->payload, pkt->cap_len);
+}
+
+
+void Classifier::dispatchPacket(metaData_t *pkt)
+{
+    PacketQueue *q = queues[flowHash(pkt) % queues.size()];
+    char *buf;
+
+    if (dispWait) {
+        q->waitBufferSpace(&buf);
+    } else if (q->getBufferSpace(&buf) != 0) {
+        // queue full, counted as dropped by the queue
+        return;
+    }
+
+    copyPacket(buf, pkt);
+    q->setBufferOccupied(pkt->cap_len + sizeof(metaData_t));
+}
+
+
+void Classifier::classifyBatch(metaData_t **pkts, int n, int *res)
+{
+    for (int i = 0; i < n; i++) {
+        res[i] = classify(pkts[i]);
+    }
+}
+
+
+void Classifier::flushPackets()
+{
+    if (stageCnt == 0) {
+        return;
+    }
+
+    classifyBatch(stage, stageCnt, stageRes);
+
+    for (int i = 0; i < stageCnt; i++) {
+        metaData_t *pkt = stage[i];
+
+        if (!stageRes[i]) {
+            continue;
+        }
+
+#ifdef DEBUG2
+        cout << "matches rule(s) ";
+        for (int j = 0; j < pkt->match_cnt; j++) {
+            cout << pkt->match[j] << ", ";
+        }
+        cout << endl;
+#endif
+
+        if (dispBuf != NULL) {
+            dispatchPacket(pkt);
+        } else {
+            char *buf = pQueue->getBatchBuffer();
+
+            if (buf == NULL) {
+                // counted as dropped by the queue
+                continue;
+            }
+
+            copyPacket(buf, pkt);
+            pQueue->setBatchBufferOccupied(pkt->cap_len + sizeof(metaData_t));
+        }
+
+        stats->packets += 1;
+        stats->bytes   += pkt->len;
+    }
+
+    stageCnt = 0;
+}
+
+
+void Classifier::putPacket(metaData_t *pkt)
+{
+    upkt = pkt;
+
+#ifdef DEBUG2
+    cout << "got packet, length: " << upkt->len << endl;
+#endif	 
+
+    if (stageSize > 1) {
+        // packets not sampled are overwritten by the next one
+        if (sampler->sample(upkt)) {
+            if (stageCopy) {
+                // the tap data is gone when the batch is classified
+                storePayload(upkt);
+            }
+            stage[stageCnt++] = upkt;
+            if (stageCnt == stageSize) {
+                flushPackets();
+            }
+        }
+        return;
+    }
+
+    // packets that do not match are overwritten by the next one
+    if (sampler->sample(upkt) && classify(upkt)) {
+        if (dispBuf != NULL) {
+            dispatchPacket(upkt);
+        } else {
+            storePayload(upkt);
+            pQueue->setBatchBufferOccupied(upkt->cap_len + sizeof(metaData_t));
+        }
+                
+        stats->packets += 1;
+        stats->bytes   += upkt->len;
+    }
+}
+
 //! single-threaded classification
 int Classifier::handleFDEvent(eventVec_t *e, fd_set *rset, fd_set *wset, fd_sets_t *fds)
 {
@@ -72,6 +72,10 @@ class ClassifierStats {
 ostream& operator<< ( ostream &os, ClassifierStats &cst );
 
 
+//! max number of packets classified together by classifyBatch
+const int MAX_CLASSIFY_BATCH = 32;
+
+
 /*! \short   accept and classify packets according to filter specification
   
     the Classifier class represents a packet classifier that captures packets
@@ -85,7 +89,7 @@ ostream& operator<< ( ostream &os, ClassifierStats &cst );
 typedef vector<NetTap*> tapList_t;
 typedef vector<NetTap*>::iterator tapListIter_t;
 
-class Classifier : public MeterComponent
+class Classifier : public MeterComponent, public PacketSink
 {
   protected:
 
@@ -94,9 +98,21 @@ class Classifier : public MeterComponent
     tapList_t taps;       //!< link to associated network tap classes
     Sampler *sampler;     //!< link to sampling class in use
     PacketQueue *pQueue;  //!< link to packet queue used by classifier
+    vector<PacketQueue *> queues; //!< queues of all packet processor workers (pQueue first)
+    char *dispBuf;        //!< buffer for packets dispatched to one of several queues
+    int dispWait;         //!< wait for a full queue instead of dropping (capture files)
     int maxBufSize;       //!< max number of bytes to store in queue at once
+    int batchSize;        //!< max number of packets read from a tap at once
+    int sinkFull;         //!< nextBuffer had no buffer left during the last read
     metaData_t *upkt;     //!< pointer to an incoming packet message
 
+    int stageSize;        //!< packets classified together (1 = one by one)
+    char *stageBuf;       //!< buffers of the packets waiting for classification
+    int stageCnt;         //!< number of packets waiting
+    int stageCopy;        //!< copy the payload of waiting packets (tap reuses its buffer)
+    metaData_t *stage[MAX_CLASSIFY_BATCH];  //!< the packets waiting
+    int stageRes[MAX_CLASSIFY_BATCH];       //!< classification results
+
     /*! \short   process, i.e. classify an incoming packet
         the method is called whenever new packets are ready for being classified.
         there are no parameters as themethod will read the packet and meta data
@@ -104,6 +120,41 @@ class Classifier : public MeterComponent
     */
     inline int processPacket();
 
+    //! copy the packet data behind the meta data if the tap left it elsewhere
+    inline void storePayload(metaData_t *pkt)
+    {
+        if (pkt->payload != pkt->data) {
+            memcpy(pkt->data, pkt->payload, pkt->cap_len);
+            pkt->payload = pkt->data;
+        }
+    }
+
+    //! copy a packet (meta data and packet data) into a queue buffer
+    inline void copyPacket(char *buf, metaData_t *pkt);
+
+    /*! \short   copy a classified packet into the queue of the worker 
+                 responsible for its flow (if there are several queues)
+    */
+    void dispatchPacket(metaData_t *pkt);
+
+    /*! \short   classify the packets of a batch together
+
+        Called by a classifier which can classify several packets faster
+        than one after another (see classifyBatch). Packets read from a tap
+        in batches then wait in separate buffers until n of them are there
+        or the tap returns, the ones that match are copied into the queue.
+    */
+    void setClassifyBatch(int n);
+
+    //! classify the waiting packets and keep the matching ones
+    void flushPackets();
+
+    //! get queue buffer for the next packet of a batch (called by the tap)
+    virtual char *nextBuffer(unsigned long *len);
+
+    //! sample and classify a packet of a batch and keep it if it matches
+    virtual void putPacket(metaData_t *pkt);
+
   public:
 
     /*! \short   construct and initialize a Classifier object
@@ -122,6 +173,14 @@ class Classifier : public MeterComponent
 
     virtual void registerTap(NetTap *nt);
 
+    /*! \short   add the packet queue of another packet processor worker
+
+        With more than one queue packets are distributed over the queues
+        by a hash of their network addresses which is the same for both
+        directions of a flow.
+    */
+    void addQueue(PacketQueue *queue);
+
     virtual void clearTaps();
 
     //! check a ruleset (the filter part)
@@ -142,6 +201,13 @@ class Classifier : public MeterComponent
     //! classify an incoming packet (determine matching rule(s))
     virtual int classify(metaData_t* pkt) = 0;
 
+    /*! \short   classify several packets
+        \arg \c pkts  packets (at most MAX_CLASSIFY_BATCH)
+        \arg \c n     number of packets
+        \arg \c res   location to store the result of classify for each packet
+    */
+    virtual void classifyBatch(metaData_t **pkts, int n, int *res);
+
     //! get packet from net tap, sample and classify
     virtual int handleFDEvent(eventVec_t *e, fd_set *rset, fd_set *wset, fd_sets_t *fds);
 
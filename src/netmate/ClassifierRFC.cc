@@ -56,7 +56,9 @@ void ClassifierRFC::initData()
     // set number line data to zero
     memset(&nldscs, 0, sizeof(numberLineDescrs_t));
 
-    // reset bitmap
+    // reset bitmap (to the initial size)
+    bmSize = bmElems(INITIAL_RULE_BITS);
+    bmResize(&allrules, bmSize);
     bmReset(&allrules);
 
     // set start equiv id to zero
@@ -73,8 +75,12 @@ void ClassifierRFC::cleanupData()
     // delete chunk data
     for (unsigned short i = 0; i < cdata.phaseCount; i++) {
         for (unsigned short j = 0; j < cdata.phases[i].chunkCount; j++) {
-            saveDeleteArr(cdata.phases[i].chunks[j].entries);
-            for (unsigned short k = 0; k < eqcl[i][j].maxId; k++) {
+            if (cdata.phases[i].chunks[j].wide) {
+                saveDeleteArr(cdata.phases[i].chunks[j].entries.w);
+            } else {
+                saveDeleteArr(cdata.phases[i].chunks[j].entries.n);
+            }
+            for (equivID_t k = 0; k < eqcl[i][j].maxId; k++) {
                 if (eqcl[i][j].eids[k].bm != NULL) {
                     saveDelete(eqcl[i][j].eids[k].bm);
                 }
@@ -87,6 +93,11 @@ void ClassifierRFC::cleanupData()
 
     // delete final rule map
     if (rmap_size > 0) {
+        for (unsigned long i = 0; i < rmap_size; i++) {
+            if (rmap[i].rules != NULL) {
+                saveDeleteArr(rmap[i].rules);
+            }
+        }
         saveDeleteArr(rmap);
         rmap_size = 0;
     }
@@ -99,10 +110,17 @@ ClassifierRFC::ClassifierRFC( ConfigManager *cnf, Sampler *sa,
 {
 #ifdef DEBUG
     log->dlog(ch, "ClassifierRFC constructor" );
+    log->dlog(ch, "bitmap kernels: %s", bmKernelName());
 #endif
 
     // initialize the data structures
     initData();
+    tables = NULL;
+    readerTables = NULL;
+    readerAck = NULL;
+
+    // packets read in batches are classified together
+    setClassifyBatch(MAX_CLASSIFY_BATCH);
 
     // 2 lines -> support old g++
     auto_ptr <ClassifierStats> _stats(new ClassifierRFCStats());
@@ -128,48 +146,192 @@ ClassifierRFC::~ClassifierRFC()
 #endif
 
     cleanupData();
+
+    // the classifier thread is stopped, all tables can go
+    if (tables != NULL) {
+        freeTables(tables);
+        tables = NULL;
+    }
+    for (rfcTablesListIter_t i = retired.begin(); i != retired.end(); ++i) {
+        freeTables(*i);
+    }
+    retired.clear();
+}
+
+
+rfcTables_t *ClassifierRFC::copyTables()
+{
+    rfcTables_t *t = new rfcTables_t;
+
+    memcpy(&t->nldscs, &nldscs, sizeof(numberLineDescrs_t));
+    memcpy(&t->cdata, &cdata, sizeof(phases_t));
+
+    for (unsigned short i = 0; i < MAX_PHASES; i++) {
+        for (unsigned short j = 0; j < MAX_CHUNKS; j++) {
+            chunk_t *c = &t->cdata.phases[i].chunks[j];
+
+            t->classes[i][j] = eqcl[i][j].maxId;
+
+            if ((i >= cdata.phaseCount) || (j >= cdata.phases[i].chunkCount)) {
+                c->entries.n = NULL;
+                continue;
+            }
+
+            // own copy of the entries
+            if (c->wide) {
+                c->entries.w = new unsigned int[c->entryCount];
+                memcpy(c->entries.w, cdata.phases[i].chunks[j].entries.w, 
+                       sizeof(unsigned int)*c->entryCount);
+            } else {
+                c->entries.n = new unsigned short[c->entryCount];
+                memcpy(c->entries.n, cdata.phases[i].chunks[j].entries.n, 
+                       sizeof(unsigned short)*c->entryCount);
+            }
+        }
+    }
+
+    t->rmap = NULL;
+    t->rmap_size = rmap_size;
+    if (rmap_size > 0) {
+        t->rmap = new matchingRules_t[rmap_size];
+        for (unsigned long i = 0; i < rmap_size; i++) {
+            t->rmap[i].ruleCount = rmap[i].ruleCount;
+            t->rmap[i].rules = NULL;
+            if (rmap[i].ruleCount > 0) {
+                t->rmap[i].rules = new unsigned int[rmap[i].ruleCount];
+                memcpy(t->rmap[i].rules, rmap[i].rules, 
+                       sizeof(unsigned int)*rmap[i].ruleCount);
+            }
+        }
+    }
+
+    return t;
+}
+
+
+void ClassifierRFC::freeTables(rfcTables_t *t)
+{
+    for (unsigned short i = 0; i < t->cdata.phaseCount; i++) {
+        for (unsigned short j = 0; j < t->cdata.phases[i].chunkCount; j++) {
+            if (t->cdata.phases[i].chunks[j].wide) {
+                saveDeleteArr(t->cdata.phases[i].chunks[j].entries.w);
+            } else {
+                saveDeleteArr(t->cdata.phases[i].chunks[j].entries.n);
+            }
+        }
+    }
+
+    for (unsigned long i = 0; i < t->rmap_size; i++) {
+        if (t->rmap[i].rules != NULL) {
+            saveDeleteArr(t->rmap[i].rules);
+        }
+    }
+    if (t->rmap != NULL) {
+        saveDeleteArr(t->rmap);
+    }
+
+    saveDelete(t);
+}
+
+
+void ClassifierRFC::publishTables()
+{
+    rfcTables_t *old = tables;
+    rfcTables_t *t = NULL;
+
+    if ((stats->rules > 0) && (cdata.phaseCount > 0)) {
+        t = copyTables();
+    }
+
+    // the tables must be complete before classify can see them
+    memoryBarrier();
+    tables = t;
+
+    if (old != NULL) {
+        retired.push_back(old);
+    }
+
+    freeRetired();
+}
+
+
+void ClassifierRFC::freeRetired()
+{
+    // without classifier thread classify is not running now, otherwise
+    // the thread must have switched to the current tables (if not the
+    // retired tables are freed on the next rule change)
+    if (threaded && (readerAck != tables)) {
+        return;
+    }
+
+    for (rfcTablesListIter_t i = retired.begin(); i != retired.end(); ++i) {
+        freeTables(*i);
+    }
+    retired.clear();
 }
 
 /* ----------------------------------------------------------------------------------- */
 
+inline rfcTables_t *ClassifierRFC::getTables()
+{
+    rfcTables_t *t = tables;
+
+    if (t != readerTables) {
+        // first packet with new tables, after the barrier the old tables
+        // are not read anymore
+        readerTables = t;
+        memoryBarrier();
+        readerAck = t;
+    }
+
+    return t;
+}
+
+
 int ClassifierRFC::classify(metaData_t* pkt)
 {
-    int indx;
+    int offs;
+    unsigned int indx;
     unsigned short val;
     unsigned short chunks, parents;
+    rfcTables_t *t;
 
 #ifdef PROFILING
     unsigned long long ti1, ti2;
 
     ti1 = PerfTimer::readTSC();
 #endif
-    
-    AUTOLOCK(threaded, &maccess);
 
-    chunks = cdata.phases[0].chunkCount;
+    t = getTables();
+
+    if (t == NULL) {
+        return 0;
+    }
+
+    chunks = t->cdata.phases[0].chunkCount;
     for (unsigned short i = 0; i < chunks; i++) {
         // get the value from the packet data
-        indx = pkt->offs[nldscs[i].ref];
-        if (indx < 0) {
+        offs = pkt->offs[t->nldscs[i].ref];
+        if (offs < 0) {
             return 0;
         } 
 
-        indx += nldscs[i].offs;
+        offs += t->nldscs[i].offs;
 
-        if (nldscs[i].len == 1) {
-            val = ((unsigned short) pkt->payload[indx]) & nldscs[i].mask;
+        if (t->nldscs[i].len == 1) {
+            val = ((unsigned short) pkt->payload[offs]) & t->nldscs[i].mask;
         } else {
             // convert to host byte order (support range matches)
-            val = ntohs(*((unsigned short *) &pkt->payload[indx]) & nldscs[i].mask);
+            val = ntohs(*((unsigned short *) &pkt->payload[offs]) & t->nldscs[i].mask);
         }
 
         // phase 0 memory lookup
-        eqnums[0][i] = cdata.phases[0].chunks[i].entries[val];
+        eqnums[0][i] = getEntry(&t->cdata.phases[0].chunks[i], val);
     }
     
 #ifdef DEBUG
     cout << "Classify: phase 0 indices" << endl;
-    for (unsigned short i = 0; i < cdata.phases[0].chunkCount; i++) {
+    for (unsigned short i = 0; i < t->cdata.phases[0].chunkCount; i++) {
         cout << i << ": " << eqnums[0][i] << endl;
 	}
     cout << endl;
@@ -177,41 +339,42 @@ int ClassifierRFC::classify(metaData_t* pkt)
     
     // phase 1-n
 
-    for (unsigned short i = 1; i < cdata.phaseCount; i++) {        
+    for (unsigned short i = 1; i < t->cdata.phaseCount; i++) {        
 
-        chunks = cdata.phases[i].chunkCount;
+        chunks = t->cdata.phases[i].chunkCount;
     	for (unsigned short j = 0; j < chunks; j++) {
+            chunk_t *c = &t->cdata.phases[i].chunks[j];
 
     	    // get entry from first parent chunk
-    	    indx = eqnums[i-1][cdata.phases[i].chunks[j].parentChunks[0]];
+    	    indx = eqnums[i-1][c->parentChunks[0]];
     	    
-            parents = cdata.phases[i].chunks[j].parentCount;
+            parents = c->parentCount;
             for (unsigned short k = 1; k < parents; k++) {
 
                 // calculate index
-                unsigned short pchunk = cdata.phases[i].chunks[j].parentChunks[k];
-                indx = indx * eqcl[i-1][pchunk].maxId + eqnums[i-1][pchunk];
+                unsigned short pchunk = c->parentChunks[k];
+                indx = indx * t->classes[i-1][pchunk] + eqnums[i-1][pchunk];
     	    }
             
     	    // phase i memory lookup
-    	    eqnums[i][j] = cdata.phases[i].chunks[j].entries[indx];
+    	    eqnums[i][j] = getEntry(c, indx);
     	}
     
 #ifdef DEBUG
         cout << "Classify: phase " << i << " indices" << endl;
-        for (unsigned short j = 0; j < cdata.phases[i].chunkCount; j++) {
+        for (unsigned short j = 0; j < t->cdata.phases[i].chunkCount; j++) {
             cout << j << ": " << eqnums[i][j] << endl;
         }
 #endif
     }
     
-    indx = eqnums[cdata.phaseCount-1][0];
+    indx = eqnums[t->cdata.phaseCount-1][0];
 
-    if (rmap_size > 0) {
-        for (unsigned short i = 0; i < rmap[indx].ruleCount; i++) {
-            pkt->match[i] = rmap[indx].rules[i];
+    if (t->rmap_size > 0) {
+        for (unsigned short i = 0; i < t->rmap[indx].ruleCount; i++) {
+            pkt->match[i] = t->rmap[indx].rules[i];
         }
-        pkt->match_cnt = rmap[indx].ruleCount;
+        pkt->match_cnt = t->rmap[indx].ruleCount;
     }
     
 #ifdef PROFILING
@@ -224,6 +387,121 @@ int ClassifierRFC::classify(metaData_t* pkt)
 }
 
 
+void ClassifierRFC::classifyBatch(metaData_t **pkts, int n, int *res)
+{
+    int offs;
+    unsigned short val;
+    unsigned short chunks, parents;
+    // packets not yet known to match nothing
+    int active[MAX_CLASSIFY_BATCH];
+    int nact = 0;
+    rfcTables_t *t = getTables();
+
+    if (t == NULL) {
+        for (int p = 0; p < n; p++) {
+            res[p] = 0;
+        }
+        return;
+    }
+
+    // phase 0 indexes from the packet data, prefetch the entries
+    chunks = t->cdata.phases[0].chunkCount;
+    for (int p = 0; p < n; p++) {
+        metaData_t *pkt = pkts[p];
+        unsigned short i;
+
+        res[p] = 0;
+
+        for (i = 0; i < chunks; i++) {
+            offs = pkt->offs[t->nldscs[i].ref];
+            if (offs < 0) {
+                break;
+            } 
+
+            offs += t->nldscs[i].offs;
+
+            if (t->nldscs[i].len == 1) {
+                val = ((unsigned short) pkt->payload[offs]) & t->nldscs[i].mask;
+            } else {
+                // convert to host byte order (support range matches)
+                val = ntohs(*((unsigned short *) &pkt->payload[offs]) & t->nldscs[i].mask);
+            }
+
+            bindx[p][i] = val;
+            __builtin_prefetch(getEntryAddr(&t->cdata.phases[0].chunks[i], val));
+        }
+
+        if (i == chunks) {
+            active[nact++] = p;
+        }
+    }
+
+    // phase 0 memory lookups
+    for (int a = 0; a < nact; a++) {
+        int p = active[a];
+
+        for (unsigned short i = 0; i < chunks; i++) {
+            beqnums[p][i] = getEntry(&t->cdata.phases[0].chunks[i], bindx[p][i]);
+        }
+    }
+
+    // phase 1-n
+    for (unsigned short i = 1; i < t->cdata.phaseCount; i++) {        
+        chunks = t->cdata.phases[i].chunkCount;
+
+        // all indexes of this phase (from the equiv classes of the last one)
+        for (int a = 0; a < nact; a++) {
+            int p = active[a];
+
+            for (unsigned short j = 0; j < chunks; j++) {
+                chunk_t *c = &t->cdata.phases[i].chunks[j];
+                unsigned int indx = beqnums[p][c->parentChunks[0]];
+
+                parents = c->parentCount;
+                for (unsigned short k = 1; k < parents; k++) {
+                    unsigned short pchunk = c->parentChunks[k];
+                    indx = indx * t->classes[i-1][pchunk] + beqnums[p][pchunk];
+                }
+
+                bindx[p][j] = indx;
+                __builtin_prefetch(getEntryAddr(c, indx));
+            }
+        }
+
+        // phase i memory lookups
+        for (int a = 0; a < nact; a++) {
+            int p = active[a];
+
+            for (unsigned short j = 0; j < chunks; j++) {
+                beqnums[p][j] = getEntry(&t->cdata.phases[i].chunks[j], bindx[p][j]);
+            }
+        }
+    }
+
+    if (t->rmap_size > 0) {
+        for (int a = 0; a < nact; a++) {
+            __builtin_prefetch(&t->rmap[beqnums[active[a]][0]]);
+        }
+    }
+
+    for (int a = 0; a < nact; a++) {
+        int p = active[a];
+        metaData_t *pkt = pkts[p];
+
+        if (t->rmap_size > 0) {
+            matchingRules_t *m = &t->rmap[beqnums[p][0]];
+
+            for (unsigned short i = 0; i < m->ruleCount; i++) {
+                pkt->match[i] = m->rules[i];
+            }
+            pkt->match_cnt = m->ruleCount;
+        }
+
+        res[p] = pkt->match_cnt;
+    }
+}
+
+
 // check a ruleset (the filter part)
 void ClassifierRFC::checkRules(ruleDB_t *rules)
 {
@@ -250,6 +528,8 @@ void ClassifierRFC::addRules(ruleDB_t *rules)
     }
 
     stats->rules += rules->size(); // adjust number of rules currently used
+
+    publishTables();
 }
 
 
@@ -263,12 +543,14 @@ void ClassifierRFC::delRules(ruleDB_t *rules)
     for (iter = rules->begin(); iter != rules->end(); iter++) {
         delRule(*iter);
     }
+
+    publishTables();
 }
 
 /* ------------------- number line functions ---------------------------------------*/
 
 // add a rule to a point on a number line
-void ClassifierRFC::addRuleToPoint(point_t *p, pointType_t type, unsigned short rid)
+void ClassifierRFC::addRuleToPoint(point_t *p, pointType_t type, unsigned int rid)
 {  
     const int initial_rule_entries = 16;
 
@@ -320,7 +602,7 @@ void ClassifierRFC::getIndex(FilterValue *v, FilterValue *m, int size, unsigned
     }
 }
 
-void ClassifierRFC::projMatchRemap(unsigned short rid, unsigned short chunk_id, int chunk_size, 
+void ClassifierRFC::projMatchRemap(unsigned int rid, unsigned short chunk_id, int chunk_size, 
                                    unsigned short ch, filter_t *f)
 {
     unsigned short ind[2], ind2[2];
@@ -360,7 +642,7 @@ void ClassifierRFC::projMatchRemap(unsigned short rid, unsigned short chunk_id,
     case FT_WILD:
         // add bit to all used equiv classes for that chunk
         // chunk data does not need to be changed
-        for (unsigned short eq = 0; eq < (int) eqcl[0][chunk_id].maxId; eq++) {
+        for (equivID_t eq = 0; eq < eqcl[0][chunk_id].maxId; eq++) {
             if (eqcl[0][chunk_id].eids[eq].refc > 0) {
                 bmSet(eqcl[0][chunk_id].eids[eq].bm, rid);
             }
@@ -369,10 +651,11 @@ void ClassifierRFC::projMatchRemap(unsigned short rid, unsigned short chunk_id,
     } 
 }    
 
-void ClassifierRFC::projMatchDirectly(unsigned short eq, unsigned short chunk_id, int chunk_size, 
+void ClassifierRFC::projMatchDirectly(equivID_t eq, unsigned short chunk_id, int chunk_size, 
                                       unsigned short ch, filter_t *f)
 {
     unsigned short ind[2], ind2[2];
+    chunk_t *c = &cdata.phases[0].chunks[chunk_id];
 
     // project the points directly on the chunk
     switch (f->mtype) {
@@ -380,7 +663,7 @@ void ClassifierRFC::projMatchDirectly(unsigned short eq, unsigned short chunk_id
         // set equiv class 2 for the distinct point
         getIndex(&f->value[0], &f->mask, chunk_size, ch, ind);
         for (unsigned short i = ind[0]; i < ind[1]; i++) {
-            cdata.phases[0].chunks[chunk_id].entries[i] = eq;
+            setEntry(c, i, eq);
         }
         break;
     case FT_RANGE:
@@ -392,11 +675,11 @@ void ClassifierRFC::projMatchDirectly(unsigned short eq, unsigned short chunk_id
         // otherwise single point
         if (ind != ind2) {
             for (unsigned short i = ind[0]; i < ind2[1]; i++) {
-                cdata.phases[0].chunks[chunk_id].entries[i] = eq;
+                setEntry(c, i, eq);
             }
         } else {
             for (unsigned short i = ind[0]; i < ind[1]; i++) {
-                cdata.phases[0].chunks[chunk_id].entries[i] = eq;
+                setEntry(c, i, eq);
             }
         }
         break;
@@ -408,7 +691,7 @@ void ClassifierRFC::projMatchDirectly(unsigned short eq, unsigned short chunk_id
               getIndex(&f->value[i], &f->mask, chunk_size, ch, ind);
               
               for (unsigned short j = ind[0]; j < ind[1]; j++) {
-                  cdata.phases[0].chunks[chunk_id].entries[j] = eq;
+                  setEntry(c, j, eq);
               }
               
               i++;
@@ -421,7 +704,7 @@ void ClassifierRFC::projMatchDirectly(unsigned short eq, unsigned short chunk_id
     }   
 }
 
-void ClassifierRFC::projMatch(unsigned short rid, unsigned short chunk_id, int chunk_size, 
+void ClassifierRFC::projMatch(unsigned int rid, unsigned short chunk_id, int chunk_size, 
                               unsigned short ch, filter_t *f)
 {
     unsigned short ind[2], ind2[2];
@@ -520,9 +803,9 @@ void ClassifierRFC::addNumberLine(refer_t ref, unsigned short offs, unsigned sho
 
 
 // find equiv class (create a new in case there is no existing)
-unsigned short ClassifierRFC::findEC(unsigned short phase, unsigned short chunk, bitmap_t *bmp)
+equivID_t ClassifierRFC::findEC(unsigned short phase, unsigned short chunk, bitmap_t *bmp)
 {
-    int eq;
+    equivID_t eq;
 
     // find bitmap in equiv class list
     chunkBmListIter_t b = eqcl[phase][chunk].bms.find(bmp);
@@ -541,8 +824,7 @@ unsigned short ClassifierRFC::findEC(unsigned short phase, unsigned short chunk,
         } else {
             bmInfo_t bmi; 
 
-            bmi.bm = new bitmap_t;
-            *bmi.bm = *bmp;
+            bmi.bm = new bitmap_t(*bmp);
             bmi.refc = 1;
             
             // get a new id
@@ -550,6 +832,7 @@ unsigned short ClassifierRFC::findEC(unsigned short phase, unsigned short chunk,
             // insert
             eqcl[phase][chunk].eids.push_back(bmi);
             eqcl[phase][chunk].bms[bmi.bm] = eq;
+            checkChunkWidth(phase, chunk);
         }
     } else {
         // use existing class
@@ -563,15 +846,12 @@ unsigned short ClassifierRFC::findEC(unsigned short phase, unsigned short chunk,
 void ClassifierRFC::addPreAllocEC(unsigned short phase, unsigned short chunk, 
                                   unsigned short cnt)
 {
-    int eq;
-    bitmap_t bmp;
-    bmReset(&bmp);
+    equivID_t eq;
 
     for (unsigned short i = 0; i < cnt; i++) {
         bmInfo_t bmi;
 
-        bmi.bm = new bitmap_t;
-        *bmi.bm = bmp;
+        bmi.bm = new bitmap_t(bmSize);
         bmi.refc = 0;
      
         eq = eqcl[phase][chunk].maxId++;
@@ -579,27 +859,107 @@ void ClassifierRFC::addPreAllocEC(unsigned short phase, unsigned short chunk,
         // put on free list 
         eqcl[phase][chunk].freeList.push_back(eq);
     }
+    checkChunkWidth(phase, chunk);
 }
 
 void ClassifierRFC::makeNewChunk(unsigned short phase, unsigned int size)
 {
     unsigned short chunk = cdata.phases[phase].chunkCount++;
-    // alloc chunk memory 
-    cdata.phases[phase].chunks[chunk].entries = new unsigned short[size];
-    memset(cdata.phases[phase].chunks[chunk].entries, 0, sizeof(unsigned short)*size);
+    // alloc chunk memory (16 bit entries until there are more classes)
+    cdata.phases[phase].chunks[chunk].wide = 0;
+    cdata.phases[phase].chunks[chunk].entries.n = new unsigned short[size];
+    memset(cdata.phases[phase].chunks[chunk].entries.n, 0, sizeof(unsigned short)*size);
     cdata.phases[phase].chunks[chunk].entryCount = size;
 }
 
+void ClassifierRFC::resizeChunk(chunk_t *c, unsigned int size)
+{
+    unsigned int keep = (size < c->entryCount) ? size : c->entryCount;
+
+    if (c->wide) {
+        unsigned int *new_entries = new unsigned int[size];
+        memset(new_entries, 0, sizeof(unsigned int)*size);
+        memcpy(new_entries, c->entries.w, sizeof(unsigned int)*keep);
+        saveDeleteArr(c->entries.w);
+        c->entries.w = new_entries;
+    } else {
+        unsigned short *new_entries = new unsigned short[size];
+        memset(new_entries, 0, sizeof(unsigned short)*size);
+        memcpy(new_entries, c->entries.n, sizeof(unsigned short)*keep);
+        saveDeleteArr(c->entries.n);
+        c->entries.n = new_entries;
+    }
+    c->entryCount = size;
+}
+
+void ClassifierRFC::checkChunkWidth(unsigned short phase, unsigned short chunk)
+{
+    chunk_t *c = &cdata.phases[phase].chunks[chunk];
+
+    if (!c->wide && (eqcl[phase][chunk].maxId > MAX_NARROW_CLASSES)) {
+        // equiv ids do not fit into 16 bit anymore
+        unsigned int *new_entries = new unsigned int[c->entryCount];
+        for (unsigned int i = 0; i < c->entryCount; i++) {
+            new_entries[i] = c->entries.n[i];
+        }
+        saveDeleteArr(c->entries.n);
+        c->entries.w = new_entries;
+        c->wide = 1;
+    }
+}
+
+unsigned int ClassifierRFC::getChunkSize(unsigned short phase, unsigned short chunk)
+{
+    unsigned long long size = 1;
+
+    for (unsigned short k = 0; k < cdata.phases[phase].chunks[chunk].parentCount; k++) {
+        size *= eqcl[phase-1][cdata.phases[phase].chunks[chunk].parentChunks[k]].maxId;
+        if (size > MAX_CHUNK_ENTRIES) {
+            throw Error("phase %d chunk %d would have more than %lu entries", 
+                        phase, chunk, MAX_CHUNK_ENTRIES);
+        }
+    }
+
+    return (unsigned int) size;
+}
+
+void ClassifierRFC::growBitmaps(unsigned int rid)
+{
+    int size = bmSize;
+
+    while ((unsigned long long) size * BITS_PER_ELEM <= rid) {
+        size *= 2;
+    }
+
+    if (size == bmSize) {
+        return;
+    }
+
+    bmResize(&allrules, size);
+    for (unsigned short i = 0; i < MAX_PHASES; i++) {
+        for (unsigned short j = 0; j < MAX_CHUNKS; j++) {
+            for (chunkEqClArrayIter_t ei = eqcl[i][j].eids.begin(); 
+                 ei != eqcl[i][j].eids.end(); ++ei) {
+                if (ei->bm != NULL) {
+                    // the bitmap ordering does not change with the size
+                    bmResize(ei->bm, size);
+                }
+            }
+        }
+    }
+    bmSize = size;
+}
+
 // intersect the bitmaps in phase 1-n
 void ClassifierRFC::doIntersection(unsigned short phase, unsigned short chunk, 
-                				   unsigned short parent, int *indx, bitmap_t *bm)
+                				   unsigned short parent, unsigned int *indx, bitmap_t *bm)
 {
-    int size = 0;
+    unsigned int size = 0;
     unsigned short pchunk = cdata.phases[phase].chunks[chunk].parentChunks[parent];
+    bitmap_t rbmp(bmSize);
 
     for (chunkEqClArrayIter_t ei = eqcl[phase-1][pchunk].eids.begin();
          ei != eqcl[phase-1][pchunk].eids.end(); ++ei) {
-        bitmap_t rbmp;
         
 #ifdef PREALLOC_EQUIV_CLASSES
         if (ei->refc == 0) {
@@ -620,8 +980,8 @@ void ClassifierRFC::doIntersection(unsigned short phase, unsigned short chunk,
         if ((parent < cdata.phases[phase].chunks[chunk].parentCount-1)) {
             doIntersection(phase, chunk, parent+1, indx, &rbmp);
         } else {
-            int eq = findEC(phase, chunk, &rbmp);
-            cdata.phases[phase].chunks[chunk].entries[*indx] = eq;
+            equivID_t eq = findEC(phase, chunk, &rbmp);
+            setEntry(&cdata.phases[phase].chunks[chunk], *indx, eq);
             (*indx)++;
         }
     }
@@ -668,7 +1028,7 @@ void ClassifierRFC::printChunk(unsigned short phase, unsigned short chunk, int s
     cout << "phase " << phase << " chunk " << chunk << ": " << eqcl[phase][chunk].maxId 
          << " equiv classes" << endl;
     // equiv classes
-    for (unsigned short eq = 0; eq < (int) eqcl[phase][chunk].maxId; eq++) {
+    for (equivID_t eq = 0; eq < eqcl[phase][chunk].maxId; eq++) {
         cout << eq << ": ";
         if (eqcl[phase][chunk].eids[eq].bm != NULL) {
             bmPrint(eqcl[phase][chunk].eids[eq].bm);
@@ -682,7 +1042,7 @@ void ClassifierRFC::printChunk(unsigned short phase, unsigned short chunk, int s
     // chunk data
     if (show_cdata) {
         for (unsigned int k = 0; k < cdata.phases[phase].chunks[chunk].entryCount; k++) {
-            cout << k << " : " << cdata.phases[phase].chunks[chunk].entries[k] << endl;
+            cout << k << " : " << getEntry(&cdata.phases[phase].chunks[chunk], k) << endl;
         }
     }
     cout << endl << endl;
@@ -703,13 +1063,20 @@ void ClassifierRFC::printProfiling(struct timeval *t1, struct timeval *t2)
             // final rule map
             if (i == cdata.phaseCount-1) {
                 mem += eqcl[i][j].maxId * sizeof(matchingRules_t);
+                for (unsigned long k = 0; k < rmap_size; k++) {
+                    mem += rmap[k].ruleCount * sizeof(unsigned int);
+                }
             }
             // equiv class list and revese mapping
-            mem += eqcl[i][j].maxId * (sizeof(bitmap_t) + sizeof(bmInfo_t));
-            mem += eqcl[i][j].bms.size() * (sizeof(bitmap_t*) + sizeof(equivID_t) + 16);
+            mem += eqcl[i][j].maxId * (sizeof(bitmap_t) + bmSize * BITMAP_ELEM_SIZE +
+                                       sizeof(bmInfo_t));
+            mem += eqcl[i][j].bms.size() * (sizeof(bitmap_t*) + sizeof(equivID_t) + 
+                                            sizeof(void*));
+            mem += eqcl[i][j].bms.bucket_count() * sizeof(void*);
             mem += eqcl[i][j].freeList.size() * sizeof(equivID_t);
             // chunk memory
-            mem += cdata.phases[i].chunks[j].entryCount * sizeof(equivID_t);
+            mem += cdata.phases[i].chunks[j].entryCount * 
+              (cdata.phases[i].chunks[j].wide ? sizeof(unsigned int) : sizeof(unsigned short));
         }
     }
           
@@ -720,12 +1087,15 @@ void ClassifierRFC::printProfiling(struct timeval *t1, struct timeval *t2)
 
 void ClassifierRFC::genFinalMap(unsigned short phase)
 {
-    unsigned int size = cdata.phases[phase].chunks[0].entryCount;
+    // the map is indexed by the equiv classes of the last chunk
+    unsigned long size = eqcl[phase][0].maxId;
+    unsigned int rules[MAX_RULES_MATCH];
 
     if (size != rmap_size) {
         matchingRules_t *new_rmap = new matchingRules_t[size];
         memset(new_rmap, 0, sizeof(matchingRules_t)*size);
         if (rmap != NULL) {
+            // classes are never removed, the map only grows
             memcpy(new_rmap, rmap, sizeof(matchingRules_t)*rmap_size);
             saveDeleteArr(rmap);
         }
@@ -734,36 +1104,51 @@ void ClassifierRFC::genFinalMap(unsigned short phase)
     }
         
     // loop over all equiv classes from the last chunk
-    for (unsigned short eq = 0; eq < (int) eqcl[phase][0].maxId; eq++) {
+    for (equivID_t eq = 0; eq < eqcl[phase][0].maxId; eq++) {
         if (eqcl[phase][0].eids[eq].refc > 0) {
             bitmap_t *bm = eqcl[phase][0].eids[eq].bm;
+            unsigned short cnt = 0;
 
-            rmap[eq].ruleCount = 0;
+            for (int e = 0; e <= bm->msb; e++) {
+                // visit the set bits only (lowest first)
+                for (unsigned long long w = bm->b[e]; w != 0ULL; w &= w - 1) {
+                    unsigned int i = e*BITS_PER_ELEM + __builtin_ctzll(w);
 
-            for (unsigned short i = 0; i < (bm->msb+1)*BITS_PER_ELEM; i++) {
-                if (bmTest(bm, i)) {
                     // bidir support
                     if (((i%2) == 1) && (bmTest(bm, i-1))) {
                         // if this is a backward rule and if forward rule bit is set
                         // ignore because forward already matches
                     } else {
+                        if (cnt == MAX_RULES_MATCH) {
+                            throw Error("more than %d rules match at the same time", 
+                                        MAX_RULES_MATCH);
+                        }
                         // use id of forward rule entry
-                        rmap[eq].rules[rmap[eq].ruleCount] = i/2;
-                        rmap[eq].ruleCount++; 		       
+                        rules[cnt++] = i/2;
                     }
                 }
-                if (rmap[eq].ruleCount == MAX_RULES_MATCH) {
-                    throw Error("more than %d rules match at the same time", 
-                                MAX_RULES_MATCH);
+            }
+
+            // rule array with the exact size
+            if (cnt != rmap[eq].ruleCount) {
+                if (rmap[eq].rules != NULL) {
+                    saveDeleteArr(rmap[eq].rules);
                 }
+                if (cnt > 0) {
+                    rmap[eq].rules = new unsigned int[cnt];
+                }
+            }
+            if (cnt > 0) {
+                memcpy(rmap[eq].rules, rules, sizeof(unsigned int)*cnt);
             }
+            rmap[eq].ruleCount = cnt;
         }
     }
 
 #ifdef DEBUG
     cout << "final chunk" << endl;
     for (unsigned int i = 0; i < cdata.phases[phase].chunks[0].entryCount; i++) {
-        unsigned short indx = cdata.phases[phase].chunks[0].entries[i];
+        equivID_t indx = getEntry(&cdata.phases[phase].chunks[0], i);
         cout << i << ": " << indx;
         cout << " -> ";
         for (unsigned short j = 0; j < rmap[indx].ruleCount; j++) {
@@ -783,6 +1168,7 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
     //! number line used index
     int nlused[MAX_CHUNKS];
     int has_bspec = 0;
+    unsigned int maxRid = 0;
 #ifdef PROFILING
     struct timeval t1, t2;
 
@@ -791,9 +1177,14 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
 
     // assume that nlines, cdata, eqcl and bms are initialized
 
-    if ((int)rules->size() > MAX_RULES) {
-        throw Error("the maximum number of rules is %d", MAX_RULES);
+    // size the bitmaps for the largest rule id
+    for (ruleDBIter_t ri = rules->begin(); ri != rules->end(); ++ri) {
+        unsigned int rid = (*ri)->getUId() * 2 + 1;
+        if (rid > maxRid) {
+            maxRid = rid;
+        }
     }
+    growBitmaps(maxRid);
     
     // initialize number lines
     memset(&nlines, 0, sizeof(numberLines_t));
@@ -849,7 +1240,7 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
     // wildcards matches (point at 0)
     for (ruleDBIter_t ri = rules->begin(); ri != rules->end(); ++ri) {
         Rule *r = (*ri);
-        unsigned short rid = 0;
+        unsigned int rid = 0;
         
         // bidir support
         for (unsigned short backward=0; backward <= r->isBidir(); backward++) {
@@ -917,17 +1308,16 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
     // now scan through the number line looking for distinct equivalence
     // classes
     for (unsigned short i = 0; i < nlines.lineCount; i++) {
-        unsigned short eq = 0;
-        bitmap_t bmp;
-        bmReset(&bmp);
+        equivID_t eq = 0;
+        bitmap_t bmp(bmSize);
               
         makeNewChunk(0, nlines.lines[i].line_size);
 
         for (unsigned int j = 0; j < nlines.lines[i].line_size; j++) {
-            unsigned short rule_cnt = nlines.lines[i].points[j].ruleCount;
+            unsigned int rule_cnt = nlines.lines[i].points[j].ruleCount;
 
             if (rule_cnt > 0) {
-                for (unsigned short k = 0; k < rule_cnt; k++) {
+                for (unsigned int k = 0; k < rule_cnt; k++) {
                     switch (nlines.lines[i].points[j].rules[k].type) {
                     case RULE_START:
                         // set rule bits
@@ -942,7 +1332,7 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
                 eq = findEC(0, i, &bmp);
             }
             // else fill in the last eq            
-            cdata.phases[0].chunks[i].entries[j] = eq;
+            setEntry(&cdata.phases[0].chunks[i], j, eq);
         }
         
 #ifdef PREALLOC_EQUIV_CLASSES
@@ -990,17 +1380,14 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
         }
         // current chunk index
         int cindx = 0;
-        int size = 1;
         for (unsigned short j = 0; j <= cdata.phases[i-1].chunkCount; j++) {
             // start new chunk after rfac chunks and include single last chunk
             if (((j > 0) && ((j % rfac) == 0)) || (j == cdata.phases[i-1].chunkCount)) {
                 // start next chunk
-                makeNewChunk(i, size);
+                makeNewChunk(i, getChunkSize(i, cindx));
                 cindx++;
-                size = 1;
             }
             cdata.phases[i].chunks[cindx].parentChunks[cdata.phases[i].chunks[cindx].parentCount++] = j;
-            size *= eqcl[i-1][j].maxId;
         }
 
 #ifdef DEBUG
@@ -1019,9 +1406,9 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
         // loop over all target chunks
         for (unsigned short j = 0; j < cdata.phases[i].chunkCount; j++) {
             // start the recursion with a bitmap where all bits are set
-            bitmap_t bmp;
+            bitmap_t bmp(bmSize);
             bmSet(&bmp);
-            int indx = 0;
+            unsigned int indx = 0;
             doIntersection(i, j, 0, &indx, &bmp);
         
 #ifdef PREALLOC_EQUIV_CLASSES
@@ -1050,18 +1437,19 @@ void ClassifierRFC::addInitialRules(ruleDB_t *rules)
 /*------------------------------------------------------------------------------*/
 
 // remap phase 0 chunk entries
-void ClassifierRFC::remapIndex(int phase, int chunk, int from, int to, int rid)
+void ClassifierRFC::remapIndex(int phase, int chunk, int from, int to, unsigned int rid)
 {
-    unsigned short eq = 0, oeq = 0;
-    unsigned short remap[65535];
+    equivID_t eq = 0, oeq = 0;
+    chunk_t *c = &cdata.phases[phase].chunks[chunk];
+    vector<equivID_t> remap(eqcl[phase][chunk].maxId);
 
     // map old class to new class
-    for (unsigned short i = 0; i < eqcl[phase][chunk].maxId; i++) {
+    for (equivID_t i = 0; i < eqcl[phase][chunk].maxId; i++) {
         remap[i] = i;
     }
     
-    for (unsigned short i = from; i < to; i++) {
-        oeq = cdata.phases[phase].chunks[chunk].entries[i];
+    for (int i = from; i < to; i++) {
+        oeq = getEntry(c, i);
         eq = remap[oeq];
       
         if (eq == oeq) {
@@ -1091,7 +1479,7 @@ void ClassifierRFC::remapIndex(int phase, int chunk, int from, int to, int rid)
         }
         
         // change this entry
-        cdata.phases[phase].chunks[chunk].entries[i] = eq;
+        setEntry(c, i, eq);
             
     }
 }
@@ -1108,9 +1496,8 @@ void ClassifierRFC::addRule(Rule *r)
     gettimeofday(&t1, NULL);
 #endif    
 
-    if (stats->rules == MAX_RULES) {
-        throw Error("max rule number exceeded");
-    }
+    // make room for the rule bits
+    growBitmaps(r->getUId() * 2 + 1);
 
     // phase 0
 
@@ -1154,7 +1541,7 @@ void ClassifierRFC::addRule(Rule *r)
                 int chunk = findNumberLine(ref, offs, ch, chunk_size);
                 if (chunk < 0) {
                     bitmap_t bmp = allrules;
-                    int eq = 0;
+                    equivID_t eq = 0;
                     bmInfo_t bmi = {NULL, 1};
 
                     // add new chunk
@@ -1169,8 +1556,7 @@ void ClassifierRFC::addRule(Rule *r)
                         // equiv class 1 is all rules + rid
                         bmSet(&bmp, rid);
                         
-                        bmi.bm = new bitmap_t;
-                        *bmi.bm = bmp;
+                        bmi.bm = new bitmap_t(bmp);
                         
                         // only one equiv class
                         eq = eqcl[0][chunk].maxId++;
@@ -1178,8 +1564,7 @@ void ClassifierRFC::addRule(Rule *r)
                         eqcl[0][chunk].eids.push_back(bmi);
                     } else {
                         // set all existing rules as equiv class 0
-                        bmi.bm = new bitmap_t;
-                        *bmi.bm = bmp;
+                        bmi.bm = new bitmap_t(bmp);
               
                         eq = eqcl[0][chunk].maxId++;
                         eqcl[0][chunk].bms[bmi.bm] = eq;
@@ -1188,8 +1573,7 @@ void ClassifierRFC::addRule(Rule *r)
                         // and all existing + current rule as equiv class 1
                         bmSet(&bmp, rid);
 
-                        bmi.bm = new bitmap_t;
-                        *bmi.bm = bmp;
+                        bmi.bm = new bitmap_t(bmp);
                      
                         eq = eqcl[0][chunk].maxId++;
                         eqcl[0][chunk].bms[bmi.bm] = eq;
@@ -1264,25 +1648,16 @@ void ClassifierRFC::addRule(Rule *r)
         // loop over all target chunks
         for (unsigned short j = 0; j < cdata.phases[i].chunkCount; j++) {
             // realloc chunk size if necessary
-            unsigned int size = 1;
-            for (unsigned short k = 0; k < cdata.phases[i].chunks[j].parentCount; k++) {
-                size *= eqcl[i-1][cdata.phases[i].chunks[j].parentChunks[k]].maxId;
-            }
+            unsigned int size = getChunkSize(i, j);
 	   
             if (size != cdata.phases[i].chunks[j].entryCount) {
-                unsigned short *new_entries = new unsigned short[size];
-                memset(new_entries, 0, sizeof(unsigned short)*size);
-                memcpy(new_entries, cdata.phases[i].chunks[j].entries, 
-                       sizeof(unsigned short)*cdata.phases[i].chunks[j].entryCount);
-                saveDeleteArr(cdata.phases[i].chunks[j].entries);
-                cdata.phases[i].chunks[j].entries = new_entries;
-                cdata.phases[i].chunks[j].entryCount = size;
+                resizeChunk(&cdata.phases[i].chunks[j], size);
             }
 
             // start the recursion with a bitmap where all bits are set
-            bitmap_t bmp;
+            bitmap_t bmp(bmSize);
             bmSet(&bmp);
-            int indx = 0;
+            unsigned int indx = 0;
             doIntersection(i, j, 0, &indx, &bmp);
             
 
@@ -1309,9 +1684,9 @@ void ClassifierRFC::addRule(Rule *r)
 
 void ClassifierRFC::delRule(Rule *r)
 {
-    int rid = 0;
+    unsigned int rid = 0;
 #ifdef REMAP_AFTER_DELETE
-    unsigned short remap[65535];
+    vector<equivID_t> remap;
     int do_remap = 0;
 #endif
 #ifdef PROFILING
@@ -1352,7 +1727,10 @@ void ClassifierRFC::delRule(Rule *r)
    
         // delete rule bit from all equiv classes and remove old bitmaps from phase 0
         for (unsigned short i = 0; i < cdata.phases[0].chunkCount; i++) {
-            for (unsigned short eq = 0; eq < eqcl[0][i].maxId; eq++) {
+#ifdef REMAP_AFTER_DELETE
+            remap.resize(eqcl[0][i].maxId);
+#endif
+            for (equivID_t eq = 0; eq < eqcl[0][i].maxId; eq++) {
                 bmInfo_t *bi = &eqcl[0][i].eids[eq];
 #ifdef REMAP_AFTER_DELETE
                 remap[eq] = eq;
@@ -1384,8 +1762,8 @@ void ClassifierRFC::delRule(Rule *r)
 #ifdef REMAP_AFTER_DELETE
             if (do_remap) {
                 for (unsigned int j = 0; j < cdata.phases[0].chunks[i].entryCount; j++) {
-                    unsigned short oeq = cdata.phases[0].chunks[i].entries[j];
-                    unsigned short eq = remap[oeq];
+                    equivID_t oeq = getEntry(&cdata.phases[0].chunks[i], j);
+                    equivID_t eq = remap[oeq];
                     if (eq != oeq) {
                         if (eqcl[0][i].eids[oeq].refc > 0) {
                             eqcl[0][i].eids[oeq].refc--;
@@ -1397,7 +1775,7 @@ void ClassifierRFC::delRule(Rule *r)
                         }
                    
                         // change
-                        cdata.phases[0].chunks[i].entries[j] = eq;
+                        setEntry(&cdata.phases[0].chunks[i], j, eq);
 
                         eqcl[0][i].eids[eq].refc++;
                     }
@@ -1426,7 +1804,7 @@ void ClassifierRFC::delRule(Rule *r)
     cout << "final chunk" << endl;
     if (cdata.phaseCount > 0) {
         for (unsigned int i = 0; i < cdata.phases[cdata.phaseCount-1].chunks[0].entryCount; i++) {
-            unsigned short indx = cdata.phases[cdata.phaseCount-1].chunks[0].entries[i];
+            equivID_t indx = getEntry(&cdata.phases[cdata.phaseCount-1].chunks[0], i);
             cout << i << ": " << indx;
             cout << " -> ";
             for (unsigned short j = 0; j < rmap[indx].ruleCount; j++) {
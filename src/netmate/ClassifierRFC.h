@@ -65,14 +65,14 @@ typedef enum
 typedef struct
 {
     pointType_t type;
-    unsigned short rid;
+    unsigned int rid;
 } rule_t;
 
 //! definition of a point (with n rules)
 typedef struct 
 {
     unsigned int entryCount;    //!< number of entries in point array
-    unsigned short ruleCount;     //!< number of rules in rules array
+    unsigned int ruleCount;     //!< number of rules in rules array
     rule_t *rules;     //!< the rules
 } point_t;
 
@@ -107,24 +107,36 @@ typedef struct
 
 
 //! equivalence ID (equivID) type definition
-typedef unsigned short equivID_t;
+typedef unsigned int equivID_t;
 
+//! max number of equiv classes of a chunk with 16 bit entries
+const unsigned int MAX_NARROW_CLASSES = 0x10000;
 
-//! comparison operator for bitmaps
-struct ltbm
+
+//! hash function for bitmaps
+struct hashbm
+{
+    size_t operator()(const bitmap_t *b) const
+    {
+        return bmHash(b);
+    }
+};
+
+//! equality operator for bitmaps
+struct eqbm
 {
     bool operator()(const bitmap_t *b1, const bitmap_t *b2) const
     {
-        return bmCompare(b1, b2);
+        return bmEqual(b1, b2);
     }
 };
 
 /*! list with rule bitmap and the equivalence ID, indexed by rule bitmap
     used for looking up the eqID for an existing bitmap
-    FIXME more efficient way?
+    a bitmap must be removed before it is changed (the hash changes)
 */
-typedef map<bitmap_t*, equivID_t, ltbm>            chunkBmList_t;
-typedef map<bitmap_t*, equivID_t, ltbm>::iterator  chunkBmListIter_t;
+typedef hash_map<bitmap_t*, equivID_t, hashbm, eqbm>            chunkBmList_t;
+typedef hash_map<bitmap_t*, equivID_t, hashbm, eqbm>::iterator  chunkBmListIter_t;
 
 
 //! list with free equivIDs
@@ -156,7 +168,7 @@ typedef vector<bmInfo_t>::iterator  chunkEqClArrayIter_t;
 typedef struct {
     chunkBmList_t bms;    //!< list of ids indexed by bitmap
     chunkEqClArray_t eids;   //!< list of bitmaps indexed by equiv ids
-    unsigned short maxId;  //!< current max id
+    equivID_t maxId;  //!< current max id
     freeList_t freeList;   //!< free equiv IDs
 } eqList_t;
 
@@ -170,9 +182,36 @@ typedef struct
     unsigned short parentCount;                 //!< number of parents
     unsigned short parentChunks[MAX_CHUNKS];    //!< chunk numbers of all parents (phase-1)
     unsigned int entryCount;                  //!< number of entries in this chunk
-    equivID_t  *entries;                    //!< the chunks entries containing eqIDs
+    //! 1 if the entries are 32 bit (more than MAX_NARROW_CLASSES equiv classes)
+    unsigned short wide;
+    union {
+        unsigned short *n;
+        unsigned int *w;
+    } entries;                              //!< the chunks entries containing eqIDs
 } chunk_t;
 
+//! get the eqID of entry i of a chunk
+inline equivID_t getEntry(const chunk_t *c, unsigned int i)
+{
+    return c->wide ? c->entries.w[i] : c->entries.n[i];
+}
+
+//! get the address of entry i of a chunk (for prefetching)
+inline const void *getEntryAddr(const chunk_t *c, unsigned int i)
+{
+    return c->wide ? (const void *) &c->entries.w[i] : (const void *) &c->entries.n[i];
+}
+
+//! set the eqID of entry i of a chunk
+inline void setEntry(chunk_t *c, unsigned int i, equivID_t eq)
+{
+    if (c->wide) {
+        c->entries.w[i] = eq;
+    } else {
+        c->entries.n[i] = (unsigned short) eq;
+    }
+}
+
 //! array of all chunks for this phase
 typedef struct
 {
@@ -189,16 +228,41 @@ typedef struct {
 
 //! final rule map to match the last index to an array of rule numbers
 typedef struct {
-    unsigned short ruleCount;               //!< number of rules
-    unsigned short rules[MAX_RULES_MATCH];  //!< array with rule indexes
+    unsigned short ruleCount;               //!< number of rules (at most MAX_RULES_MATCH)
+    unsigned int *rules;                    //!< array with ruleCount rule indexes
 } matchingRules_t;
 
 typedef matchingRules_t *ruleMap_t;
 
 
+/*! \short   lookup tables used by classify
+
+    classify only reads a published generation of the tables. Rules are
+    added to and deleted from the build data of the classifier, afterwards
+    a copy of the result is published by swapping the tables pointer (RCU
+    like), so classification is never blocked by rule changes. The old
+    generation is freed when the classifier thread has switched to the new
+    one.
+*/
+typedef struct {
+    numberLineDescrs_t nldscs;  //!< number line descriptors (chunk 0)
+    phases_t cdata;             //!< chunk data
+    //! number of equiv classes of each chunk (for the index calculation)
+    equivID_t classes[MAX_PHASES][MAX_CHUNKS];
+    ruleMap_t rmap;             //!< final rule map
+    unsigned long rmap_size;
+} rfcTables_t;
+
+typedef list<rfcTables_t*>            rfcTablesList_t;
+typedef list<rfcTables_t*>::iterator  rfcTablesListIter_t;
+
+
 //! stores the calculated indexes during classification
 typedef equivID_t eqNum_t[MAX_PHASES][MAX_CHUNKS];
 
+//! stores the indexes or equiv classes of one phase for a batch of packets
+typedef unsigned int batchNum_t[MAX_CLASSIFY_BATCH][MAX_CHUNKS];
+
 
 //! classifie which uses recursive flow classification scheme
 class ClassifierRFC : public Classifier
@@ -213,19 +277,52 @@ class ClassifierRFC : public Classifier
     //! equiv classes (bitmap) indexed by class id
     eqClTable_t eqcl;
 
-    //! chunk data
+    //! chunk data (build data, classify uses the published tables)
     phases_t cdata;
 
-    //! final rule bitmap to id array map
+    //! final rule bitmap to id array map (build data)
     ruleMap_t rmap;
     unsigned long rmap_size;
 
     //! equiv classes for classify
     eqNum_t eqnums;
 
+    //! chunk indexes and equiv classes of the last phase for classifyBatch
+    batchNum_t bindx, beqnums;
+
     //! bitset containing all rule bits currently used
     bitmap_t allrules;
 
+    //! number of elements of all bitmaps
+    int bmSize;
+
+    //! tables used by classify (NULL if there are no rules)
+    rfcTables_t * volatile tables;
+
+    //! replaced tables that may still be used by the classifier thread
+    rfcTablesList_t retired;
+
+    //! tables used by the last classify call (only used by classify)
+    rfcTables_t *readerTables;
+
+    //! tables the classifier thread has switched to
+    rfcTables_t * volatile readerAck;
+
+    //! copy the build data into a new generation of lookup tables
+    rfcTables_t *copyTables();
+
+    //! free a generation of lookup tables
+    void freeTables(rfcTables_t *t);
+
+    //! make the build data the tables used by classify
+    void publishTables();
+
+    //! free the retired tables the classifier thread does not use anymore
+    void freeRetired();
+
+    //! get the current tables (only used by the classifier thread)
+    inline rfcTables_t *getTables();
+
 
     //! fast initial add (no rules present)
     void addInitialRules(ruleDB_t *rules);
@@ -242,26 +339,35 @@ class ClassifierRFC : public Classifier
                   unsigned short *ret);
 
     //! adds a rule to a single point on the number line
-    void addRuleToPoint(point_t *p, pointType_t type, unsigned short rid);
+    void addRuleToPoint(point_t *p, pointType_t type, unsigned int rid);
 
     // project directly on phase 0 chunk and remap existing entries
-    void projMatchRemap(unsigned short rid, unsigned short chunk_id, int chunk_size, 
+    void projMatchRemap(unsigned int rid, unsigned short chunk_id, int chunk_size, 
                         unsigned short ch, filter_t *f);
 
     // project directly on phase 0 chunk
-    void projMatchDirectly(unsigned short eq, unsigned short chunk_id, int chunk_size, 
+    void projMatchDirectly(equivID_t eq, unsigned short chunk_id, int chunk_size, 
                            unsigned short ch, filter_t *f);
     
     //! projects a match on the the number line (multiple points)
-    void projMatch(unsigned short rid, unsigned short chunk_id, int chunk_size, 
+    void projMatch(unsigned int rid, unsigned short chunk_id, int chunk_size, 
                    unsigned short ch, filter_t *f);
 
     //! do the intersection for phases 1-n
     void doIntersection(unsigned short phase, unsigned short chunk, 
-            			unsigned short parent, int *indx, bitmap_t *bm);
+            			unsigned short parent, unsigned int *indx, bitmap_t *bm);
 
     //! remap indexes on number line (incremental add)
-    void remapIndex(int phase, int chunk, int from, int to, int rid);
+    void remapIndex(int phase, int chunk, int from, int to, unsigned int rid);
+
+    //! make all bitmaps large enough for rule id rid
+    void growBitmaps(unsigned int rid);
+
+    //! get the number of entries of a phase 1-n chunk from its parents
+    unsigned int getChunkSize(unsigned short phase, unsigned short chunk);
+
+    //! switch a chunk to 32 bit entries if it has too many equiv classes
+    void checkChunkWidth(unsigned short phase, unsigned short chunk);
 
     //! initialize data
     void initData();
@@ -286,13 +392,16 @@ class ClassifierRFC : public Classifier
 
     void genFinalMap(unsigned short phase);
 
-    unsigned short findEC(unsigned short phase, unsigned short chunk, bitmap_t *b);
+    equivID_t findEC(unsigned short phase, unsigned short chunk, bitmap_t *b);
 
     void addPreAllocEC(unsigned short phase, unsigned short chunk, 
                        unsigned short cnt);
 
     void makeNewChunk(unsigned short phase, unsigned int size);
 
+    //! change the number of entries of a chunk (keeps the existing entries)
+    void resizeChunk(chunk_t *c, unsigned int size);
+
     //! debug functions
     void printNumberLines();
     void printChunk(unsigned short phase, unsigned short chunk, int show_cdata);
@@ -316,6 +425,14 @@ class ClassifierRFC : public Classifier
     //! classify a packet
     virtual int classify(metaData_t* pkt);
 
+    /*! \short   classify several packets
+
+        All packets go through a phase before the next phase starts. The
+        table entries of a phase are prefetched for all packets before
+        they are read, so the cache misses of the packets overlap.
+    */
+    virtual void classifyBatch(metaData_t **pkts, int n, int *res);
+
     //! check a ruleset (the filter part)
     virtual void checkRules(ruleDB_t *rules);
 
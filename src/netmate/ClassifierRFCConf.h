@@ -31,10 +31,14 @@
 #define _CLASSIFIER_RFC_CONF_H_
 
 
-/*! max number of rules supported (must be power of 2!) 
-    multiply by 2 because each rule can result in 2 equiv classes (bidir rules)
+/*! initial number of rule bits of the bitmaps, the bitmaps grow (doubling)
+    when a rule with a larger id is added
+    each rule uses 2 bits (bidir rules)
  */
-const unsigned short MAX_RULES = 1024 * 2;
+const unsigned int INITIAL_RULE_BITS = 64;
+
+//! max number of entries of a chunk in phase 1-n
+const unsigned long MAX_CHUNK_ENTRIES = 1UL << 28;
 
 //! max number of chunks (should be power of 2)
 const unsigned short MAX_CHUNKS = 32;
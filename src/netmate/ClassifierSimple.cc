@@ -29,11 +29,54 @@
 #include "ClassifierSimple.h"
 
 
+//! hash of the masked value of a packet field
+static inline unsigned long hashValue(const unsigned char *val, const char *mask,
+                                      unsigned short len)
+{
+    unsigned long h = 2166136261UL;
+
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (val[i] & (unsigned char) mask[i])) * 16777619UL;
+    }
+
+    return h;
+}
+
+//! true if a match is on the field the match f is on
+static inline int sameField(const match_t *m, const match_t *f)
+{
+    return (m->refer == f->refer) && (m->offs == f->offs) && (m->len == f->len) &&
+        !memcmp(m->mask, f->mask, m->len);
+}
+
+//! get the match of a rule usable for dispatching on the field of f (or NULL)
+static inline const match_t *findField(matchList_t &matches, const match_t *f)
+{
+    for (matchListIter_t m = matches.begin(); m != matches.end(); ++m) {
+        if (((m->type == FT_EXACT) || (m->type == FT_SET)) && sameField(&*m, f)) {
+            return &*m;
+        }
+    }
+
+    return NULL;
+}
+
+//! get the distinct value hashes of a match
+static void getHashes(const match_t *m, set<unsigned long> *hashes)
+{
+    int cnt = (m->type == FT_SET) ? m->cnt : 1;
+
+    for (int c = 0; c < cnt; c++) {
+        hashes->insert(hashValue((const unsigned char *) m->value[c], m->mask, m->len));
+    }
+}
+
+
 /* ------------------------- ClassifierSimple ------------------------- */
 
 ClassifierSimple::ClassifierSimple(ConfigManager *cnf, Sampler *sa,
                                    PacketQueue *pq, int threaded) 
-    : Classifier(cnf, "ClassifierSimple",sa,pq,threaded)
+    : Classifier(cnf, "ClassifierSimple",sa,pq,threaded), tree(NULL), usedRefers(0)
 {
 #ifdef DEBUG
     log->dlog(ch, "ClassifierSimple constructor" );
@@ -61,88 +104,281 @@ ClassifierSimple::~ClassifierSimple()
         mutexDestroy(&maccess);
     }
 #endif
+
+    freeNode(tree);
+}
+
+
+int ClassifierSimple::matchRule(matchList_t &matches, metaData_t *pkt)
+{
+    unsigned char tmp[MAX_FILTER_LEN];
+
+    for (matchListIter_t m = matches.begin(); m != matches.end(); ++m) {
+        // if the offset is not > 0 there cant be a match
+        if (pkt->offs[m->refer] < 0) {
+            return -1;
+        } else {
+            unsigned short len = m->len;
+            filterType_t type = m->type; 
+            unsigned char *pval = (unsigned char *) &pkt->payload[ pkt->offs[m->refer] + m->offs ];
+              
+            if (type != FT_WILD) {
+                  
+                // get masked pkt value ...
+                for (int i = 0; i < len; i++) {
+                    tmp[i] = pval[i] & m->mask[i];
+                }	
+
+                // ... and compare with match value
+                if ((type == FT_EXACT) && memcmp(tmp, m->value[0], len)) {
+                    return 0;
+                }
+                else if ((type == FT_RANGE) &&
+                         ((memcmp(tmp, m->value[0], len) < 0) ||
+                          (memcmp(tmp, m->value[1], len) > 0))) {
+                    return 0;
+                }
+                else if (type == FT_SET) {
+                    int c = 0;
+                    int inset = 0;
+
+                    while (c < m->cnt) {
+                        if (!memcmp(tmp, m->value[c], len)) {
+                            inset = 1;
+                            break;
+                        }
+                        c++;
+                    }
+                    if (!inset) {
+                        return 0;
+                    }
+                } 
+            }
+        }
+    }
+
+    return 1;
+}
+
+
+void ClassifierSimple::addMatch(metaData_t *pkt, int rid, int *lastMatch)
+{
+    if (rid != *lastMatch+1) {
+        /// store rule id in meta-data (for use by PacketProcessor)
+        if (pkt->match_cnt >= MAX_RULES_MATCH) {
+            throw Error("more than %d rules match the same packet", MAX_RULES_MATCH);
+        }
+   
+        pkt->match[pkt->match_cnt] = rid/2;
+        if ((rid % 2) == 1) {
+            pkt->reverse = 1;
+        }
+        *lastMatch = rid;
+
+        pkt->match_cnt++;
+    }
 }
 
 
 int ClassifierSimple::classify( metaData_t* pkt )
 {
-    int found;
     int last_match = -2; // first forward rule is 0
-    unsigned char tmp[MAX_FILTER_LEN];
+    int missing = 0;
+    dtNode_t *n;
 
     AUTOLOCK(threaded, &maccess);
 
     pkt->match_cnt = 0;
-    
-    for (rulesIter_t r = rules.begin(); r != rules.end(); ++r) {  
-        found = 1;
 
-        for (matchListIter_t m = r->second.begin(); m != r->second.end(); ++m) {
-            // if the offset is not > 0 there cant be a match
-            if (pkt->offs[m->refer] < 0) {
+    if (tree == NULL) {
+        return 0;
+    }
+
+    for (int i = MAC; i <= DATA; i++) {
+        if (pkt->offs[i] < 0) {
+            missing |= (1 << i);
+        }
+    }
+
+    if (missing & usedRefers) {
+        // a rule on a missing layer ends the classification, so check
+        // all rules in order
+        for (rulesIter_t r = rules.begin(); r != rules.end(); ++r) {
+            int res = matchRule(r->second, pkt);
+
+            if (res < 0) {
                 return 0;
-            } else {
-                unsigned short len = m->len;
-                filterType_t type = m->type; 
-                unsigned char *pval = (unsigned char *) &pkt->payload[ pkt->offs[m->refer] + m->offs ];
-              
-                if (type != FT_WILD) {
-                  
-                    // get masked pkt value ...
-                    for (int i = 0; i < len; i++) {
-                        tmp[i] = pval[i] & m->mask[i];
-                    }	
-
-                    // ... and compare with match value
-                    if ((type == FT_EXACT) && memcmp(tmp, m->value[0], len)) {
-                        found = 0;
-                        break;
-                    }
-                    else if ((type == FT_RANGE) &&
-                             ((memcmp(tmp, m->value[0], len) < 0) ||
-                              (memcmp(tmp, m->value[1], len) > 0))) {
-                        found = 0;
-                        break;
+            } else if (res > 0) {
+                addMatch(pkt, r->first, &last_match);
+            }
+        }
+
+        return pkt->match_cnt;
+    }
+
+    // find the candidate rules in the decision tree
+    n = tree;
+    while (!n->children.empty()) {
+        dtChildrenIter_t c = 
+          n->children.find(hashValue(&pkt->payload[pkt->offs[n->refer] + n->offs], 
+                                     n->mask, n->len));
+
+        n = (c != n->children.end()) ? c->second : n->other;
+    }
+
+    for (ruleRefListIter_t r = n->rules.begin(); r != n->rules.end(); ++r) {
+        if (matchRule((*r)->second, pkt) > 0) {
+            addMatch(pkt, (*r)->first, &last_match);
+        }
+    }
+
+    return pkt->match_cnt;
+}
+
+
+void ClassifierSimple::buildTree()
+{
+    ruleRefList_t all;
+
+    freeNode(tree);
+
+    usedRefers = 0;
+    for (rulesIter_t r = rules.begin(); r != rules.end(); ++r) {
+        for (matchListIter_t m = r->second.begin(); m != r->second.end(); ++m) {
+            usedRefers |= (1 << m->refer);
+        }
+        all.push_back(r);
+    }
+
+    tree = buildNode(all, 0);
+}
+
+
+dtNode_t *ClassifierSimple::buildNode(ruleRefList_t &cand, int depth)
+{
+    dtNode_t *n = new dtNode_t;
+    const match_t *best = NULL;
+    unsigned long bestMax = cand.size();
+    vector<const match_t *> tried;
+
+    n->other = NULL;
+
+    if ((cand.size() <= DT_LEAF_RULES) || (depth >= DT_MAX_DEPTH)) {
+        n->rules = cand;
+        return n;
+    }
+
+    // find the field which leaves the fewest rules in the largest child
+    for (ruleRefListIter_t r = cand.begin(); r != cand.end(); ++r) {
+        for (matchListIter_t m = (*r)->second.begin(); m != (*r)->second.end(); ++m) {
+            map<unsigned long, unsigned long> cnt;
+            unsigned long wild = 0, maxCnt = 0, total = 0;
+            unsigned int i;
+
+            if ((m->type != FT_EXACT) && (m->type != FT_SET)) {
+                continue;
+            }
+
+            // each field is tried once
+            for (i = 0; (i < tried.size()) && !sameField(&*m, tried[i]); i++);
+            if (i < tried.size()) {
+                continue;
+            }
+            tried.push_back(&*m);
+
+            for (ruleRefListIter_t r2 = cand.begin(); r2 != cand.end(); ++r2) {
+                const match_t *m2 = findField((*r2)->second, &*m);
+
+                if (m2 == NULL) {
+                    wild++;
+                } else {
+                    set<unsigned long> hashes;
+
+                    getHashes(m2, &hashes);
+                    for (set<unsigned long>::iterator h = hashes.begin(); h != hashes.end(); ++h) {
+                        maxCnt = max(maxCnt, ++cnt[*h]);
+                        total++;
                     }
-                    else if (type == FT_SET) {
-                        int c = 0;
-                        int inset = 0;
-
-                        while (c < m->cnt) {
-                            if (!memcmp(tmp, m->value[c], len)) {
-                                inset = 1;
-                                break;
-                            }
-                            c++;
-                        }
-                        if (!inset) {
-                            found = 0;
-                            break;
-                        }
-                    } 
                 }
             }
+
+            // rules matching any value are copied into all children
+            total += wild * (cnt.size() + 1);
+
+            if ((wild + maxCnt < bestMax) && (total <= DT_MAX_COPIES * cand.size())) {
+                best = &*m;
+                bestMax = wild + maxCnt;
+            }
         }
+    }
 
-        if (found) {
-            if (r->first != last_match+1) {
-                /// store rule id in meta-data (for use by PacketProcessor)
-                if (pkt->match_cnt > MAX_RULES_MATCH) {
-                    throw Error("more than %d rules match the same packet", MAX_RULES_MATCH);
-                }
-   
-                pkt->match[pkt->match_cnt] = r->first/2;
-		if ((r->first % 2) == 1) {
-		  pkt->reverse = 1;
-		}
-                last_match = r->first;
+    if (best == NULL) {
+        // no field separates the rules
+        n->rules = cand;
+        return n;
+    }
+
+    n->refer = best->refer;
+    n->offs = best->offs;
+    n->len = best->len;
+    memcpy(n->mask, best->mask, best->len);
 
-                pkt->match_cnt++;
+    // split the rules keeping their order
+    map<unsigned long, ruleRefList_t> parts;
+    ruleRefList_t wild;
+
+    for (ruleRefListIter_t r = cand.begin(); r != cand.end(); ++r) {
+        const match_t *m = findField((*r)->second, best);
+
+        if (m != NULL) {
+            set<unsigned long> hashes;
+
+            getHashes(m, &hashes);
+            for (set<unsigned long>::iterator h = hashes.begin(); h != hashes.end(); ++h) {
+                parts[*h];
             }
         }
     }
 
-    return pkt->match_cnt;
+    for (ruleRefListIter_t r = cand.begin(); r != cand.end(); ++r) {
+        const match_t *m = findField((*r)->second, best);
+
+        if (m == NULL) {
+            for (map<unsigned long, ruleRefList_t>::iterator p = parts.begin(); p != parts.end(); ++p) {
+                p->second.push_back(*r);
+            }
+            wild.push_back(*r);
+        } else {
+            set<unsigned long> hashes;
+
+            getHashes(m, &hashes);
+            for (set<unsigned long>::iterator h = hashes.begin(); h != hashes.end(); ++h) {
+                parts[*h].push_back(*r);
+            }
+        }
+    }
+
+    for (map<unsigned long, ruleRefList_t>::iterator p = parts.begin(); p != parts.end(); ++p) {
+        n->children[p->first] = buildNode(p->second, depth+1);
+    }
+    n->other = buildNode(wild, depth+1);
+
+    return n;
+}
+
+
+void ClassifierSimple::freeNode(dtNode_t *n)
+{
+    if (n == NULL) {
+        return;
+    }
+
+    for (dtChildrenIter_t c = n->children.begin(); c != n->children.end(); ++c) {
+        freeNode(c->second);
+    }
+    freeNode(n->other);
+
+    delete n;
 }
 
   
@@ -167,6 +403,8 @@ void ClassifierSimple::addRules(ruleDB_t *rules)
             addRule(*iter, 0);
         }
     }
+
+    buildTree();
 }
 
 
@@ -183,6 +421,8 @@ void ClassifierSimple::delRules(ruleDB_t *rules)
             delRule(*iter, 0);
         }
     }
+
+    buildTree();
 }
 
 
@@ -71,6 +71,49 @@ typedef vector<match_t>::iterator   matchListIter_t;
 typedef map<int, matchList_t>           rules_t;
 typedef map<int, matchList_t>::iterator rulesIter_t;
 
+//! list of rules (in the order of the rule list)
+typedef vector<rulesIter_t>             ruleRefList_t;
+typedef vector<rulesIter_t>::iterator   ruleRefListIter_t;
+
+//! rules at most in a leaf of the decision tree
+const unsigned int DT_LEAF_RULES = 4;
+
+//! maximum depth of the decision tree
+const int DT_MAX_DEPTH = 8;
+
+//! maximum factor by which the rules of a node may be copied to its children
+const unsigned int DT_MAX_COPIES = 4;
+
+/*! \short   node of the decision tree of the rules
+
+    An inner node dispatches on the masked value of one packet field: rules
+    which match the field exactly (or against a set) are put into the child
+    for their value(s), rules which do not are copied into all children and
+    into the child for other values. Children are found by a hash of the
+    value and rules with colliding values share a child, so a leaf only
+    holds candidates which are checked with all their matches.
+*/
+typedef struct dtNode
+{
+    //! field dispatched on (inner nodes)
+    refer_t refer;
+    unsigned short offs;
+    unsigned short len;
+    char mask[MAX_FILTER_LEN];
+
+    //! children by value hash (empty for a leaf)
+    hash_map<unsigned long, struct dtNode *> children;
+
+    //! child for all other values
+    struct dtNode *other;
+
+    //! candidate rules (leaves)
+    ruleRefList_t rules;
+} dtNode_t;
+
+typedef hash_map<unsigned long, dtNode_t *>            dtChildren_t;
+typedef hash_map<unsigned long, dtNode_t *>::iterator  dtChildrenIter_t;
+
 
 class ClassifierSimple : public Classifier
 {
@@ -79,6 +122,27 @@ class ClassifierSimple : public Classifier
     //! rule list
     rules_t rules;
 
+    //! decision tree built from the rule list
+    dtNode_t *tree;
+
+    //! reference points used by any rule (bit mask)
+    int usedRefers;
+
+    //! rebuild the decision tree after the rules have changed
+    void buildTree();
+
+    //! build the (sub) tree for a list of rules
+    dtNode_t *buildNode(ruleRefList_t &cand, int depth);
+
+    //! free a (sub) tree
+    void freeNode(dtNode_t *n);
+
+    //! check all matches of a rule (1 = match, 0 = no match, -1 = missing layer)
+    int matchRule(matchList_t &matches, metaData_t *pkt);
+
+    //! store a matching rule in the packet meta data
+    void addMatch(metaData_t *pkt, int rid, int *lastMatch);
+
     //! add a single rule
     void addRule(Rule *r)
     {
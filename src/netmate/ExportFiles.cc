@@ -0,0 +1,203 @@
+/*! \file  ExportFiles.cc
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    export files kept open between exports
+
+    $Id$
+*/
+
+#include "ExportFiles.h"
+
+
+ExportFiles *ExportFiles::s_instance = NULL;
+
+
+/* -------------------- getInstance -------------------- */
+
+ExportFiles *ExportFiles::getInstance()
+{
+    if (s_instance == NULL) {
+        s_instance = new ExportFiles();
+    }
+    return s_instance;
+}
+
+
+/* ------------------------- ExportFiles ------------------------- */
+
+ExportFiles::ExportFiles()
+{
+    log = Logger::getInstance();
+    ch = log->createChannel("ExportFiles");
+
+#ifdef ENABLE_THREADS
+    mutexInit(&access);
+#endif
+}
+
+
+/* ------------------------- ~ExportFiles ------------------------- */
+
+ExportFiles::~ExportFiles()
+{
+    // files still open (there should be none)
+    for (exportFileListIter_t f = files.begin(); f != files.end(); ++f) {
+        delete f->second.ofile;
+        delete f->second.writer;
+    }
+
+#ifdef ENABLE_THREADS
+    mutexDestroy(&access);
+#endif
+}
+
+
+/* ------------------------- createDir ------------------------- */
+
+void ExportFiles::createDir(string filename)
+{
+    string::size_type i = 0;
+
+    while ((i = filename.find('/', i+1)) != string::npos) {
+        struct stat statbuf;
+        string dir = filename.substr(0, i);
+
+        if (!(stat(dir.c_str(), &statbuf) == 0 && S_ISDIR(statbuf.st_mode))) {
+            if (mkdir(dir.c_str(), 0777) != 0) {
+                throw Error("unable to make directory for %s: %s", filename.c_str(),
+                            strerror(errno));
+            }
+        }
+    }
+}
+
+
+/* ------------------------- checkFile ------------------------- */
+
+int ExportFiles::checkFile(exportFileListIter_t f)
+{
+    int err = f->second.writer->getError();
+
+    if ((err == 0) && !f->second.ofile->fail()) {
+        return 1;
+    }
+
+    log->elog(ch, "writing %s failed: %s, export data lost", f->first.c_str(),
+              (err != 0) ? strerror(err) : "stream error");
+    return 0;
+}
+
+
+/* ------------------------- reopenFile ------------------------- */
+
+void ExportFiles::reopenFile(exportFileListIter_t f)
+{
+    // open the new file first, so the old one stays usable on errors
+    AsyncWriter *writer = new AsyncWriter(f->first, f->second.compression,
+                                          f->second.nthreads);
+
+    delete f->second.ofile;
+    delete f->second.writer;
+    f->second.writer = writer;
+    f->second.ofile = new ostream(writer);
+
+    log->log(ch, "reopened %s", f->first.c_str());
+}
+
+
+/* ------------------------- acquire ------------------------- */
+
+ostream &ExportFiles::acquire(set<string> &used, string filename,
+                              compression_t compression, int nthreads,
+                              uid_t uid, gid_t gid)
+{
+    filename += AsyncWriter::getSuffix(compression);
+
+    exportFileListIter_t f = files.find(filename);
+
+    if (f == files.end()) {
+        exportFile_t nf;
+
+        createDir(filename);
+
+        nf.writer = new AsyncWriter(filename, compression, nthreads);
+        nf.ofile = new ostream(nf.writer);
+        chown(filename.c_str(), uid, gid);
+        nf.refs = 0;
+        nf.compression = compression;
+        nf.nthreads = nthreads;
+
+        f = files.insert(make_pair(filename, nf)).first;
+    } else if (!checkFile(f)) {
+        reopenFile(f);
+    }
+
+    if (used.insert(filename).second) {
+        f->second.refs++;
+    }
+
+    return *f->second.ofile;
+}
+
+
+/* ------------------------- release ------------------------- */
+
+void ExportFiles::release(set<string> &used)
+{
+    for (set<string>::iterator i = used.begin(); i != used.end(); ++i) {
+        exportFileListIter_t f = files.find(*i);
+
+        if ((f != files.end()) && (--f->second.refs == 0)) {
+            f->second.ofile->flush();
+            checkFile(f);
+            delete f->second.ofile;
+            // writes out the remaining data
+            delete f->second.writer;
+            files.erase(f);
+        }
+    }
+    used.clear();
+}
+
+
+/* ------------------------- flush ------------------------- */
+
+void ExportFiles::flush(set<string> &used)
+{
+    for (set<string>::iterator i = used.begin(); i != used.end(); ++i) {
+        exportFileListIter_t f = files.find(*i);
+
+        if (f == files.end()) {
+            continue;
+        }
+
+        f->second.ofile->flush();
+        if (!checkFile(f)) {
+            try {
+                reopenFile(f);
+            } catch (Error &e) {
+                // tried again at the next flush or export
+                log->elog(ch, e);
+            }
+        }
+    }
+}
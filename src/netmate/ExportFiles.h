@@ -0,0 +1,140 @@
+/*! \file  ExportFiles.h
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    export files kept open between exports (used by the file export modules)
+
+    $Id$
+*/
+
+#ifndef _EXPORTFILES_H_
+#define _EXPORTFILES_H_
+
+
+#include "stdincpp.h"
+#include "Error.h"
+#include "Threads.h"
+#include "Logger.h"
+#include "AsyncWriter.h"
+
+
+/*! \short   open export files shared by the file export modules
+
+    Export files are kept open between exports. Tasks exporting into the
+    same file share it, the data is written (and compressed) by the
+    AsyncWriter of the file. Each task keeps the set of files it uses,
+    a file is closed when the last task using it releases it. A file that
+    failed to write is reopened (the data not written is lost).
+
+    exportData runs in the exporter thread while the module timers flushing
+    the files run in the meter thread. Hold getLock() while calling acquire,
+    release or flush and while writing to a file.
+*/
+
+class ExportFiles
+{
+  private:
+
+    //! link to the globally available ExportFiles instance
+    static ExportFiles *s_instance;
+
+    typedef struct {
+        AsyncWriter *writer;
+        ostream *ofile;
+        int refs;  //!< number of tasks using the file
+        compression_t compression;
+        int nthreads;
+    } exportFile_t;
+
+    typedef map<string, exportFile_t>            exportFileList_t;
+    typedef map<string, exportFile_t>::iterator  exportFileListIter_t;
+
+    exportFileList_t files;
+
+    Logger *log; //!< link to global logger
+    int ch;      //!< logging channel used by objects of this class
+
+#ifdef ENABLE_THREADS
+    mutex_t access;
+#endif
+
+    ExportFiles();
+
+    //! create all directories above a file
+    void createDir(string filename);
+
+    /*! \short   test whether all data given to a file could be written
+        \returns 0 if not, the error is logged then
+    */
+    int checkFile(exportFileListIter_t f);
+
+    /*! \short   close and reopen a file, e.g. after a write error
+        \throws Error if the file cannot be opened, the old one is kept then
+    */
+    void reopenFile(exportFileListIter_t f);
+
+  public:
+
+    //! close all files still open
+    ~ExportFiles();
+
+    //! get access to the one and only ExportFiles instance
+    static ExportFiles *getInstance();
+
+#ifdef ENABLE_THREADS
+    //! lock to hold while using the files (AUTOLOCK is empty without threads)
+    mutex_t *getLock()
+    {
+        return &access;
+    }
+#endif
+
+    /*! \short   get an export file used by a task (opened at first use)
+
+        compressed files get the suffix of the compression, the file
+        name with suffix is added to the files of the task, a file with
+        a previous write error is reopened
+
+        \arg \c used         files used by the task
+        \arg \c filename     name of the file
+        \arg \c compression  compression of the file
+        \arg \c nthreads     number of threads compressing the file
+        \arg \c uid          owner of a new file
+        \arg \c gid          group of a new file
+        \throws Error if the file cannot be opened
+    */
+    ostream &acquire(set<string> &used, string filename,
+                     compression_t compression = COMPRESS_NONE, int nthreads = 1,
+                     uid_t uid = 0, gid_t gid = 0);
+
+    //! release the files used by a task and close files no task uses anymore
+    void release(set<string> &used);
+
+    /*! \short   write out the buffered data of the files used by a task
+
+        files with write errors are reopened
+        \arg \c used  files used by the task
+    */
+    void flush(set<string> &used);
+};
+
+
+#endif // _EXPORTFILES_H_
@@ -38,8 +38,9 @@ int     ExportModule::s_ch = 0;
 /* ------------------------- ExportModule ------------------------- */
 
 ExportModule::ExportModule( ConfigManager *conf, string libName,
-			    string libFileName, libHandle_t libhandle ) : 
-    Module( libName, libFileName, libhandle ), timersActive(0)
+			    string libFileName, libHandle_t libhandle,
+                            builtinSymbol_t *symbols ) : 
+    Module( libName, libFileName, libhandle, symbols ), timersActive(0)
 {
     int res;
 
@@ -58,6 +59,15 @@ ExportModule::ExportModule( ConfigManager *conf, string libName,
 
     setOwnName(libName);
 
+    builtin = BUILTIN_EXPORT_NONE;
+#ifdef ENABLE_BUILTIN_MODULES
+#define FIND_BUILTIN(m) \
+    if (funcList->exportData == LTX_NAME(m, exportData)) { \
+        builtin = BUILTIN_EXPORT_ ## m; \
+    }
+    BUILTIN_EXPORT_MODULES(FIND_BUILTIN)
+#endif
+
     res = funcList->initModule(conf);
     if (res != 0 ) {
         s_log->elog(s_ch, "initialization of module '%s' failed: %s", 
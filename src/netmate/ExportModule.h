@@ -35,6 +35,23 @@
 #include "EventScheduler.h"
 
 
+#ifdef ENABLE_BUILTIN_MODULES
+// export functions of the modules linked into the meter
+#define DECLARE_EXPORT(m) \
+    int LTX_NAME(m, exportData)( FlowRecord *frec, void *expData );
+BUILTIN_EXPORT_MODULES(DECLARE_EXPORT)
+#define BUILTIN_EXPORT_ID(m)  , BUILTIN_EXPORT_ ## m
+#else
+#define BUILTIN_EXPORT_ID(m)
+#endif
+
+//! modules linked into the meter that the exporter calls directly
+typedef enum {
+    BUILTIN_EXPORT_NONE = 0
+    BUILTIN_EXPORT_MODULES(BUILTIN_EXPORT_ID)
+} builtinExport_t;
+
+
 /*! \short   container class that stores information about an export module
   
     container class - stores information about an export module such as 
@@ -54,6 +71,9 @@ class ExportModule : public Module
     //!< number of active timers
     unsigned int timersActive;
 
+    //! which module linked into the meter this is (BUILTIN_EXPORT_NONE if none)
+    builtinExport_t builtin;
+
   public:
 
     //! return block of function pointers (API) for a module
@@ -62,6 +82,12 @@ class ExportModule : public Module
         return funcList; 
     }
 
+    //! module linked into the meter whose functions can be called directly
+    builtinExport_t getBuiltin()
+    {
+        return builtin;
+    }
+
     //! return a module's version
     virtual int getVersion()     
     { 
@@ -84,9 +110,11 @@ class ExportModule : public Module
         \arg \c libname - name of the export module 
         \arg \c filename - name of module including path and extension
         \arg \c libhandle - system handle for loaded library (see dlopen)
+        \arg \c symbols - symbol table of a module linked into the meter
     */
     ExportModule( ConfigManager *conf, string libName,
-        		  string libFileName, libHandle_t libhandle );
+        		  string libFileName, libHandle_t libhandle,
+                  builtinSymbol_t *symbols = NULL );
 
     //! destroy an ExportModule object
     ~ExportModule();
@@ -291,6 +291,25 @@ int Exporter::delRule( Rule *r )
 }
 
 
+/* -------------------- callExportData -------------------- */
+
+//! export a flow record, modules linked into the meter are called directly
+static inline int callExportData(expAction_t *e, FlowRecord *frec)
+{
+#ifdef ENABLE_BUILTIN_MODULES
+#define CALL_BUILTIN(m) \
+    case BUILTIN_EXPORT_ ## m: \
+        return LTX_NAME(m, exportData)(frec, e->expData);
+    switch (e->module->getBuiltin()) {
+    BUILTIN_EXPORT_MODULES(CALL_BUILTIN)
+    default:
+        break;
+    }
+#endif
+    return e->mapi->exportData(frec, e->expData);
+}
+
+
 /* -------------------- exportFlowRecord -------------------- */
 
 int Exporter::exportFlowRecord( FlowRecord *frec, expnames_t expmods )
@@ -320,7 +339,7 @@ int Exporter::exportFlowRecord( FlowRecord *frec, expnames_t expmods )
             frec->startExport();
 
             // give data block from processing module(s) to exp module
-            iter2->mapi->exportData( frec, iter2->expData );
+            callExportData(&*iter2, frec);
         }
     }
 
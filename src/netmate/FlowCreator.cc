@@ -29,78 +29,205 @@
 #include "FlowCreator.h"
 
 
-FlowCreator::FlowCreator()
+RecordPool::RecordPool(int recSize)
+  : freeList(NULL)
 {
-    flows.resize(START_BUCKETS);
+    size = sizeof(void *);
+    
+    // round up to a power of two below a cache line, to full lines above
+    while ((size < recSize) && (size < CACHE_LINE_SIZE)) {
+        size *= 2;
+    }
+    if (size < recSize) {
+        size = (recSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    }
+}
+
+RecordPool::~RecordPool()
+{
+    for (unsigned int i = 0; i < chunks.size(); i++) {
+        saveDeleteArr(chunks[i]);
+    }
+}
+
+void RecordPool::grow()
+{
+    int num = (RECORD_CHUNK > size) ? RECORD_CHUNK / size : 1;
+    char *chunk = new char[num * size + CACHE_LINE_SIZE];
+    char *rec = chunk + (CACHE_LINE_SIZE - ((unsigned long) chunk % CACHE_LINE_SIZE));
+
+    chunks.push_back(chunk);
+
+    for (int i = 0; i < num; i++) {
+        release(rec);
+        rec += size;
+    }
+}
+
+FlowCreator::FlowCreator(int _shard, int _shards)
+  : slots(NULL), mask(START_BUCKETS - 1), count(0), freeList(NULL),
+    shard(_shard), shards(_shards), lruHead(NULL), lruTail(NULL), exportGen(0)
+{
+    slots = new flowSlot_t[START_BUCKETS];
+    memset(slots, 0, START_BUCKETS * sizeof(flowSlot_t));
     idSource = RuleIdSource(1);
 }
 
 FlowCreator::~FlowCreator()
 {
-    flowListIter_t tmp;
+    while (lruHead != NULL) {
+        deleteFlow(lruHead);
+    }
+
+    for (unsigned int i = 0; i < chunks.size(); i++) {
+        saveDeleteArr(chunks[i]);
+    }
+    saveDeleteArr(slots);
 
-    flowListIter_t i = flows.begin();    
-    while (i != flows.end()) {
-        tmp = i;
-        i++;
-        deleteFlow(tmp);
+    for (unsigned int i = 0; i < pools.size(); i++) {
+        if (pools[i] != NULL) {
+            saveDelete(pools[i]);
+        }
     }
 }
 
-void FlowCreator::deleteFlow(flowListIter_t f)
+void FlowCreator::addPool(int recSize)
 {
-    unsigned char *tmp;
-    
-    idSource.freeId(f->second.flowId);
-    tmp = f->first.keyData;
-    flows.erase(f);
-    saveDeleteArr(tmp);
+    pools.push_back((recSize > 0) ? new RecordPool(recSize) : NULL);
 }
 
-void FlowCreator::deleteFlow(flowInfo_t *fi)
+flowInfo_t *FlowCreator::newEntry()
+{
+    flowInfo_t *fi;
+
+    if (freeList == NULL) {
+        flowInfo_t *chunk = new flowInfo_t[FLOW_CHUNK];
+
+        chunks.push_back(chunk);
+        for (int i = 0; i < FLOW_CHUNK; i++) {
+            chunk[i].next = freeList;
+            freeList = &chunk[i];
+        }
+    }
+
+    fi = freeList;
+    freeList = fi->next;
+
+    return fi;
+}
+
+void FlowCreator::insertSlot(unsigned int hash, flowInfo_t *fi)
 {
-  hkey_t k;
-  unsigned char *tmp;
-
-  idSource.freeId(fi->flowId);
-  tmp = fi->keyData;
-  k.len = fi->len;
-  k.keyData = fi->keyData;
-  flows.erase(k);
-  saveDeleteArr(tmp);
+    unsigned int pos = hash & mask;
+    unsigned int dist = 0;
+
+    while (slots[pos].flow != NULL) {
+        unsigned int d = probeDist(pos, slots[pos].hash);
+
+        // take the slot from a flow closer to its home slot
+        if (d < dist) {
+            flowSlot_t tmp = slots[pos];
+
+            slots[pos].hash = hash;
+            slots[pos].flow = fi;
+            hash = tmp.hash;
+            fi = tmp.flow;
+            dist = d;
+        }
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+
+    slots[pos].hash = hash;
+    slots[pos].flow = fi;
 }
 
-flowInfo_t *FlowCreator::addFlow(const unsigned char *keyData, unsigned short len)
+void FlowCreator::grow()
 {
-    hkey_t k;
-    flowInfo_t entry;
+    flowSlot_t *old = slots;
+    unsigned int size = mask + 1;
 
-    k.keyData = new unsigned char[len];
-    memcpy(k.keyData, keyData, len);
-    entry.keyData = k.keyData;
-    entry.len = len;
-    entry.flowId = idSource.newId();
-    entry.newFlow = 1;
-    k.len = len;
+    slots = new flowSlot_t[size * 2];
+    memset(slots, 0, size * 2 * sizeof(flowSlot_t));
+    mask = size * 2 - 1;
 
-    pair<flowListIter_t, bool> res = flows.insert(make_pair(k, entry));
+    for (unsigned int i = 0; i < size; i++) {
+        if (old[i].flow != NULL) {
+            insertSlot(old[i].hash, old[i].flow);
+        }
+    }
 
-    return &res.first->second;
+    saveDeleteArr(old);
 }
 
-flowInfo_t *FlowCreator::getFlow(const unsigned char *keyData, unsigned short len)
+void FlowCreator::deleteFlow(flowInfo_t *fi)
 {
-    hkey_t k;
-    flowListIter_t f;
+    unsigned int pos = fi->hash & mask;
+    unsigned int next;
+
+    while (slots[pos].flow != fi) {
+        pos = (pos + 1) & mask;
+    }
 
-    k.len = len;
-    k.keyData = (unsigned char *) keyData;
+    // shift the following flows back towards their home slots
+    next = (pos + 1) & mask;
+    while ((slots[next].flow != NULL) && (probeDist(next, slots[next].hash) > 0)) {
+        slots[pos] = slots[next];
+        pos = next;
+        next = (next + 1) & mask;
+    }
+    slots[pos].flow = NULL;
+    count--;
 
-    f = flows.find(k);
+    unlinkFlow(fi);
+    idSource.freeId(fi->flowId / shards);
+    if (fi->keyData != fi->keyBuf) {
+        saveDeleteArr(fi->keyData);
+    }
+    fi->keyData = NULL;
 
-    if (f == flows.end()) {
-        return NULL;
+    // return the flow records to the pools
+    for (unsigned int n = 0; n < fi->actions.size(); n++) {
+        if ((pools[n] != NULL) && (fi->actions[n].flowData != NULL)) {
+            pools[n]->release(fi->actions[n].flowData);
+        }
     }
-    
-    return &f->second;
+    fi->actions.clear();
+
+    fi->next = freeList;
+    freeList = fi;
+}
+
+flowInfo_t *FlowCreator::addFlow(const unsigned char *keyData, unsigned short len,
+                                 unsigned int hash)
+{
+    flowInfo_t *fi;
+
+    // keep the load factor below 3/4
+    if ((count + 1) * 4 > (mask + 1) * 3) {
+        grow();
+    }
+
+    fi = newEntry();
+
+    if (len <= FLOW_KEY_INLINE) {
+        fi->keyData = fi->keyBuf;
+    } else {
+        fi->keyData = new unsigned char[len];
+    }
+    memcpy(fi->keyData, keyData, len);
+    fi->len = len;
+    fi->hash = hash;
+    fi->flowId = idSource.newId() * shards + shard;
+    fi->newFlow = 1;
+    fi->dir = 0;
+    fi->exportGen = exportGen;
+    fi->lastPkt = 0;
+
+    insertSlot(hash, fi);
+    count++;
+
+    appendFlow(fi);
+
+    return fi;
 }
@@ -35,15 +35,30 @@
 #include "ProcModule.h"
 #include "Rule.h"
 #include "RuleIdSource.h"
+#include "Threads.h"
 
+//! initial number of slots of a flow table (power of two)
 const int START_BUCKETS = 16;
 
+//! flow keys up to this length are stored inside the flow entry
+const int FLOW_KEY_INLINE = 40;
+
+//! number of flow entries allocated at once
+const int FLOW_CHUNK = 256;
+
+//! size of the memory blocks flow records are allocated in
+const int RECORD_CHUNK = 64*1024;
+
 // FIXME missing struct documentation
 typedef struct
 {
     ProcModule *module;
     ProcModuleInterface_t *mapi; // module API
     void *flowData;
+    // size of flow records allocated by the meter (0 = allocated by module)
+    int recSize;
+    // module configuration of the rule (shared by all flows)
+    void *config;
     // config params for module
     configParam_t *params;
 } ppaction_t;
@@ -52,94 +67,88 @@ typedef struct
 typedef vector<ppaction_t>            ppactionList_t;
 typedef vector<ppaction_t>::iterator  ppactionListIter_t;
 
-typedef struct {
+typedef struct flowInfo {
     time_t lastPkt;
 
     ppactionList_t actions;
+    // points to keyBuf for short keys
     unsigned char *keyData;
     unsigned short len;
+    // hash of the flow key
+    unsigned int hash;
     // unique flow id
     unsigned long long flowId;
     // designate new flows
     int newFlow;
+    // key direction of the first packet (keys in canonical order only)
+    unsigned char dir;
+    // number of the last export of all flows that included the flow
+    unsigned char exportGen;
+
+    // neighbours in the list of flows ordered by last packet time
+    // (next also links unused entries)
+    struct flowInfo *prev, *next;
+
+    unsigned char keyBuf[FLOW_KEY_INLINE];
 
 } flowInfo_t;
 
+//! slot of the flow table, the hash avoids touching entries of other flows
 typedef struct
 {
-    unsigned short len;
-    // flow key
-    unsigned char *keyData;
-} hkey_t;
+    unsigned int hash;
+    flowInfo_t *flow;
+} flowSlot_t;
 
-struct eqkey
-{
-    inline bool operator()(const hkey_t &s1, const hkey_t &s2) const
-    {
-        if (s1.len == s2.len) {
-            return (memcmp(s1.keyData, s2.keyData, s1.len) == 0);
-        } else {
-            return 0;
-        }
-    }
-};
 
-// hash function craeted by Bob Jenkins (bob_jenkins@burtleburtle.net)
-
-#define mix(a,b,c) \
-{ \
-  a -= b; a -= c; a ^= (c>>13); \
-  b -= c; b -= a; b ^= (a<<8); \
-  c -= a; c -= b; c ^= (b>>13); \
-  a -= b; a -= c; a ^= (c>>12);  \
-  b -= c; b -= a; b ^= (a<<16); \
-  c -= a; c -= b; c ^= (b>>5); \
-  a -= b; a -= c; a ^= (c>>3);  \
-  b -= c; b -= a; b ^= (a<<10); \
-  c -= a; c -= b; c ^= (b>>15); \
-}
-
-struct hfnct
+/*! \short   pool of fixed size flow records of one action module
+
+    records are cut from large blocks and aligned so that small records
+    do not straddle cache lines, freed records are kept for reuse
+*/
+
+class RecordPool
 {
-    inline size_t operator()(const hkey_t &key) const
-    {
-        const unsigned char *k = key.keyData;        /* the key */
-        unsigned long  length = key.len;   /* the length of the key in ub4 */
-        unsigned long  initval = 0;  /* the previous hash, or an arbitrary value */
-        unsigned long a,b,c,len;
-
-        /* Set up the internal state */
-        len = length;
-        a = b = 0x9e3779b9;  /* the golden ratio; an arbitrary value */
-        c = initval;         /* the previous hash value */
-
-        /*---------------------------------------- handle most of the key */
-        while (len >= 3) {
-            a += k[0];
-            b += k[1];
-            c += k[2];
-            mix(a,b,c);
-            k += 3; len -= 3;
-        }
-
-        /*-------------------------------------- handle the last 2 ub4's */
-        c += length;
-        switch(len) {             /* all the case statements fall through */
-            /* c is reserved for the length */
-        case 2 : b+=k[1];
-        case 1 : a+=k[0];
-            /* case 0: nothing left to add */
-        }
-        mix(a,b,c);
-        /*-------------------------------------------- report the result */
-        return c;
-    }
-};
+  private:
+
+    //! size of a record incl. alignment
+    int size;
+
+    //! allocated blocks (as allocated, not aligned)
+    vector<char *> chunks;
+
+    //! unused records, linked through their first bytes
+    void *freeList;
 
+  public:
+
+    RecordPool(int recSize);
+
+    ~RecordPool();
+
+    void *alloc()
+      {
+          void *rec;
 
-//! action list for each rule
-typedef hash_map<const hkey_t, flowInfo_t, hfnct, eqkey> flowList_t;
-typedef hash_map<const hkey_t, flowInfo_t, hfnct, eqkey>::iterator flowListIter_t;
+          if (freeList == NULL) {
+              grow();
+          }
+
+          rec = freeList;
+          freeList = *((void **) rec);
+
+          return rec;
+      }
+
+    void release(void *rec)
+      {
+          *((void **) rec) = freeList;
+          freeList = rec;
+      }
+
+    //! allocate another block of records
+    void grow();
+};
 
 
 /*! \short   manage and apply Action Modules, retrieve flow data
@@ -156,30 +165,253 @@ class FlowCreator
     // pool of unique flow ids
     RuleIdSource idSource;
 
-    flowList_t flows;
+    /*! open addressing table with linear probing, flows are kept in
+        robin hood order (ordered by distance from their home slot) so a
+        lookup stops as soon as it passes the place the key would be at
+    */
+    flowSlot_t *slots;
+
+    //! number of slots - 1 (number of slots is a power of two)
+    unsigned int mask;
+
+    //! number of flows in the table
+    unsigned int count;
+
+    //! flow entries are allocated in chunks and do not move
+    vector<flowInfo_t *> chunks;
+
+    //! unused flow entries
+    flowInfo_t *freeList;
+
+    //! pools for the flow records of the rule's actions (NULL if allocated by module)
+    vector<RecordPool *> pools;
+
+    //! number of this flow table and number of flow tables of the rule
+    int shard, shards;
+
+    //! flows ordered by last packet time, least recently active first
+    flowInfo_t *lruHead, *lruTail;
+
+    //! number of the current (or last) export of all flows
+    unsigned char exportGen;
+
+    //! marks the position of a suspended export in the activity list
+    flowInfo_t cursor;
+
+    //! remove a flow from the activity list
+    void unlinkFlow(flowInfo_t *fi)
+      {
+          if (fi->prev != NULL) {
+              fi->prev->next = fi->next;
+          } else {
+              lruHead = fi->next;
+          }
+          if (fi->next != NULL) {
+              fi->next->prev = fi->prev;
+          } else {
+              lruTail = fi->prev;
+          }
+          fi->prev = fi->next = NULL;
+      }
+
+    //! distance of a slot from the home slot of the flow in it
+    inline unsigned int probeDist(unsigned int pos, unsigned int hash)
+      {
+          return (pos - hash) & mask;
+      }
+
+    //! put a flow into the table (the flow must not be in the table yet)
+    void insertSlot(unsigned int hash, flowInfo_t *fi);
+
+    //! double the number of slots
+    void grow();
+
+    //! get an unused flow entry
+    flowInfo_t *newEntry();
+
+    //! append a flow to the activity list as most recently active
+    void appendFlow(flowInfo_t *fi)
+      {
+          fi->prev = lruTail;
+          fi->next = NULL;
+          if (lruTail != NULL) {
+              lruTail->next = fi;
+          } else {
+              lruHead = fi;
+          }
+          lruTail = fi;
+      }
 
   public:
 
-    FlowCreator();
+    /*! \short   construct a flow table
+
+        A rule may spread its flows over several flow tables (one per
+        packet processor worker), flow ids are unique over all of them.
+
+        \arg \c shard   number of this flow table
+        \arg \c shards  number of flow tables of the rule
+    */
+    FlowCreator(int shard = 0, int shards = 1);
 
     ~FlowCreator();
 
-    flowInfo_t *getFlow(const unsigned char *KeyData, unsigned short len);
+    //! hash a flow key (a word at a time)
+    static inline unsigned int hashKey(const unsigned char *k, unsigned short len)
+      {
+          unsigned long long h = 0x9e3779b97f4a7c15ULL ^ len;
+          unsigned long long w;
+
+          while (len >= sizeof(w)) {
+              memcpy(&w, k, sizeof(w));
+              h = (h ^ w) * 0xff51afd7ed558ccdULL;
+              h ^= h >> 32;
+              k += sizeof(w);
+              len -= sizeof(w);
+          }
+          if (len > 0) {
+              w = 0;
+              memcpy(&w, k, len);
+              h = (h ^ w) * 0xff51afd7ed558ccdULL;
+          }
+
+          h ^= h >> 29;
+          h *= 0xc4ceb9fe1a85ec53ULL;
+          h ^= h >> 32;
+
+          return (unsigned int) h;
+      }
+
+    //! find a flow, the hash must be hashKey(keyData, len)
+    flowInfo_t *getFlow(const unsigned char *keyData, unsigned short len, 
+                        unsigned int hash)
+      {
+          unsigned int pos = hash & mask;
+          unsigned int dist = 0;
+
+          while (slots[pos].flow != NULL) {
+              if ((slots[pos].hash == hash) && (slots[pos].flow->len == len) &&
+                  (memcmp(slots[pos].flow->keyData, keyData, len) == 0)) {
+                  return slots[pos].flow;
+              }
+              // the key would have displaced this flow
+              if (probeDist(pos, slots[pos].hash) < dist) {
+                  break;
+              }
+              pos = (pos + 1) & mask;
+              dist++;
+          }
+
+          return NULL;
+      }
 
-    flowInfo_t *addFlow(const unsigned char *keyData, unsigned short len);
+    flowInfo_t *getFlow(const unsigned char *keyData, unsigned short len)
+      {
+          return getFlow(keyData, len, hashKey(keyData, len));
+      }
 
-    void deleteFlow(flowListIter_t f);
+    /*! \short   add a new flow, the key must not be in the table yet
+        \arg \c hash   must be hashKey(keyData, len)
+    */
+    flowInfo_t *addFlow(const unsigned char *keyData, unsigned short len,
+                        unsigned int hash);
 
+    flowInfo_t *addFlow(const unsigned char *keyData, unsigned short len)
+      {
+          return addFlow(keyData, len, hashKey(keyData, len));
+      }
+
+    //! delete a flow, its pooled flow records must have been destroyed already
     void deleteFlow(flowInfo_t *fi);
 
-    flowList_t *getFlows()
+    /*! \short   add the flow record pool for the next action of the rule
+        \arg \c recSize  size of the module's flow records (0 = no pool)
+    */
+    void addPool(int recSize);
+
+    //! get a flow record for action n (NULL if allocated by module)
+    void *newRecord(int n)
       {
-          return &flows;
+          return (pools[n] != NULL) ? pools[n]->alloc() : NULL;
       }
 
+    //! number of flows in the table
+    unsigned int getNumFlows()
+      {
+          return count;
+      }
+
+    //! set last packet time of a flow, this makes it the most recently active
     void setLastTime(flowInfo_t *fi, time_t time)
       {
           fi->lastPkt = time;
+
+          if (fi != lruTail) {
+              unlinkFlow(fi);
+              appendFlow(fi);
+          }
+      }
+
+    /*! \short   get the least recently active flow
+
+        Following the next pointers from here visits the flows in order of
+        their last packet time, so idle flows can be found without looking
+        at the active ones. While an export is suspended the list also
+        contains its cursor (an entry without actions), so only the export
+        may walk the list then.
+    */
+    flowInfo_t *getOldestFlow()
+      {
+          return lruHead;
+      }
+
+    /*! \short   start an export of all flows, returns the oldest flow
+
+        The export can be suspended to unlock the table and resumed later.
+        Flows that became active while the table was unlocked are visited
+        again, exported() tells whether a flow has been visited already.
+        Flows added during the export are not part of it.
+    */
+    flowInfo_t *startExport()
+      {
+          exportGen++;
+          return lruHead;
+      }
+
+    //! test whether a flow has been visited by the export, marks it visited
+    int exported(flowInfo_t *fi)
+      {
+          if (fi->exportGen == exportGen) {
+              return 1;
+          }
+          fi->exportGen = exportGen;
+          return 0;
+      }
+
+    //! remember that the export continues at flow next (NULL = at the end)
+    void suspendExport(flowInfo_t *next)
+      {
+          if (next == NULL) {
+              appendFlow(&cursor);
+          } else {
+              cursor.prev = next->prev;
+              cursor.next = next;
+              if (next->prev != NULL) {
+                  next->prev->next = &cursor;
+              } else {
+                  lruHead = &cursor;
+              }
+              next->prev = &cursor;
+          }
+      }
+
+    //! continue a suspended export, returns the next flow to visit
+    flowInfo_t *resumeExport()
+      {
+          flowInfo_t *next = cursor.next;
+
+          unlinkFlow(&cursor);
+          return next;
       }
 };
 
@@ -152,4 +152,21 @@ class FlowRecord
 ostream& operator<< ( ostream &os, FlowRecord &obj );
 
 
+/*! \short   receiver of the flow records of an export
+
+    a large flow table is exported as a sequence of flow records that each
+    contain a limited number of flows, the sink gets them one after another
+*/
+
+class FlowRecordSink
+{
+  public:
+
+    virtual ~FlowRecordSink() {}
+
+    //! take the next flow record of an export (the sink owns it afterwards)
+    virtual void putFlowRecord(FlowRecord *frec) = 0;
+};
+
+
 #endif // _FLOWRECORDLIST_H_
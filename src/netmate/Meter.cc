@@ -73,6 +73,55 @@ static inline char *noNewline( char* s )
 }
 
 
+/*! \short   hands the flow records of a rule export to the exporter
+
+    with direct = 1 each record is exported and freed right away, else the
+    records are queued for the exporter and before the next record of the
+    same export is queued the exporter has to catch up, so only a bounded
+    part of a large flow table is copied at any time
+*/
+class ExportSink : public FlowRecordSink
+{
+  private:
+
+    Exporter *expt;
+    expnames_t expmods;
+    int final;
+    int direct;
+    int expThread;
+    int records;
+
+  public:
+
+    ExportSink(Exporter *e, expnames_t em, int fin, int dir, int et)
+      : expt(e), expmods(em), final(fin), direct(dir), expThread(et), records(0) {}
+
+    virtual void putFlowRecord(FlowRecord *frec)
+    {
+        frec->setFinal(final);
+
+        if (direct) {
+            // export flow records directly
+            expt->exportFlowRecord(frec, expmods);
+            saveDelete(frec);
+        } else {
+            if (records > 0) {
+                if (expThread) {
+                    expt->waitUntilDone();
+                } else {
+                    expt->handleFDEvent(NULL, NULL, NULL, NULL);
+                }
+            }
+
+            // schedule this data for export via export module(s) for that rule
+            expt->storeData(frec->getRuleId(), expmods, frec);
+        }
+
+        records++;
+    }
+};
+
+
 /* ------------------------- Meter ------------------------- */
 
 Meter::Meter( int argc, char *argv[])
@@ -299,6 +348,11 @@ Meter::Meter( int argc, char *argv[])
         }
 #endif
 
+        // distribute packets over all packet processor workers
+        for (int i = 1; i < proc->getNumWorkers(); i++) {
+            clss->addQueue(proc->getQueue(i));
+        }
+
         int p1 = 0, p2 = 0, last = 1, first = 1;
         while(((p2 = ni.find(",",p1)) > 0) || last) {
             NetTap *nett;
@@ -325,6 +379,11 @@ Meter::Meter( int argc, char *argv[])
 #else
 		throw Error("No support for ERF");
 #endif
+	      } else if (tt == "mmap") {
+		if (onlineCap) {
+		  throw Error("mmap net tap only supports capture files");
+		}
+		nett = new NetTapMmap(dev);
 	      } else {
 		/* pcap by default */
 #ifdef ENABLE_THREADS
@@ -553,16 +612,12 @@ void Meter::handleEvent(Event *e, fd_sets_t *fds)
           // multiple rules can export at the same time
           for (ruleDBIter_t iter = rules->begin(); iter != rules->end(); iter++) {
 
-	      FlowRecord *rec;
-
-              // retrieve flow data via evaluation module(s) for that rule
-              rec = proc->exportRule((*iter)->getUId(), (*iter)->getRuleName());
+	      ExportSink sink(expt.get(), ((PushExportEvent *)e)->getExpMods(), 
+                              ((PushExportEvent *)e)->isFinal(), 0, expThread);
 
-	      // set final status
-	      rec->setFinal(((PushExportEvent *)e)->isFinal());
-
-              // schedule this data for export via export module(s) for that rule
-              expt->storeData((*iter)->getUId(), ((PushExportEvent *)e)->getExpMods(), rec);   
+              // retrieve flow data via evaluation module(s) for that rule and
+              // schedule it for export via export module(s) for that rule
+              proc->exportRule(&sink, (*iter)->getUId(), (*iter)->getRuleName());
           }
       }
       break;
@@ -589,17 +644,13 @@ void Meter::handleEvent(Event *e, fd_sets_t *fds)
               e->setTime(res);
           } else if (res == 0) {
               // timeout has expired ->collect data
-	      FlowRecord *rec;
+	      // final flow records
+	      ExportSink sink(expt.get(), expnames_t(), 1, 0, expThread);
 	
               // retrieve idle flow data via evaluation module(s) for that rule
-              // and reset flow to idle in packet processor
-              rec = proc->exportRule(rid, rulm->getRule(rid)->getRuleName(), now, timeout);
-              
-	      // final flow record
-	      rec->setFinal(1);
-
-              // export this data to via export module(s) for that rule
-              expt->storeData(rid, "", rec);
+              // and reset flow to idle in packet processor, export this data 
+              // via export module(s) for that rule
+              proc->exportRule(&sink, rid, rulm->getRule(rid)->getRuleName(), now, timeout);
           } // else (still) idle
       }
       
@@ -694,15 +745,11 @@ void Meter::handleEvent(Event *e, fd_sets_t *fds)
           for (ruleDBIter_t iter = rules->begin(); iter != rules->end(); iter++) {
               if ((*iter)->isFlagEnabled(RULE_FINAL_EXPORT)) {
 
-		  FlowRecord *rec;
+		  // export flow records directly
+		  ExportSink sink(expt.get(), expnames_t(), 0, 1, expThread);
 
                   // retrieve flow data via evaluation module(s) for that rule
-                  rec = proc->exportRule((*iter)->getUId(), (*iter)->getRuleName());
-
-                  // export flow records directly
-                  expt->exportFlowRecord(rec, "");
-
-                  saveDelete(rec);
+                  proc->exportRule(&sink, (*iter)->getUId(), (*iter)->getRuleName());
               }
           }
 	  
@@ -729,16 +776,12 @@ void Meter::handleEvent(Event *e, fd_sets_t *fds)
 	  
                   // export final result data
                   if (rptr->isFlagEnabled(RULE_FINAL_EXPORT)) {
-		      FlowRecord *rec;
+                      // export the flow records directly
+		      ExportSink sink(expt.get(), expnames_t(), 0, 1, expThread);
 
                       // retrieve flow data via evaluation module(s)
                       // for that rule
-                      rec = proc->exportRule(rptr->getUId(),rptr->getRuleName());
-		      
-                      // export the flow record directly
-                      expt->exportFlowRecord(rec, "");
-
-                      saveDelete(rec);
+                      proc->exportRule(&sink, rptr->getUId(), rptr->getRuleName());
                   }
 
                   clss->delRule(rptr);
@@ -758,15 +801,11 @@ void Meter::handleEvent(Event *e, fd_sets_t *fds)
 
                       // export final result data
                       if (rptr->isFlagEnabled(RULE_FINAL_EXPORT)) {
-			  FlowRecord *rec;
-
-                          // retrieve flow data via evaluation module(s) for that rule
-                          rec = proc->exportRule(rptr->getUId(),rptr->getRuleName());
-			  
                           // export this data via export module(s) for that rule
-                          expt->exportFlowRecord(rec, "");
+			  ExportSink sink(expt.get(), expnames_t(), 0, 1, expThread);
 
-                          saveDelete(rec);
+                          // retrieve flow data via evaluation module(s) for that rule
+                          proc->exportRule(&sink, rptr->getUId(), rptr->getRuleName());
                       }
 			
                       clss->delRule(rptr);
@@ -948,6 +987,8 @@ void Meter::run()
 #else
                               throw Error("No support for ERF");
 #endif
+                            } else if (tt == "mmap") {
+                              nett = new NetTapMmap(dev);
                             } else {
                               /* pcap by default */
 #ifdef ENABLE_THREADS
@@ -1028,18 +1069,11 @@ void Meter::run()
         for (ruleDBIter_t iter = rules.begin(); iter != rules.end(); iter++) {
 	     if ((*iter)->getIntervals()->empty()) {
 
-                  FlowRecord *rec;
+                  // final flow records, exported directly
+                  ExportSink sink(expt.get(), expnames_t(), 1, 1, expThread);
 
                   // retrieve flow data via evaluation module(s) for that rule
-                  rec = proc->exportRule((*iter)->getUId(), (*iter)->getRuleName());
-
-		  // final flow record
-		  rec->setFinal(1);
-
-                  // export flow records directly
-                  expt->exportFlowRecord(rec, "");
-
-                  saveDelete(rec);
+                  proc->exportRule(&sink, (*iter)->getUId(), (*iter)->getRuleName());
               }
         }
 
@@ -52,6 +52,7 @@
 #endif
 #else
 #include "NetTapPcap.h"
+#include "NetTapMmap.h"
 #ifdef HAVE_ERF
 #include "NetTapERF.h"
 #endif
@@ -39,13 +39,22 @@ int     MetricData::s_ch = 0;
 
 enum ListTypes_e { VARIABLE = 0, FIXED1 = 1 };
 
+//! size of the first chunk of flow data
+const unsigned long MIN_CHUNK = 4096;
+//! chunks double in size up to this size
+const unsigned long MAX_CHUNK = 1024*1024;
+
+//! round up to 8 byte boundary
+#define ROW_ALIGN(x) (((x) + 7) & ~((unsigned long) 7))
+
 
 /* ------------------------- MetricData ------------------------- */
 
 MetricData::MetricData(string mn, ExportList *e, flowKeyInfo_t *fkl, int size, 
                        const unsigned char *mdata, unsigned short ksize,
                        const unsigned char *kdata, int newFlow, unsigned long long flowId)
-    : mname(mn), exportLists(e), flowKeyList(fkl), flowCount(0), keyCount(0)
+    : mname(mn), exportLists(e), flowKeyList(fkl), flowCount(0), first(NULL), last(NULL),
+      keyCount(0), chunkPos(NULL), chunkFree(0), chunkSize(MIN_CHUNK)
 {
     
     s_log = Logger::getInstance();
@@ -80,15 +89,41 @@ MetricData::~MetricData()
     s_log->dlog(s_ch, "Destroyed");
 #endif
 
-    for (bufListIter_t i = dataBufs.begin(); i != dataBufs.end(); ++i) {
-        saveDeleteArr(i->buf);
+    for (chunkListIter_t i = chunks.begin(); i != chunks.end(); ++i) {
+        saveDeleteArr(*i);
     }
+}
+
+
+char *MetricData::allocRow(unsigned long len)
+{
+    char *row;
+
+    if (len > chunkFree) {
+        unsigned long csize = chunkSize;
 
-     for (bufListIter_t i = keyBufs.begin(); i != keyBufs.end(); ++i) {
-         if (i->buf != NULL) {
-             saveDeleteArr(i->buf);
-         }
+        // large rows get a chunk of their own
+        if (csize < len) {
+            csize = len;
+        }
+
+        chunkPos = new char[csize];
+        if (chunkPos == NULL) {
+            throw Error("could not allocate metric data of size %lu", csize);
+        }
+        chunks.push_back(chunkPos);
+        chunkFree = csize;
+
+        if (chunkSize < MAX_CHUNK) {
+            chunkSize *= 2;
+        }
     }
+
+    row = chunkPos;
+    chunkPos += len;
+    chunkFree -= len;
+
+    return row;
 }
 
 
@@ -96,50 +131,44 @@ void MetricData::addFlowData(int size, const unsigned char *mdata,
                              unsigned short ksize, const unsigned char *kdata, 
                              int newFlow, unsigned long long flowId)
 {
-    buf_t new_buf;
-
     if (size > 0) {
-        new_buf.buf  = new char[size];
-
-        if (new_buf.buf != NULL) {
-            // copy metric data (necessary if the data is not exported immediately!
-            memcpy(new_buf.buf, mdata, size);
-            new_buf.flowId = flowId;
-            new_buf.newFlow = newFlow;
-            new_buf.len = size;
-            new_buf.ptr = new_buf.buf;
-	    new_buf.swap = 0;
-            dataBufs.push_back(new_buf);
-        } else {
-            throw Error("could not allocate metric data of size %d", size);
-        }
-
-        flowCount++;
+        // header, flow data and key, the data is aligned like memory from new
+        unsigned long hlen = ROW_ALIGN(sizeof(flowRow_t));
+        unsigned long dlen = ROW_ALIGN((unsigned long) size);
+        char *mem = allocRow(hlen + dlen + ROW_ALIGN((unsigned long) ksize));
+        flowRow_t *row = (flowRow_t *) mem;
+
+        row->next = NULL;
+        row->flowId = flowId;
+        row->newFlow = newFlow;
+        row->swap = 0;
+
+        // copy metric data (necessary if the data is not exported immediately!
+        row->buf = mem + hlen;
+        memcpy(row->buf, mdata, size);
+        row->len = size;
+        row->ptr = row->buf;
 
         if (ksize > 0) {
-            new_buf.buf = new char[ksize];
-
-            if (new_buf.buf != NULL) {
-                // copy metric data (necessary if the data is not exported immediately!
-                memcpy(new_buf.buf, kdata, ksize);
-                //new_buf.flowId = flowId;
-                //new_buf.newFlow = newFlow;
-                new_buf.len = ksize;
-                new_buf.ptr = new_buf.buf;
-		new_buf.swap = 0;
-            } else {
-                throw Error("could not allocate flow key data of size %d", ksize);
+            row->kbuf = row->buf + dlen;
+            if (kdata != NULL) {
+                memcpy(row->kbuf, kdata, ksize);
             }
+            row->klen = ksize;
         } else {
-            new_buf.buf = NULL;
-            //new_buf.flowId = 0;
-            //new_buf.newFlow = 1;
-            new_buf.len = 0;
-            new_buf.ptr = NULL;
-	    new_buf.swap = 0;
+            row->kbuf = NULL;
+            row->klen = 0;
         }
+        row->kptr = row->kbuf;
 
-        keyBufs.push_back(new_buf);
+        if (last != NULL) {
+            last->next = row;
+        } else {
+            first = row;
+        }
+        last = row;
+
+        flowCount++;
     }
 }
 
@@ -149,14 +178,12 @@ void MetricData::initExport()
 {
     currList = -1;
     currFlow = -1;
+    curr = NULL;
  
     // reset pointers
-    for (bufListIter_t i = dataBufs.begin(); i != dataBufs.end(); ++i) {
-        i->ptr = i->buf;
-    }
-
-     for (bufListIter_t i = keyBufs.begin(); i != keyBufs.end(); ++i) {
-        i->ptr = i->buf;
+    for (flowRow_t *r = first; r != NULL; r = r->next) {
+        r->ptr = r->buf;
+        r->kptr = r->kbuf;
     }
  
     fkPtr = flowKeyList;
@@ -194,6 +221,7 @@ int MetricData::getNextList()
   
     currList++;
     currFlow = -1;
+    curr = NULL;
 
     if (currList == (int) exportLists->size()) {
         return -1;
@@ -207,8 +235,8 @@ int MetricData::getNextList()
               char *tmp;
               int r = 0;
       
-              for (int i=0; i < flowCount; i++) {
-                  tmp = align(dataBufs[i].ptr, BINARY);
+              for (flowRow_t *row = first; row != NULL; row = row->next) {
+                  tmp = align(row->ptr, BINARY);
                   r += *((int *)tmp);
               }
 
@@ -229,9 +257,11 @@ int MetricData::getNextFlow(unsigned long long *flowId, int *newFlow)
     if (currFlow == flowCount) {
         return -1;
     }
+
+    curr = (curr == NULL) ? first : curr->next;
    
-    *flowId = dataBufs[currFlow].flowId;
-    *newFlow = dataBufs[currFlow].newFlow;
+    *flowId = curr->flowId;
+    *newFlow = curr->newFlow;
 
     switch (exportLists->getList(currList)->nrows) {
     case FIXED1:
@@ -242,11 +272,11 @@ int MetricData::getNextFlow(unsigned long long *flowId, int *newFlow)
           char *tmp;
           int r = 0;
 
-          tmp = align(dataBufs[currFlow].ptr, BINARY);
+          tmp = align(curr->ptr, BINARY);
           r = *((int *)tmp);
           
           // varlists start with header of 2ints
-          dataBufs[currFlow].ptr += 2 * sizeof(int); 
+          curr->ptr += 2 * sizeof(int); 
 
           return r;
       }
@@ -268,22 +298,22 @@ const char *MetricData::getNextFlowKey(DataType_e *type)
 
     if (fkPtr->type == EXPORTEND) {
         fkPtr = flowKeyList;
-        keyBufs[currFlow].ptr = keyBufs[currFlow].buf;
-	keyBufs[currFlow].swap = 1;
+        curr->kptr = curr->kbuf;
+	curr->swap = 1;
         return NULL;
     }
 
     *type = fkPtr->type;
 
-    tmp = keyBufs[currFlow].ptr;
+    tmp = curr->kptr;
 
     if (*type == STRING) {
-      keyBufs[currFlow].ptr += strlen(tmp) + 1;
+      curr->kptr += strlen(tmp) + 1;
     } else if (*type == BINARY) {
       unsigned int len = *((unsigned int *)tmp);
-      keyBufs[currFlow].ptr = (char *) tmp + DataTypeSize[UINT32] + len;
+      curr->kptr = (char *) tmp + DataTypeSize[UINT32] + len;
     } else {
-      if (!keyBufs[currFlow].swap) {
+      if (!curr->swap) {
 	if ((*type == UINT16) || (*type == INT16)) {
 	  // still in network byteorder so swap
 	  *((uint16_t *) tmp) = ntohs(*((uint16_t *) tmp));
@@ -294,7 +324,7 @@ const char *MetricData::getNextFlowKey(DataType_e *type)
 	}
       }
       
-      keyBufs[currFlow].ptr += DataTypeSize[fkPtr->type];
+      curr->kptr += DataTypeSize[fkPtr->type];
     }
     
     fkPtr++;
@@ -376,8 +406,8 @@ const char *MetricData::getNextData( DataType_e type )
     case INT8:
     case UINT8:	
         // not necessary to align on a byte ;)
-        tmp = dataBufs[currFlow].ptr;
-        dataBufs[currFlow].ptr += DataTypeSize[type];
+        tmp = curr->ptr;
+        curr->ptr += DataTypeSize[type];
         break;
     case INT16:
     case UINT16:
@@ -386,29 +416,29 @@ const char *MetricData::getNextData( DataType_e type )
     case IPV4ADDR:
     case FLOAT:
     case DOUBLE:
-        tmp = align(dataBufs[currFlow].ptr, type);
-        dataBufs[currFlow].ptr = (char *) tmp + DataTypeSize[type];
+        tmp = align(curr->ptr, type);
+        curr->ptr = (char *) tmp + DataTypeSize[type];
         break;
     case IPV6ADDR:
         // align on 32 bit
-        tmp = align(dataBufs[currFlow].ptr, INT32);
-        dataBufs[currFlow].ptr = (char *) tmp + DataTypeSize[type];
+        tmp = align(curr->ptr, INT32);
+        curr->ptr = (char *) tmp + DataTypeSize[type];
         break;
     case INT64:
     case UINT64:
         // 64bit values only aligned to 32bit
-        tmp = align(dataBufs[currFlow].ptr, INT32); 
-        dataBufs[currFlow].ptr = (char *) tmp + DataTypeSize[type];
+        tmp = align(curr->ptr, INT32); 
+        curr->ptr = (char *) tmp + DataTypeSize[type];
         break;
     case STRING:
-        tmp = dataBufs[currFlow].ptr;
-        dataBufs[currFlow].ptr += strlen((char *)dataBufs[currFlow].ptr) + 1;
+        tmp = curr->ptr;
+        curr->ptr += strlen((char *)curr->ptr) + 1;
         break;
     case BINARY:
       {
-          tmp = align(dataBufs[currFlow].ptr, UINT32);
+          tmp = align(curr->ptr, UINT32);
           unsigned int len = *((unsigned int *)tmp);
-          dataBufs[currFlow].ptr = (char *) tmp + DataTypeSize[UINT32] + len;
+          curr->ptr = (char *) tmp + DataTypeSize[UINT32] + len;
       }
       break;
     case INVALID1: 
@@ -52,20 +52,30 @@ extern unsigned short DataTypeSize[];
     data itself.
 */
 
-typedef struct
+/*! header of the data of one flow
+
+    The headers, flow data and flow keys of all flows are stored one after 
+    another in large chunks of memory (the flow data directly behind the 
+    header, the key behind the data), so adding a flow costs no allocation
+    in most cases and the whole object is freed by freeing a few chunks.
+*/
+typedef struct flowRow
 {
+    //! next flow in the order of adding
+    struct flowRow *next;
     unsigned long long flowId;
     int newFlow;
-    char *buf;
-    unsigned long len;
-    // pointer into buffer
-    char *ptr;
-    // indicate swapped to host byte order (only for keybufs)
+    // indicate key swapped to host byte order
     int swap;
-} buf_t;
+    // flow data and flow key
+    char *buf, *kbuf;
+    unsigned long len, klen;
+    // pointers into buffers
+    char *ptr, *kptr;
+} flowRow_t;
 
-typedef vector<buf_t> bufList_t;
-typedef vector<buf_t>::iterator bufListIter_t;
+typedef vector<char *> chunkList_t;
+typedef vector<char *>::iterator chunkListIter_t;
 
 class MetricData
 {
@@ -89,17 +99,33 @@ class MetricData
     // number of flows this object contains data for
     int flowCount;
 
-    // pointer to current flow
+    // index of current flow
     int currFlow;
 
+    // current flow
+    flowRow_t *curr;
+
+    // first and last flow
+    flowRow_t *first, *last;
+
     //! number of flow keys
     unsigned short keyCount;
 
     //! pointer to the current export list
     int currList;
 
-    // flow key and flow data buffer list
-    bufList_t keyBufs, dataBufs;
+    // memory chunks holding the flows
+    chunkList_t chunks;
+
+    // free space in the current chunk
+    char *chunkPos;
+    unsigned long chunkFree;
+
+    // size of the next chunk (grows up to MAX_CHUNK)
+    unsigned long chunkSize;
+
+    // get len bytes (8 byte aligned) from the current or a new chunk
+    char *allocRow(unsigned long len);
 
     // align a pointer to a specific data type
     inline char *align(char *var, DataType_e type)
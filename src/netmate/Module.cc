@@ -34,7 +34,8 @@
 
 /* ------------------------- Module ------------------------- */
 
-Module::Module( string name, string libfile, libHandle_t libhandle )
+Module::Module( string name, string libfile, libHandle_t libhandle,
+                builtinSymbol_t *syms )
 {
     log = Logger::getInstance();
     ch = log->createChannel("Module");
@@ -45,6 +46,7 @@ Module::Module( string name, string libfile, libHandle_t libhandle )
     modName = name;
     fileName = libfile;
     libHandle = libhandle;
+    symbols = syms;
     ownName = "";
     refs = 0;
     calls = 0;
@@ -55,7 +57,9 @@ Module::Module( string name, string libfile, libHandle_t libhandle )
 
 Module::~Module()
 {
-    dlclose(libHandle);
+    if (libHandle != NULL) {
+        dlclose(libHandle);
+    }
     
 #ifdef DEBUG
     log->dlog(ch, "Destroyed");
@@ -69,22 +73,40 @@ void *Module::loadAPI( string apiName )
 {
     void *funcList;
 
-    funcList = dlsym(libHandle, apiName.c_str());
+    funcList = getSymbol(apiName);
     if (funcList == NULL) {
         throw Error("cannot find API called '%s' in lib %s, error: %s",
-                    apiName.c_str(), fileName.c_str(), dlerror());
+                    apiName.c_str(), fileName.c_str(), 
+                    (symbols != NULL) ? "no such symbol" : dlerror());
     } else {
         return funcList;
     }
 }
 
 
+/* ------------------------- getSymbol ------------------------- */
+
+void *Module::getSymbol( string name )
+{
+    if (symbols != NULL) {
+        for (builtinSymbol_t *s = symbols; s->name != NULL; s++) {
+            if (name == s->name) {
+                return s->addr;
+            }
+        }
+        return NULL;
+    }
+
+    return dlsym(libHandle, name.c_str());
+}
+
+
 /* ------------------------- checkMagic ------------------------- */
 
 void Module::checkMagic( int magicNumber )
 {
     // test for magic number in loaded module
-    int *magic = (int *)dlsym(libHandle, "magic");
+    int *magic = (int *)getSymbol("magic");
 
     if (magic == NULL) {
         throw Error("invalid module - no magic number present");
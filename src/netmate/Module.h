@@ -33,6 +33,7 @@
 
 #include "stdincpp.h"
 #include "Logger.h"
+#include "BuiltinModule.h"
 
 
 //! FIXME missing documentation
@@ -53,6 +54,7 @@ class Module
     int ch;
 
     libHandle_t libHandle;      //!< library handle from dlopen call
+    builtinSymbol_t *symbols;   //!< symbol table of a module linked into the meter
     string modName;             //!< short name of module (must be unique!)
     string fileName;            //!< file name of module (including path)
     string ownName;             //!< module name supplied by module itself
@@ -122,8 +124,11 @@ class Module
         \arg \c libname   - name of the evaluation module 
         \arg \c filename  - name of module including path and extension
         \arg \c libhandle - system handle for loaded library (see dlopen)
+        \arg \c symbols   - symbol table if the module is linked into the meter
+                            (libhandle is NULL then)
     */
-    Module( string libname, string filename, libHandle_t libhandle );
+    Module( string libname, string filename, libHandle_t libhandle,
+            builtinSymbol_t *symbols = NULL );
     
 
     //! destroy a Module object, to be overloaded
@@ -136,6 +141,11 @@ class Module
     */
     void *loadAPI( string apiName );
 
+    /*! \short  get the address of a symbol of the module
+        \returns NULL if the module has no such symbol
+    */
+    void *getSymbol( string name );
+
     /*! \short  check magic number in module
         tries to read magic number from module lib file and check for correctness
         \throws Error in case magic number is not present or is wrong
@@ -42,6 +42,25 @@ Logger *ModuleLoader::s_log = NULL;
 int     ModuleLoader::s_loaders = 0;
 
 
+#ifdef ENABLE_BUILTIN_MODULES
+#define DECLARE_SYMBOLS(m)  extern builtinSymbol_t BUILTIN_SYMBOLS(m)[];
+extern "C" {
+    BUILTIN_PROC_MODULES(DECLARE_SYMBOLS)
+    BUILTIN_EXPORT_MODULES(DECLARE_SYMBOLS)
+}
+#define MODULE_ENTRY(m)  { #m, BUILTIN_SYMBOLS(m) },
+#endif
+
+//! modules linked into the meter, used instead of module files
+static builtinModule_t builtinModules[] = {
+#ifdef ENABLE_BUILTIN_MODULES
+    BUILTIN_PROC_MODULES(MODULE_ENTRY)
+    BUILTIN_EXPORT_MODULES(MODULE_ENTRY)
+#endif
+    { NULL, NULL }
+};
+
+
 /* ------------------------- ModuleLoader ------------------------- */
 
 ModuleLoader::ModuleLoader( ConfigManager *cnf, string basedir,
@@ -200,6 +219,7 @@ Module *ModuleLoader::loadModule( string libname, int preload )
     Module *module = NULL;
     string filename, path, ext;
     libHandle_t libhandle = NULL;
+    builtinSymbol_t *symbols = NULL;
     
     if (libname.empty()) {
         return NULL;
@@ -209,41 +229,48 @@ Module *ModuleLoader::loadModule( string libname, int preload )
 #ifdef DEBUG
         s_log->log(ch, "trying to load module '%s'", libname.c_str());
 #endif
-        // if libname has relative path (or none) then use basepath
-        if (libname[0] != '/') {
-            path = basepath;
-        }
+        // modules linked into the meter need no library
+        symbols = getBuiltin(libname);
+
+        if (symbols != NULL) {
+            filename = "built-in";
+        } else {
+            // if libname has relative path (or none) then use basepath
+            if (libname[0] != '/') {
+                path = basepath;
+            }
 
-        // use '.so' as postfix if it is not yet there
-        if (libname.substr(libname.size()-3,3) != ".so") {
-            ext = ".so";
-        }
+            // use '.so' as postfix if it is not yet there
+            if (libname.substr(libname.size()-3,3) != ".so") {
+                ext = ".so";
+            }
 	
-        // construct filename of module including path and extension
-        filename = path + libname + ext;
+            // construct filename of module including path and extension
+            filename = path + libname + ext;
 	
-        // try to load the library module
-        libhandle = dlopen(filename.c_str(), RTLD_LAZY);
-        if (libhandle == NULL) {
-            // try to load without .so extension (cater for libtool bug)
-            filename = path + libname;
+            // try to load the library module
             libhandle = dlopen(filename.c_str(), RTLD_LAZY);
             if (libhandle == NULL) {
-                throw Error("cannot load module '%s': %s", 
-                            libname.c_str(), (char *) dlerror());
+                // try to load without .so extension (cater for libtool bug)
+                filename = path + libname;
+                libhandle = dlopen(filename.c_str(), RTLD_LAZY);
+                if (libhandle == NULL) {
+                    throw Error("cannot load module '%s': %s", 
+                                libname.c_str(), (char *) dlerror());
+                }
             }
         }
         
         // dlopen succeeded, now check what module we have there 
         // everything went fine up to now -> create new module info entry
         {
-            int magic = fetchMagic(libhandle);
+            int magic = (symbols != NULL) ? fetchMagic(symbols) : fetchMagic(libhandle);
             
             if (magic == PROC_MAGIC) {
-                module = new ProcModule(libname, filename, libhandle);
+                module = new ProcModule(libname, filename, libhandle, symbols);
             } else if (magic == EXPORT_MAGIC) {
                 module = new ExportModule(conf, libname, filename, 
-                                          libhandle);
+                                          libhandle, symbols);
             } else {
                 throw Error("unsupported module type (unknown magic number)");
             }
@@ -252,7 +279,8 @@ Module *ModuleLoader::loadModule( string libname, int preload )
         module->link();             // increase sue counter in this module
         modules[libname] = module;  // and finally store the module
         
-        s_log->log(ch, "loaded %s module '%s'",
+        s_log->log(ch, "loaded %s%s module '%s'",
+		   (symbols != NULL) ? "built-in " : "",
 		   module->getModuleType().c_str(), libname.c_str());
         
         return module;
@@ -347,6 +375,32 @@ int ModuleLoader::fetchMagic( libHandle_t libHandle )
 }
 
 
+int ModuleLoader::fetchMagic( builtinSymbol_t *symbols )
+{
+    for (builtinSymbol_t *s = symbols; s->name != NULL; s++) {
+        if (!strcmp(s->name, "magic")) {
+            return *((int *) s->addr);
+        }
+    }
+
+    throw Error("invalid module - no magic number present");
+}
+
+
+/* ------------------------- getBuiltin ------------------------- */
+
+builtinSymbol_t *ModuleLoader::getBuiltin( string modname )
+{
+    for (builtinModule_t *m = builtinModules; m->name != NULL; m++) {
+        if (modname == m->name) {
+            return m->symbols;
+        }
+    }
+
+    return NULL;
+}
+
+
 /* ------------------------- operator<< ------------------------- */
 
 ostream& operator<< ( ostream &os, ModuleLoader &ml )
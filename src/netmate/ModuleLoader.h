@@ -171,6 +171,14 @@ class ModuleLoader
      */
     int fetchMagic( libHandle_t libHandle );
 
+    //! fetch magic number from the symbol table of a built-in module
+    int fetchMagic( builtinSymbol_t *symbols );
+
+    /*! \short   get the symbol table of a module linked into the meter
+        \returns NULL if there is no such built-in module
+    */
+    static builtinSymbol_t *getBuiltin( string modname );
+
     //! FIXME missing documentation
     string getInfo();
 
@@ -29,6 +29,27 @@
 #include "NetTap.h"
 
 
+int NetTap::getPackets(PacketSink *sink, int max)
+{
+    int cnt = 0;
+    unsigned long len = 0;
+    char *buf;
+
+    while ((cnt < max) && ((buf = sink->nextBuffer(&len)) != NULL)) {
+        metaData_t *pkt = getPacket(buf, len);
+        
+        if (pkt == NULL) {
+            break;
+        }
+
+        sink->putPacket(pkt);
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
 NetTapStats *NetTap::getStats()
 {
     return stats.get();
@@ -61,6 +61,34 @@ class NetTapStats {
 //! overload for <<, so that a NetTap stats object can be thrown into an ostream
 ostream& operator<< ( ostream &os, NetTapStats &nst );
 
+
+/*! \short   receiver of packets delivered by NetTap::getPackets
+
+    getPackets asks the sink for a buffer before each packet and hands
+    every filled buffer back, so the sink can classify the packet and
+    decide whether to keep it where it is
+*/
+
+class PacketSink
+{
+  public:
+
+    virtual ~PacketSink() {}
+
+    /*! \short  get buffer for the next packet
+        \arg \c len - location to store the size of the buffer
+        \returns buffer or NULL if no space is left
+    */
+    virtual char *nextBuffer(unsigned long *len) = 0;
+
+    /*! \short  the packet has been written into the last buffer returned by nextBuffer
+        the payload may point into the tap's own buffer, unless the tap
+        keeps its data (see NetTap::keepsPayload) it is only valid until
+        putPacket returns
+    */
+    virtual void putPacket(metaData_t *pkt) = 0;
+};
+
        
 /*! \short   capture packets from lower layer (network, file, ...)
   
@@ -97,10 +125,25 @@ class NetTap
     /*! \short get packet from network tap
         This function return the next packet in the queue to the caller. It
         blocks if there is no packet in the queue. The return value can be
-        used for error signalization.
+        used for error signalization. The payload of the packet may point
+        into the tap's own buffer, it is valid until the next read only.
     */
     virtual metaData_t *getPacket(char *buf, unsigned long len) = 0;
 
+    /*! \short get up to max packets from network tap in one go
+        The packets are written into the buffers provided by the sink.
+        The default implementation calls getPacket repeatedly, taps that
+        can read several packets at once should overload this.
+        \returns number of packets read, 0 if there was no packet
+    */
+    virtual int getPackets(PacketSink *sink, int max);
+
+    //! indicate whether the payload of packets stays valid after the read
+    virtual int keepsPayload()
+    {
+        return 0;
+    }
+
     /*! \short   read statistical information from the network tap
         \returns a struct containing numerous statistical values
      */
@@ -211,6 +211,7 @@ void NetTapERF::procPacket(char *buf, unsigned long len, const struct pcap_pkthd
         throw Error("buffer too small for captured packet");
     }
 
+    pkt->payload = pkt->data;
     memcpy(pkt->payload, pktdata, pkt->cap_len);
     pkt->offs[L_LINK] = 0;
     pkt->offs[L_NET] = -1;
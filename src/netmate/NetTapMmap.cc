@@ -0,0 +1,318 @@
+
+/*!\file   NetTapMmap.cc
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    nettap reading pcap capture files via mmap
+
+    $Id$
+*/
+
+#include "NetTapMmap.h"
+#include "metadata.h"
+#include "Timeval.h"
+
+
+// pcap file format
+const unsigned int PCAP_MAGIC      = 0xa1b2c3d4;
+const unsigned int PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const int PCAP_FILE_HLEN = 24;
+const int PCAP_REC_HLEN  = 16;
+
+//! release mapped pages already read in chunks of this size
+const size_t RELEASE_CHUNK = 64*1024*1024;
+
+//! optimize filter code
+const int OFLAG = 1;
+
+//! netmask for filter code
+const unsigned long NETMASK = 0x0;
+
+
+/*!\short   construct and initialize a NetTapMmap object
+ */
+NetTapMmap::NetTapMmap(string df)
+    : devfile(df), base(NULL), size(0), pos(0), released(0), swapped(0), nsec(0),
+      filtered(0)
+{
+    struct stat st;
+    int fd;
+
+    if (devfile.empty()) {
+        throw Error("empty file name");
+    }
+
+    if ((fd = open(devfile.c_str(), O_RDONLY)) < 0) {
+        throw Error("cannot open capture file %s: %s", devfile.c_str(), strerror(errno));
+    }
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw Error("cannot stat capture file %s: %s", devfile.c_str(), strerror(errno));
+    }
+
+    size = st.st_size;
+    if (size < (size_t) PCAP_FILE_HLEN) {
+        close(fd);
+        throw Error("capture file %s too short", devfile.c_str());
+    }
+
+    base = (unsigned char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after close
+    close(fd);
+
+    if (base == (unsigned char *) MAP_FAILED) {
+        base = NULL;
+        throw Error("cannot map capture file %s: %s", devfile.c_str(), strerror(errno));
+    }
+
+    // the file is read once from start to end
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    // parse file header
+    unsigned int magic = get32(base);
+    if ((magic != PCAP_MAGIC) && (magic != PCAP_MAGIC_NSEC)) {
+        swapped = 1;
+        magic = get32(base);
+    }
+
+    if (magic == PCAP_MAGIC_NSEC) {
+        nsec = 1;
+    } else if (magic != PCAP_MAGIC) {
+        munmap(base, size);
+        base = NULL;
+        throw Error("%s is not a pcap capture file", devfile.c_str());
+    }
+
+    s_linkType = get32(base + 20);
+    pos = PCAP_FILE_HLEN;
+
+    // get the initial time stamp (the timestamp of the first packet)
+    if (pos + PCAP_REC_HLEN <= size) {
+        struct timeval tv;
+
+        tv.tv_sec = get32(base + pos);
+        tv.tv_usec = get32(base + pos + 4);
+        if (nsec) {
+            tv.tv_usec /= 1000;
+        }
+        Timeval::settimeofday(&tv);
+    }
+
+    // 2 lines -> support old g++
+    auto_ptr<NetTapStats> _stats(new NetTapStats());
+    stats = _stats;
+
+    cout << "Reading (mmap) from: " << devfile << endl;
+}
+
+
+/*!\short   destroy a NetTapMmap object
+ */
+NetTapMmap::~NetTapMmap()
+{
+    if (filtered) {
+        pcap_freecode(&bpfprog);
+    }
+
+    if (base != NULL) {
+        munmap(base, size);
+    }
+}
+
+
+metaData_t *NetTapMmap::nextRecord(char *buf, unsigned long len)
+{
+    struct timeval tv;
+
+    // the current packet
+    metaData_t *pkt = (metaData_t *) buf;
+    const unsigned char *rec;
+    unsigned int caplen;
+
+    do {
+        if (pos + PCAP_REC_HLEN > size) {
+            return NULL;
+        }
+
+        rec = base + pos;
+        caplen = get32(rec + 8);
+
+        if (pos + PCAP_REC_HLEN + caplen > size) {
+            // truncated file
+            pos = size;
+            return NULL;
+        }
+
+        // the packet may be copied behind the meta data later
+        if (len < (sizeof(metaData_t) + caplen)) {
+            throw Error("buffer too small for captured packet");
+        }
+
+        pos += PCAP_REC_HLEN + caplen;
+
+        // drop pages we have read already from the mapping
+        if (pos - released > RELEASE_CHUNK) {
+            size_t end = (pos & ~((size_t) getpagesize() - 1)) - RELEASE_CHUNK;
+
+            if (end > released) {
+                madvise(base + released, end - released, MADV_DONTNEED);
+                released = end;
+            }
+        }
+
+    } while (filtered && !bpf_filter(bpfprog.bf_insns, (u_char *) rec + PCAP_REC_HLEN,
+                                     get32(rec + 12), caplen));
+
+    tv.tv_sec = get32(rec);
+    tv.tv_usec = get32(rec + 4);
+    if (nsec) {
+        tv.tv_usec /= 1000;
+    }
+
+    // update the global last packet timestamp
+#ifdef NO_REORDERING
+    if (Timeval::settimeofday(&tv) < 0) {
+        pkt->len = 0;
+        return pkt;
+    }
+#else
+    Timeval::settimeofday(&tv);
+#endif
+
+    pkt->tv_sec = tv.tv_sec;
+    pkt->tv_usec = tv.tv_usec;
+    pkt->len = get32(rec + 12);
+    pkt->cap_len = caplen;
+    pkt->reverse = 0;
+
+    // no copy here, the classifier copies the packets it keeps
+    pkt->payload = (unsigned char *) rec + PCAP_REC_HLEN;
+
+    NetTapPcap::parseHeaders(pkt, s_linkType);
+
+    stats->packets++;
+    stats->bytes += pkt->cap_len;
+
+    return pkt;
+}
+
+
+metaData_t *NetTapMmap::getPacket(char *buf, unsigned long len)
+{
+    metaData_t *pkt = nextRecord(buf, len);
+
+    if ((pkt != NULL) && (pkt->len == 0)) {
+        return NULL;
+    }
+
+    return pkt;
+}
+
+
+int NetTapMmap::getPackets(PacketSink *sink, int max)
+{
+    int cnt = 0;
+    unsigned long len = 0;
+    char *buf;
+
+    while ((cnt < max) && ((buf = sink->nextBuffer(&len)) != NULL)) {
+        metaData_t *pkt = nextRecord(buf, len);
+
+        if (pkt == NULL) {
+            break;
+        }
+
+        cnt++;
+
+        if (pkt->len > 0) {
+            sink->putPacket(pkt);
+        }
+    }
+
+    return cnt;
+}
+
+
+void NetTapMmap::compileFilter(string filter, struct bpf_program *prog)
+{
+    // no capture device, compile for the link type of the file
+    pcap_t *dead = pcap_open_dead(s_linkType, 65535);
+
+    if (dead == NULL) {
+        throw Error("cannot compile BPF filter %s", filter.c_str());
+    }
+
+    if (pcap_compile(dead, prog, (char *)filter.c_str(), OFLAG, htonl(NETMASK)) < 0) {
+        pcap_close(dead);
+        throw Error("error while compiling BPF filter %s", filter.c_str());
+    }
+
+    pcap_close(dead);
+}
+
+
+void NetTapMmap::checkFilter(string filter)
+{
+    struct bpf_program prog;
+
+    if (!filter.empty()) {
+        compileFilter(filter, &prog);
+        pcap_freecode(&prog);
+    }
+}
+
+
+void NetTapMmap::addFilter(string filter)
+{
+    struct bpf_program prog;
+
+    if (!filter.empty()) {
+        compileFilter(filter, &prog);
+        delFilter();
+        bpfprog = prog;
+        filtered = 1;
+    }
+}
+
+
+void NetTapMmap::delFilter()
+{
+    if (filtered) {
+        pcap_freecode(&bpfprog);
+        filtered = 0;
+    }
+}
+
+
+void NetTapMmap::dump( ostream &os )
+{
+    os << "NetTapMmap dump: " << endl;
+    os << *stats;
+}
+
+
+//!overload for <<, so that a network tap object can be thrown into an ostream
+ostream& operator<< ( ostream &os, NetTapMmap &nt )
+{
+    nt.dump(os);
+    return os;
+}
@@ -0,0 +1,154 @@
+/*! \file   NetTapMmap.h
+
+    Copyright 2003-2004 Fraunhofer Institute for Open Communication Systems (FOKUS),
+                        Berlin, Germany
+
+    This file is part of Network Measurement and Accounting System (NETMATE).
+
+    NETMATE is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    NETMATE is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this software; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Description:
+    nettap reading pcap capture files via mmap
+
+    $Id$
+*/
+
+#ifndef _NETTAPMMAP_H_
+#define _NETTAPMMAP_H_
+
+
+#include "stdincpp.h"
+#include "Error.h"
+#include "NetTap.h"
+#include "NetTapPcap.h"
+
+
+/*! \short   read packets from a memory mapped pcap capture file
+
+    The packets handed to the classifier point into the mapped file,
+    only packets kept by the classifier are copied into the packet queue.
+*/
+
+class NetTapMmap : public NetTap
+{
+  private:
+
+    //! capture file name
+    string devfile;
+
+    //! start of the mapped file
+    unsigned char *base;
+
+    //! size of the mapped file
+    size_t size;
+
+    //! offset of the next record
+    size_t pos;
+
+    //! offset up to which the mapping has been released already
+    size_t released;
+
+    //! link layer type (e.g. Ethernet)
+    int s_linkType;
+
+    //! 1 if the file was written with different byte order
+    int swapped;
+
+    //! 1 if the time stamps have nanosecond resolution
+    int nsec;
+
+    //! BPF filter applied to every record (if filtered is set)
+    struct bpf_program bpfprog;
+    int filtered;
+
+    //! compile a BPF filter for the link type of the file
+    void compileFilter(string filter, struct bpf_program *prog);
+
+    //! read a 32bit value from a pcap header
+    inline unsigned int get32(const unsigned char *p)
+    {
+        unsigned int v;
+
+        // records are not aligned in the file
+        memcpy(&v, p, sizeof(v));
+
+        return swapped ? (((v & 0xff) << 24) | ((v & 0xff00) << 8) |
+                          ((v >> 8) & 0xff00) | (v >> 24)) : v;
+    }
+
+    /*! \short   fill the meta data for the next record of the file
+                 that passes the filter
+        \returns NULL at the end of the file
+    */
+    metaData_t *nextRecord(char *buf, unsigned long len);
+
+  public:
+
+    /*! \short   construct and initialize a NetTapMmap object
+        \arg \c df   capture file to read from
+     */
+    NetTapMmap(string df);
+
+    //! destroy a NetTapMmap object
+    virtual ~NetTapMmap();
+
+    /*! \short get next packet from the capture file
+
+        The payload of the returned packet points into the mapped file.
+    */
+    virtual metaData_t *getPacket(char *buf, unsigned long len);
+
+    //! get up to max packets from the capture file
+    virtual int getPackets(PacketSink *sink, int max);
+
+    //! the file stays mapped while it is read
+    virtual int keepsPayload()
+    {
+        return 1;
+    }
+
+    //! check filter
+    virtual void checkFilter(string filter);
+
+    /*! \short   add a filter
+
+        Records not matching the BPF filter are skipped when the file is read.
+    */
+    virtual void addFilter(string filter);
+
+    //! delete the filter
+    virtual void delFilter();
+
+    //! dump a network tap object
+    virtual void dump( ostream &os );
+
+    //! no file descriptor to wait on
+    virtual int getFd()
+    {
+        return 0;
+    }
+
+    int isOnline()
+    {
+        return 0;
+    }
+};
+
+
+//! overload for <<, so that a network tap object can be thrown into an ostream
+ostream& operator<< ( ostream &os, NetTapMmap &nt );
+
+
+#endif // _NETTAPMMAP_H_
@@ -60,6 +60,8 @@ typedef struct
     NetTapPcap *nt;
     char *buf;
     unsigned long len;
+    PacketSink *sink;
+    int cnt;
 } pcap_data_t;
 
 
@@ -165,17 +167,45 @@ NetTapPcap::~NetTapPcap()
 void NetTapPcap::sProcPacket(u_char *data, const struct pcap_pkthdr *pkthdr, const u_char *pktdata)
 {
     pcap_data_t *pd = (pcap_data_t *) data;
+    metaData_t *pkt = (metaData_t *) pd->buf;
 
     pd->nt->procPacket(pd->buf, pd->len, pkthdr, pktdata);
+
+    // getPacket returns after pcap_dispatch, a live capture may reuse
+    // pktdata by then (a capture file only at the next read)
+    if (pd->nt->online && (pkt->len > 0)) {
+        memcpy(pkt->data, pktdata, pkt->cap_len);
+        pkt->payload = pkt->data;
+    }
+}
+
+// static function called from pcap for batched reads
+void NetTapPcap::sProcPackets(u_char *data, const struct pcap_pkthdr *pkthdr, const u_char *pktdata)
+{
+    pcap_data_t *pd = (pcap_data_t *) data;
+    unsigned long len = 0;
+    char *buf = pd->sink->nextBuffer(&len);
+
+    if (buf == NULL) {
+        // no more space in the sink, packet is lost
+        return;
+    }
+
+    pd->nt->procPacket(buf, len, pkthdr, pktdata);
+
+    metaData_t *pkt = (metaData_t *) buf;
+    if (pkt->len > 0) {
+        pd->nt->stats->packets++;
+        pd->nt->stats->bytes += pkt->cap_len;
+        pd->cnt++;
+
+        pd->sink->putPacket(pkt);
+    }
 }
 
-// FIXME make this code extensible to different mac, network and transport layers
 void NetTapPcap::procPacket(char *buf, unsigned long len, const struct pcap_pkthdr *pkthdr, 
                             const u_char *pktdata)
 {
-    unsigned short offs = 0;
-    int net_type = 0;
-    int proto = 0;
     int ret = 0;
 
     // the current packet
@@ -202,14 +232,28 @@ void NetTapPcap::procPacket(char *buf, unsigned long len, const struct pcap_pkth
         throw Error("buffer too small for captured packet");
     }
 
-    memcpy(pkt->payload, pktdata, pkt->cap_len);
+    // classify in the pcap buffer, the classifier copies the packet into
+    // the queue only if it is kept (pktdata is only valid in the callback)
+    pkt->payload = (unsigned char *) pktdata;
+
+    parseHeaders(pkt, s_linkType);
+}
+
+
+// FIXME make this code extensible to different mac, network and transport layers
+void NetTapPcap::parseHeaders(metaData_t *pkt, int linkType)
+{
+    unsigned short offs = 0;
+    int net_type = 0;
+    int proto = 0;
+
     pkt->offs[L_LINK] = 0;
     pkt->offs[L_NET] = -1;
     pkt->offs[L_TRANS] = -1;
     pkt->offs[L_DATA] = -1;
     
     // only support Ethernet, raw IP and loopback for now
-    switch (s_linkType) {
+    switch (linkType) {
     case DLT_NULL:
         offs += 4;
         pkt->layers[L_LINK] = L_UNKNOWN;
@@ -341,6 +385,8 @@ metaData_t *NetTapPcap::getPacket(char *buf, unsigned long len)
     pd.nt = this;
     pd.buf = buf;
     pd.len = len;
+    pd.sink = NULL;
+    pd.cnt = 0;
 
     int ret = pcap_dispatch(pcap_handle, 1, sProcPacket, (u_char *)&pd);
     if (ret < 0) {
@@ -361,6 +407,26 @@ metaData_t *NetTapPcap::getPacket(char *buf, unsigned long len)
 }
 
 
+int NetTapPcap::getPackets(PacketSink *sink, int max)
+{
+    pcap_data_t pd;
+
+    pd.nt = this;
+    pd.buf = NULL;
+    pd.len = 0;
+    pd.sink = sink;
+    pd.cnt = 0;
+
+    int ret = pcap_dispatch(pcap_handle, max, sProcPackets, (u_char *)&pd);
+    if (ret < 0) {
+        throw Error("pcap_dispatch: %s", pcap_geterr(pcap_handle));
+    }
+
+    // number of packets read (some may have been discarded)
+    return ret;
+}
+
+
 void NetTapPcap::checkFilter(string filter)
 {
     int netmask;
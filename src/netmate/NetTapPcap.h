@@ -91,11 +91,21 @@ class NetTapPcap : public NetTap
     static void sProcPacket(u_char *data, const struct pcap_pkthdr *pkthdr, 
                            const u_char *pktdata);
 
+    //! pcap callback used by getPackets, passes each packet to the sink
+    static void sProcPackets(u_char *data, const struct pcap_pkthdr *pkthdr, 
+                             const u_char *pktdata);
+
     void procPacket(char *buf, unsigned long len, const struct pcap_pkthdr *pkthdr, 
                     const u_char *pktdata);
 
   public:
 
+    /*! \short   determine the layer offsets and protocols of a packet
+        \arg \c pkt       packet with payload and cap_len set
+        \arg \c linkType  pcap link layer type (DLT_*)
+    */
+    static void parseHeaders(metaData_t *pkt, int linkType);
+
     /*! \short   construct and initialize a NetTap object
         \arg \c df       device or file to open
         \arg \c onl      online capturing (net) or offline cpaturing (file)
@@ -117,6 +127,13 @@ class NetTapPcap : public NetTap
         used for error signalization.
     */
     virtual metaData_t *getPacket(char *buf, unsigned long len);
+
+    /*! \short get up to max packets with a single pcap_dispatch call
+
+        Each packet is written into a buffer provided by the sink and 
+        handed back to it right away.
+    */
+    virtual int getPackets(PacketSink *sink, int max);
     
     //! check filter
     virtual void checkFilter(string filter);
@@ -34,14 +34,19 @@
 //!\short  default number of packet buffers to reserve if none is configured in the meter config file (item: PacketQueueBuffers)
 static const int  DEF_PACKET_BUFFERS = 2000;
 
+//!\short  default max number of flows per flow record of an export (item: MaxExportFlows)
+static const int  DEF_EXPORT_FLOWS = 65536;
+
 
 /* ------------------------- PacketProcessor ------------------------- */
 
 PacketProcessor::PacketProcessor(ConfigManager *cnf, int threaded, string moduleDir ) 
     : MeterComponent(cnf, "PacketProcessor", threaded),
-      numRules(0), expt(NULL)
+      numRules(0), numWorkers(1), workersRunning(0), workers(NULL), expt(NULL),
+      maxExportFlows(DEF_EXPORT_FLOWS)
 {
     string txt;
+    int bufs = DEF_PACKET_BUFFERS;
     
 #ifdef DEBUG
     log->dlog(ch,"Starting");
@@ -53,10 +58,40 @@ PacketProcessor::PacketProcessor(ConfigManager *cnf, int threaded, string module
         }
     }
 
+    if ((txt = cnf->getValue("Workers", "PKTPROCESSOR")) != "") {
+        numWorkers = ParserFcts::parseInt(txt, 1, MAX_WORKERS);
+        if ((numWorkers > 1) && !threaded) {
+            log->wlog(ch, "multiple workers need a threaded packet processor, using one worker");
+            numWorkers = 1;
+        }
+    }
+
     if ((txt = cnf->getValue("PacketQueueBuffers",  "PKTPROCESSOR")) != "") {
-        queue = new PacketQueue(ParserFcts::parseULong(txt, 0), threaded);
-    } else {
-        queue = new PacketQueue(DEF_PACKET_BUFFERS, threaded);
+        bufs = ParserFcts::parseULong(txt, 0);
+    }
+
+    if ((txt = cnf->getValue("MaxExportFlows", "PKTPROCESSOR")) != "") {
+        maxExportFlows = ParserFcts::parseInt(txt, 0);
+    }
+
+    // the classifier is the only writer and each worker the only reader
+    int lockFree = cnf->isTrue("LockFreeQueue", "PKTPROCESSOR");
+
+    workers = new procWorker_t[numWorkers];
+    for (int i = 0; i < numWorkers; i++) {
+        workers[i].proc = this;
+        workers[i].id = i;
+        workers[i].queue = new PacketQueue(bufs, threaded, MIN_QUEUE_BUF, 
+                                           AVG_BUF_DATA, lockFree);
+#ifdef ENABLE_THREADS
+        if (threaded) {
+            mutexInit(&workers[i].access);
+        }
+#endif
+    }
+
+    if (numWorkers > 1) {
+        log->log(ch, "using %d workers", numWorkers);
     }
 
     try {
@@ -64,7 +99,10 @@ PacketProcessor::PacketProcessor(ConfigManager *cnf, int threaded, string module
                                   cnf->getValue("Modules", "PKTPROCESSOR"),/*modlist*/
                                   "Proc" /*channel name prefix*/);
     } catch (Error &e) {
-        saveDelete(queue);
+        for (int i = 0; i < numWorkers; i++) {
+            saveDelete(workers[i].queue);
+        }
+        saveDeleteArr(workers);
         throw e;
     }
 }
@@ -90,39 +128,124 @@ PacketProcessor::~PacketProcessor()
 
     // destroyFlowRecord for all rules
     for (ruleActionListIter_t r = rules.begin(); r != rules.end(); r++) {
+        // auto flows first, they use the rule's module configuration
+        for (unsigned int w = 0; w < r->flows.size(); w++) {
+            for (flowInfo_t *i = r->flows[w]->getOldestFlow(); i != NULL; i = i->next) {
+                for (ppactionListIter_t j = i->actions.begin(); j != i->actions.end(); j++) {
+                    j->mapi->destroyFlowRec(j->flowData);
+                    j->flowData = NULL; 
+                    j->params = NULL;
+                    
+                    // FIXME disable timers
+                }
+            }
+
+            saveDelete(r->flows[w]);
+        }
+
         for (ppactionListIter_t i = r->actions.begin(); 
              i != r->actions.end(); i++) {
-            if (i->flowData != NULL) {
-                i->mapi->destroyFlowRec(i->flowData);
-            }
+            destroyRuleRec(&(*i));
             saveDeleteArr(i->params);
         }
         
         if (r->flowKeyLen > 0) {
             saveDeleteArr(r->flowKeyList);
         }
+    }
 
-        if (r->auto_flows) {
-            for (flowListIter_t i = r->flows->getFlows()->begin(); 
-                 i != r->flows->getFlows()->end(); ++i) {
-                for (ppactionListIter_t j = i->second.actions.begin(); j != i->second.actions.end(); j++) {
-                    j->mapi->destroyFlowRec(j->flowData);
-                    j->flowData = NULL; 
-                    j->params = NULL;
-                    
-                    // FIXME disable timers
-                }
+    // discard the Module Loader
+    saveDelete(loader);
+
+    // destroy the packet queues
+    for (int i = 0; i < numWorkers; i++) {
+        saveDelete(workers[i].queue);
+#ifdef ENABLE_THREADS
+        if (threaded) {
+            mutexDestroy(&workers[i].access);
+        }
+#endif
+    }
+    saveDeleteArr(workers);
+}
+
+
+void PacketProcessor::lockWorkers()
+{
+#ifdef ENABLE_THREADS
+    if (threaded) {
+        for (int i = 0; i < numWorkers; i++) {
+            mutexLock(&workers[i].access);
+        }
+    }
+#endif
+}
+
+
+void PacketProcessor::unlockWorkers()
+{
+#ifdef ENABLE_THREADS
+    if (threaded) {
+        for (int i = numWorkers - 1; i >= 0; i--) {
+            mutexUnlock(&workers[i].access);
+        }
+    }
+#endif
+}
+
+
+void PacketProcessor::run()
+{
+    // worker 0 runs in the thread of the component
+    MeterComponent::run();
+
+#ifdef ENABLE_THREADS
+    if (threaded && !workersRunning) {
+        for (int i = 1; i < numWorkers; i++) {
+            int res = threadCreate(&workers[i].thread, workerThread, &workers[i]);
+            if (res != 0) {
+                throw Error("Cannot create packet processor worker thread: %s",
+                            strerror(res));
             }
+        }
+        workersRunning = 1;
+    }
+#endif
+}
+
 
-            saveDelete(r->flows);
+void PacketProcessor::stop()
+{
+#ifdef ENABLE_THREADS
+    if (threaded && workersRunning) {
+        for (int i = 1; i < numWorkers; i++) {
+            threadCancel(workers[i].thread);
+            threadJoin(workers[i].thread);
         }
+        workersRunning = 0;
     }
+#endif
 
-    // discard the Module Loader
-    saveDelete(loader);
+    MeterComponent::stop();
+}
+
+
+void *PacketProcessor::workerThread(void *arg)
+{
+    procWorker_t *w = (procWorker_t *) arg;
 
-    // destroy the packet queue
-    saveDelete(queue);
+#ifdef ENABLE_THREADS
+    // asynch cancel
+    threadSetCancelType(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+#endif
+
+    w->proc->log->log(w->proc->ch, "PacketProcessor worker %d running", w->id);
+
+    for (;;) {
+        w->proc->processQueue(w->id);
+    }
+
+    return NULL;
 }
 
 
@@ -172,9 +295,17 @@ int PacketProcessor::checkRule(Rule *r)
     log->dlog(ch, "checking Rule %s.%s", r->getSetName().c_str(), r->getRuleName().c_str());
 #endif  
 
+    // nothing to clean up if the rule is rejected before any module is loaded
+    a.flowData = NULL;
+    a.module = NULL;
+    a.params = NULL;
+    a.config = NULL;
+
     try {
         AUTOLOCK(threaded, &maccess);
 
+        checkWorkerKey(r);
+
         for (actionListIter_t iter = actions->begin(); iter != actions->end(); iter++) {
             Module *mod;
             string mname = iter->name;
@@ -182,6 +313,8 @@ int PacketProcessor::checkRule(Rule *r)
             a.flowData = NULL;
             a.module = NULL;
             a.params = NULL;
+            a.recSize = 0;
+            a.config = NULL;
 
             // load Action Module used by this rule
             mod = loader->getModule(mname.c_str());
@@ -193,7 +326,8 @@ int PacketProcessor::checkRule(Rule *r)
 
                 // init module
                 a.params = ConfigManager::getParamList(iter->conf);
-                int ret = (a.mapi)->initFlowRec(a.params, &a.flowData);
+                a.recSize = a.module->getFlowRecSize();
+                int ret = initRuleRec(&a);
 
                 if (ret < 0) {
                     throw Error("Invalid parameters for module %s", mname.c_str());
@@ -203,8 +337,7 @@ int PacketProcessor::checkRule(Rule *r)
                 a.params = NULL;
 
                 // free memory
-                (a.mapi)->destroyFlowRec(a.flowData);
-                a.flowData = NULL;
+                destroyRuleRec(&a);
 
                 //release packet processing modules already loaded for this rule
                 loader->releaseModule(a.module);
@@ -220,8 +353,8 @@ int PacketProcessor::checkRule(Rule *r)
         }
 
         // free memory
-        if (a.flowData != NULL) {
-            (a.mapi)->destroyFlowRec(a.flowData);
+        if ((a.flowData != NULL) || (a.config != NULL)) {
+            destroyRuleRec(&a);
         }
             
         //release packet processing modules already loaded for this rule
@@ -235,6 +368,164 @@ int PacketProcessor::checkRule(Rule *r)
 }
 
 
+/* ------------------------- initRuleRec ------------------------- */
+
+int PacketProcessor::initRuleRec(ppaction_t *a)
+{
+    int ret;
+
+    a->flowData = NULL;
+    a->config = NULL;
+
+    // parse the parameters once for all flows of the rule
+    ret = a->module->initRuleConfig(a->params, &a->config);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (a->recSize > 0) {
+        a->flowData = new char[a->recSize];
+    }
+
+    return a->module->initFlowRec(a->params, a->config, &a->flowData);
+}
+
+
+/* ------------------------- destroyRuleRec ------------------------- */
+
+void PacketProcessor::destroyRuleRec(ppaction_t *a)
+{
+    if (a->flowData != NULL) {
+        (a->mapi)->destroyFlowRec(a->flowData);
+
+        if (a->recSize > 0) {
+            delete[] (char *) a->flowData;
+        }
+        a->flowData = NULL;
+    }
+
+    if (a->config != NULL) {
+        a->module->destroyRuleConfig(a->config);
+        a->config = NULL;
+    }
+}
+
+
+/* ------------------------- checkWorkerKey ------------------------- */
+
+void PacketProcessor::checkWorkerKey(Rule *r)
+{
+    keyProg_t prog;
+    int addrs = 0;
+
+    if ((numWorkers < 2) || !r->isFlagEnabled(RULE_AUTO_FLOWS)) {
+        return;
+    }
+
+    compileKey(r->getFilter(), prog);
+
+    // the addresses hashed by the classifier (IPv4 or IPv6 header)
+    for (keyProg_t::iterator k = prog.begin(); k != prog.end(); ++k) {
+        if ((k->refer != IP) || !k->full) {
+            continue;
+        }
+        if ((k->offs == 12) && (k->len == 4)) {
+            addrs |= 1;
+        } else if ((k->offs == 16) && (k->len == 4)) {
+            addrs |= 2;
+        } else if ((k->offs == 8) && (k->len == 16)) {
+            addrs |= 4;
+        } else if ((k->offs == 24) && (k->len == 16)) {
+            addrs |= 8;
+        }
+    }
+
+    if (((addrs & 3) != 3) && ((addrs & 12) != 12)) {
+        throw Error("rule %s.%s: with %d workers the flow key must contain the "
+                    "source and destination address", r->getSetName().c_str(),
+                    r->getRuleName().c_str(), numWorkers);
+    }
+}
+
+
+/* ------------------------- compileKey ------------------------- */
+
+int PacketProcessor::compileKey(filterList_t *flist, keyProg_t &prog)
+{
+    int koffs = 0;
+    int symmetric = 1;
+
+    prog.clear();
+
+    for (filterListIter_t fi = flist->begin(); fi != flist->end(); ++fi) {
+        keyField_t k;
+
+        if (fi->type == "String") {
+            k.type = KF_STRING;
+        } else if (fi->type == "Binary") {
+            k.type = KF_BINARY;
+        } else {
+            k.type = KF_PLAIN;
+        }
+
+        k.refer = fi->refer;
+        k.offs = fi->offs;
+        // fields without reverse name are the same in both directions
+        if (!fi->rname.empty()) {
+            k.rrefer = fi->rrefer;
+            k.roffs = fi->roffs;
+        } else {
+            k.rrefer = fi->refer;
+            k.roffs = fi->offs;
+        }
+        k.len = fi->len;
+        k.shift = (fi->len == 1) ? fi->fdshift : 0;
+
+        k.full = 1;
+        memset(k.mask, 0, sizeof(k.mask));
+        for (int i = 0; i < fi->len; i++) {
+            k.mask[i] = fi->fdmask.getValue()[i] & fi->mask.getValue()[i];
+            if (k.mask[i] != 0xff) {
+                k.full = 0;
+            }
+        }
+
+        if (k.type == KF_BINARY) {
+            koffs += sizeof(unsigned int);
+        }
+        k.koffs = koffs;
+        koffs += k.len;
+        if (k.type == KF_STRING) {
+            koffs++;
+        }
+        k.rfield = -1;
+
+        prog.push_back(k);
+    }
+
+    // find the field holding the reverse value of each field
+    for (unsigned int n = 0; n < prog.size(); n++) {
+        for (unsigned int m = 0; m < prog.size(); m++) {
+            if ((prog[m].refer == prog[n].rrefer) && (prog[m].offs == prog[n].roffs) &&
+                (prog[m].type == prog[n].type) && (prog[m].len == prog[n].len) &&
+                (prog[m].shift == prog[n].shift) &&
+                (memcmp(prog[m].mask, prog[n].mask, prog[n].len) == 0)) {
+                prog[n].rfield = m;
+                break;
+            }
+        }
+    }
+
+    for (unsigned int n = 0; n < prog.size(); n++) {
+        if ((prog[n].rfield < 0) || (prog[prog[n].rfield].rfield != (short) n)) {
+            symmetric = 0;
+        }
+    }
+
+    return symmetric;
+}
+
+
 /* ------------------------- addRule ------------------------- */
 
 int PacketProcessor::addRule( Rule *r, EventScheduler *e )
@@ -250,6 +541,10 @@ int PacketProcessor::addRule( Rule *r, EventScheduler *e )
     log->dlog(ch, "adding Rule #%d", ruleId);
 #endif  
 
+    checkWorkerKey(r);
+
+    // workers must not look at the rules while the list may be reallocated
+    lockWorkers();
     AUTOLOCK(threaded, &maccess);  
 
     entry.lastPkt = 0;
@@ -257,15 +552,20 @@ int PacketProcessor::addRule( Rule *r, EventScheduler *e )
     entry.bytes = 0;
     entry.flowKeyLen = 0;
     entry.flowKeyList = r->getFlowKeyList();
+    entry.symmetric = 0;
+    entry.batch = 0;
     entry.flist = r->getFilter();
     entry.auto_flows = r->isFlagEnabled(RULE_AUTO_FLOWS);
     entry.bidir = r->isBidir();
     entry.seppaths = r->sepPaths();
     entry.newFlow = 1;
     entry.rule = r;
-    entry.flows = NULL;
     if (entry.auto_flows) {
-        entry.flows = new FlowCreator();
+        entry.symmetric = compileKey(entry.flist, entry.keyProg);
+
+        for (int i = 0; i < numWorkers; i++) {
+            entry.flows.push_back(new FlowCreator(i, numWorkers));
+        }
     }
 
     try {
@@ -286,8 +586,8 @@ int PacketProcessor::addRule( Rule *r, EventScheduler *e )
 
                 // init module
                 a.params = ConfigManager::getParamList(iter->conf);
-                a.flowData = NULL;
-                int ret = (a.mapi)->initFlowRec(a.params, &a.flowData);
+                a.recSize = a.module->getFlowRecSize();
+                int ret = initRuleRec(&a);
 
                 // if packet proc modules requires bidir matching
                 // then set rule to bidir
@@ -305,11 +605,26 @@ int PacketProcessor::addRule( Rule *r, EventScheduler *e )
             cnt++;
         }
     
+        // auto flow rules whose modules all support it process packets in batches
+        entry.batch = entry.auto_flows && !entry.actions.empty();
+        for (ppactionListIter_t i = entry.actions.begin(); i != entry.actions.end(); i++) {
+            if (i->module->getBatchFunc() == NULL) {
+                entry.batch = 0;
+            }
+        }
+
         // make sure the vector of rules is large enough
         if ((unsigned int)ruleId + 1 > rules.size()) {
             rules.reserve(ruleId*2 + 1);
             rules.resize(ruleId + 1 );
         }
+        // flow records of auto flows come from pools of the flow tables
+        for (unsigned int w = 0; w < entry.flows.size(); w++) {
+            for (ppactionListIter_t i = entry.actions.begin(); i != entry.actions.end(); i++) {
+                entry.flows[w]->addPool(i->recSize);
+            }
+        }
+
         // success ->enter struct into internal table
         rules[ruleId] = entry;
 	
@@ -321,7 +636,7 @@ int PacketProcessor::addRule( Rule *r, EventScheduler *e )
 
             saveDelete(i->params);
 
-            (i->mapi)->destroyFlowRec(i->flowData);
+            destroyRuleRec(&(*i));
 	    
             //release packet processing modules already loaded for this rule
             if (i->module) {
@@ -331,8 +646,15 @@ int PacketProcessor::addRule( Rule *r, EventScheduler *e )
         // empty the list itself
         entry.actions.clear();
 
+        for (unsigned int i = 0; i < entry.flows.size(); i++) {
+            saveDelete(entry.flows[i]);
+        }
+
+        unlockWorkers();
         throw e;
     }
+
+    unlockWorkers();
     return 0;
 }
 
@@ -348,14 +670,14 @@ int PacketProcessor::delRule( Rule *r )
     log->dlog(ch, "deleting Rule #%d", ruleId);
 #endif
 
+    lockWorkers();
     AUTOLOCK(threaded, &maccess);
 
     ra = &rules[ruleId];
 
-    if (ra->auto_flows) {
-        for (flowListIter_t i = ra->flows->getFlows()->begin(); 
-             i != ra->flows->getFlows()->end(); ++i) {
-            for (ppactionListIter_t j = i->second.actions.begin(); j != i->second.actions.end(); j++) {
+    for (unsigned int w = 0; w < ra->flows.size(); w++) {
+        for (flowInfo_t *i = ra->flows[w]->getOldestFlow(); i != NULL; i = i->next) {
+            for (ppactionListIter_t j = i->actions.begin(); j != i->actions.end(); j++) {
                 j->mapi->destroyFlowRec(j->flowData);
                 j->flowData = NULL; 
                 j->params = NULL;
@@ -364,16 +686,16 @@ int PacketProcessor::delRule( Rule *r )
             }
         }
 
-        saveDelete(ra->flows);
+        saveDelete(ra->flows[w]);
     }
+    ra->flows.clear();
 
 
     // now free flow data and release used Modules
     for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
 
         // dismantle flow data structure with module function
-        i->mapi->destroyFlowRec(i->flowData);
-        i->flowData = NULL;
+        destroyRuleRec(&(*i));
         
         if (i->params != NULL) {
             saveDeleteArr(i->params);
@@ -391,192 +713,376 @@ int PacketProcessor::delRule( Rule *r )
     ra->flowKeyLen = 0;
     saveDeleteArr(ra->flowKeyList);
     ra->flist = NULL;
+    ra->keyProg.clear();
+    ra->symmetric = 0;
+    ra->batch = 0;
     ra->auto_flows = 0;
     ra->bidir = 0;
     ra->seppaths = 0;
     ra->newFlow = 0;
     ra->rule = NULL;
-    if (ra->flows != NULL) {
-        saveDelete(ra->flows);
-    }
 
+    unlockWorkers();
     return 0;
 }
 
 
-/* ------------------------- processPacket ------------------------- */
+/* ------------------------- buildKey ------------------------- */
+
+inline int PacketProcessor::buildKey(keyProg_t &prog, metaData_t *meta, 
+                                     unsigned char *key, int reverse)
+{
+    int len = 0;
+
+    for (unsigned int n = 0; n < prog.size(); n++) {
+        keyField_t *k = &prog[n];
+        const unsigned char *pval;
+        unsigned char *dst;
+
+        if (!reverse) {
+            pval = &meta->payload[meta->offs[k->refer] + k->offs];
+        } else {
+            pval = &meta->payload[meta->offs[k->rrefer] + k->roffs];
+        }
+
+        if (k->type == KF_BINARY) {
+            // insert length first
+            unsigned int flen = k->len;
+
+            memcpy(&key[len], &flen, sizeof(flen));
+            len += sizeof(flen);
+        }
+
+        dst = &key[len];
+        memcpy(dst, pval, k->len);
+
+        // get masked pkt value
+        if (!k->full) {
+            int i = 0;
+
+            for (; i + (int) sizeof(unsigned long long) <= k->len; i += sizeof(unsigned long long)) {
+                unsigned long long v, m;
+
+                memcpy(&v, &dst[i], sizeof(v));
+                memcpy(&m, &k->mask[i], sizeof(m));
+                v &= m;
+                memcpy(&dst[i], &v, sizeof(v));
+            }
+            for (; i < k->len; i++) {
+                dst[i] &= k->mask[i];
+            }
+        }
+
+        // if pkt value was only one byte then shift the value 
+        // downwards according to filter def mask (e.g. 0x02 -> 1bit, 0x10 -> 4bits)
+        if (k->shift != 0) {
+            dst[0] = dst[0] >> k->shift;
+        }
 
+        len += k->len;
 
-int PacketProcessor::processPacket(metaData_t *meta)
+        if (k->type == KF_STRING) {
+            // insert final terminator
+            key[len] = '\0';
+            len++;
+        }
+    }
+
+    return len;
+}
+
+
+/* ------------------------- swapKey ------------------------- */
+
+inline void PacketProcessor::swapKey(keyProg_t &prog, const unsigned char *key, 
+                                     unsigned char *rkey, int len)
 {
+    // copies length fields, terminators and path marker
+    memcpy(rkey, key, len);
 
-#ifdef PROFILING
-    unsigned long long ini, end;
-#endif
-    ruleActions_t *ra;
-    ppactionList_t *acts;
+    for (unsigned int n = 0; n < prog.size(); n++) {
+        keyField_t *k = &prog[n];
 
-    AUTOLOCK(threaded, &maccess);
+        if (k->rfield != (short) n) {
+            memcpy(&rkey[k->koffs], &key[prog[k->rfield].koffs], k->len);
+        }
+    }
+}
 
-    // loop over all the rules matched
-    for (int i = 0; i<meta->match_cnt; i++) {
-        int ruleId = meta->match[i];
 
-        ra = &rules[ruleId];
+/* ------------------------- exportKey ------------------------- */
 
-        // make sure the rule still exists
-        if (!ra->actions.empty()) {
-	    flowInfo_t *flow = NULL;
-            //log->dlog(ch,"processing packet for Rule #%d", ruleId);
+inline const unsigned char *PacketProcessor::exportKey(ruleActions_t *ra, flowInfo_t *fi, 
+                                                       unsigned char *buf)
+{
+    if (!ra->bidir || !ra->symmetric) {
+        return fi->keyData;
+    }
+
+    if (fi->dir) {
+        swapKey(ra->keyProg, fi->keyData, buf, fi->len);
+    } else {
+        memcpy(buf, fi->keyData, fi->len);
+    }
 
-            // account number of packets and bytes for this task
-            ra->packets++;
-            ra->bytes += meta->cap_len;
+    if (ra->seppaths) {
+        // the table has a key direction in the marker, exported is
+        // 1 for the path of the first packet and 2 for the other path
+        buf[fi->len - 1] = (fi->keyData[fi->len - 1] - 1 == fi->dir) ? 1 : 2;
+    }
 
-            if (ra->auto_flows) {
-	        int mval_len = 0, rmval_len = 0;
-                unsigned char mvalues[1024];
-		unsigned char rmvalues[1024];
-		unsigned char tmp[MAX_FILTER_LEN];
+    return buf;
+}
 
-                // get matching attributes from packet
-                for (filterListIter_t fi = ra->flist->begin(); fi != ra->flist->end(); ++fi) {
 
-                    unsigned char *pval = (unsigned char *) &meta->payload[ meta->offs[fi->refer] + fi->offs ]; 
+/* ------------------------- lookupFlow ------------------------- */
 
-                    // get masked pkt value
-                    for (int i = 0; i < fi->len; i++) {
-		        tmp[i] = pval[i] & fi->fdmask.getValue()[i] & fi->mask.getValue()[i];
-                    }
+flowInfo_t *PacketProcessor::lookupFlow(ruleActions_t *ra, metaData_t *meta, int worker,
+                                        int clreverse)
+{
+    FlowCreator *flows = ra->flows[worker];
+    int mval_len = 0, rmval_len = 0;
+    unsigned char mvalues[1024];
+    unsigned char rmvalues[1024];
+    unsigned int hash;
+    flowInfo_t *fi;
+    // key direction of the packet and of the first packet of a new flow
+    int dir = 0, first = 0;
+
+    // get matching attributes from packet
+    mval_len = buildKey(ra->keyProg, meta, mvalues, 0);
+
+    if (ra->bidir && ra->symmetric) {
+        // the flow is stored under the smaller of forward and reverse 
+        // key, so one lookup finds it for packets of both directions
+        swapKey(ra->keyProg, mvalues, rmvalues, mval_len);
+        dir = (memcmp(mvalues, rmvalues, mval_len) > 0);
+        if (dir) {
+            memcpy(mvalues, rmvalues, mval_len);
+        }
 
-		    // if pkt value was only one byte then shift the value 
-		    // downwards according to filter def mask (e.g. 0x02 -> 1bit, 0x10 -> 4bits)
-		    if (fi->len == 1 && fi->fdshift != 0) {
-			tmp[0] = tmp[0] >> fi->fdshift;
-		    }
-
-		    // FIXME the following 'switch' is terribly inefficient
-		    if (fi->type == "String") {
-		       memcpy(&mvalues[mval_len], tmp, fi->len);
-		       mval_len += fi->len;
-		       // insert final terminator
-		       mvalues[mval_len] = '\0';
-		       mval_len++;
-		    } else if (fi->type == "Binary") {
-		      // insert length first
-		      *((unsigned int *) &mvalues[mval_len]) = fi->len;
-		      mval_len += sizeof(unsigned int);
-		      memcpy(&mvalues[mval_len], tmp, fi->len);
-		      mval_len += fi->len;
-		    } else {
-		      memcpy(&mvalues[mval_len], tmp, fi->len);
-		      mval_len += fi->len;
-		    }
-		    
-		    if (ra->bidir) {
-
-		      if (!fi->rname.empty()) {
-			// get reverse value
-			unsigned char *pval = (unsigned char *) &meta->payload[ meta->offs[fi->rrefer] + fi->roffs ]; 
-			// get masked pkt value
-			for (int i = 0; i < fi->len; i++) {
-			  tmp[i] = pval[i] & fi->fdmask.getValue()[i] & fi->mask.getValue()[i];
-			}	
-		      } 
-
-		      // FIXME the following 'switch' is terribly inefficient
-		      if (fi->type == "String") {
-			memcpy(&rmvalues[rmval_len], tmp, fi->len);
-			rmval_len += fi->len;
-			// insert final terminator
-			rmvalues[rmval_len] = '\0';
-			rmval_len++;
-		      } else if (fi->type == "Binary") {
-			// insert length first
-			*((unsigned int *) &rmvalues[rmval_len]) = fi->len;
-			rmval_len += sizeof(unsigned int);
-			memcpy(&rmvalues[rmval_len], tmp, fi->len);
-			rmval_len += fi->len;
-		      } else {
-			memcpy(&rmvalues[rmval_len], tmp, fi->len);
-			rmval_len += fi->len;
-		      }
-		    }
+        if (ra->seppaths) {
+            // each direction has its own flow entry
+            mvalues[mval_len] = 1 + dir;
+            mval_len++;
+        }
+
+        hash = FlowCreator::hashKey(mvalues, mval_len);
+        fi = flows->getFlow(mvalues, mval_len, hash);
+
+        if (fi == NULL) {
+            // according to the classifier its in reverse direction -> swap directions
+            first = clreverse ? !dir : dir;
+
+            if (ra->seppaths) {
+                // the entry of the other direction knows the first packet
+                mvalues[mval_len-1] = 2 - dir;
+                flowInfo_t *other = flows->getFlow(mvalues, mval_len);
+                mvalues[mval_len-1] = 1 + dir;
+                if (other != NULL) {
+                    first = other->dir;
+                }
+            }
+#ifdef SWAP_HACK
+            else if (!clreverse && ((meta->layers[2] == T_UDP) || (meta->layers[2] == T_TCP))) {
+                // use heuristic: swap direction if udp/tcp source port is well-known but dst port is not
+                unsigned short src_port = ntohs(*((unsigned short *) &meta->payload[meta->offs[2]]));
+                unsigned short dst_port = ntohs(*((unsigned short *) &meta->payload[meta->offs[2]+2]));
+                if ( (src_port < 1024) && (dst_port >= 1024) ) { 
+                    first = !dir;
                 }
+            }
+#endif
+        }
+    } else {
+        if (ra->bidir) {
+            rmval_len = buildKey(ra->keyProg, meta, rmvalues, 1);
+        }
 
-		if (ra->seppaths) {
-		  mvalues[mval_len] = 1;
-		  mval_len++;
-		  rmvalues[rmval_len] = 1;
-		  rmval_len++;
-		}
+        if (ra->seppaths) {
+            mvalues[mval_len] = 1;
+            mval_len++;
+            rmvalues[rmval_len] = 1;
+            rmval_len++;
+        }
 
-		flowInfo_t *fi = ra->flows->getFlow(mvalues, mval_len);
+        // the key is hashed once for lookup and insert
+        hash = FlowCreator::hashKey(mvalues, mval_len);
+        fi = flows->getFlow(mvalues, mval_len, hash);
 
-		if ((fi == NULL) && ra->bidir) {
-		  // try reverse match
-		  fi = ra->flows->getFlow(rmvalues, rmval_len);
+        if ((fi == NULL) && ra->bidir) {
+            unsigned int rhash = FlowCreator::hashKey(rmvalues, rmval_len);
 
-		  if (fi != NULL) {
-		    // set backward indication
-		    meta->reverse = 1;
+            // try reverse match
+            fi = flows->getFlow(rmvalues, rmval_len, rhash);
 
-		    if (ra->seppaths) {
-		      // generate extra flow entry for reverse path
-		      rmvalues[rmval_len-1] = 2;
-		      fi = ra->flows->getFlow(rmvalues, rmval_len);
-		      memcpy(mvalues, rmvalues, rmval_len);
-		      mval_len = rmval_len;
-		    }
-		  } else {
-		    // this is the first packet of a new flow
-		    if (meta->reverse) {
-		      // according to the classifier its in reverse direction -> swap directions
-		      memcpy(mvalues, rmvalues, rmval_len);
-		      mval_len = rmval_len;
-                    }
+            if (fi != NULL) {
+                // set backward indication
+                meta->reverse = 1;
+
+                if (ra->seppaths) {
+                    // generate extra flow entry for reverse path
+                    rmvalues[rmval_len-1] = 2;
+                    hash = FlowCreator::hashKey(rmvalues, rmval_len);
+                    fi = flows->getFlow(rmvalues, rmval_len, hash);
+                    memcpy(mvalues, rmvalues, rmval_len);
+                    mval_len = rmval_len;
+                }
+            } else {
+                // this is the first packet of a new flow
+                if (meta->reverse) {
+                    // according to the classifier its in reverse direction -> swap directions
+                    memcpy(mvalues, rmvalues, rmval_len);
+                    mval_len = rmval_len;
+                    hash = rhash;
+                }
 #ifdef SWAP_HACK
-		    else if ((meta->layers[2] == T_UDP) || (meta->layers[2] == T_TCP)) {
-		      // use heuristic: swap direction if udp/tcp source port is well-known but dst port is not
-		      unsigned short src_port = ntohs(*((unsigned short *) &meta->payload[meta->offs[2]]));
-		      unsigned short dst_port = ntohs(*((unsigned short *) &meta->payload[meta->offs[2]+2]));
-		      if ( (src_port < 1024) && (dst_port >= 1024) ) { 
-			memcpy(mvalues, rmvalues, rmval_len);
-			mval_len = rmval_len;
-			// and change direction to backward!
-			meta->reverse = 1;
-		      }
-		    }
+                else if ((meta->layers[2] == T_UDP) || (meta->layers[2] == T_TCP)) {
+                    // use heuristic: swap direction if udp/tcp source port is well-known but dst port is not
+                    unsigned short src_port = ntohs(*((unsigned short *) &meta->payload[meta->offs[2]]));
+                    unsigned short dst_port = ntohs(*((unsigned short *) &meta->payload[meta->offs[2]+2]));
+                    if ( (src_port < 1024) && (dst_port >= 1024) ) { 
+                        memcpy(mvalues, rmvalues, rmval_len);
+                        mval_len = rmval_len;
+                        hash = rhash;
+                        // and change direction to backward!
+                        meta->reverse = 1;
+                    }
+                }
 #endif
-		  } 
-		}
-		
-		if (fi == NULL) {
-		  // add new flow
-		  fi = ra->flows->addFlow(mvalues, mval_len);
+            } 
+        }
+    }
+
+    if (fi == NULL) {
+        // add new flow
+        fi = flows->addFlow(mvalues, mval_len, hash);
+        fi->dir = first;
                   
-		  // initialize proc modules
-		  for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
-		    ppaction_t a;
-		    
-		    a.mapi = i->mapi;
-		    a.module = i->module;
-		    a.params = i->params;
-		    
-		    a.flowData = NULL;
-		    (a.mapi)->initFlowRec(a.params, &a.flowData);
-		    fi->actions.push_back(a);
-		  }
-		} 
+        // initialize proc modules
+        int n = 0;
+        for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++, n++) {
+            ppaction_t a;
+
+            a.mapi = i->mapi;
+            a.module = i->module;
+            a.params = i->params;
+            a.recSize = i->recSize;
+            a.config = i->config;
+
+            a.flowData = flows->newRecord(n);
+            a.module->initFlowRec(a.params, a.config, &a.flowData);
+            fi->actions.push_back(a);
+        }
+    } 
+
+    if (ra->bidir && ra->symmetric) {
+        // backward if the key direction differs from the first packet
+        meta->reverse = dir ^ fi->dir;
+    }
+
+    flows->setLastTime(fi, meta->tv_sec + 1);
+
+    return fi;
+}
 
-                ra->flows->setLastTime(fi, meta->tv_sec + 1);
 
-                ra->flowKeyLen = mval_len;
+/* ------------------------- callProcessPacket ------------------------- */
 
-                acts = &fi->actions;
+//! apply an action to a packet, modules linked into the meter are called directly
+static inline int callProcessPacket(ppaction_t *a, metaData_t *meta)
+{
+#ifdef ENABLE_BUILTIN_MODULES
+#define CALL_BUILTIN(m) \
+    case BUILTIN_PROC_ ## m: \
+        return LTX_NAME(m, processPacket)((char *)meta->payload, meta, a->flowData);
+    switch (a->module->getBuiltin()) {
+    BUILTIN_PROC_MODULES(CALL_BUILTIN)
+    default:
+        break;
+    }
+#endif
+    return a->mapi->processPacket((char *)meta->payload, meta, a->flowData);
+}
+
+//! apply an action to a batch of packets (the module must support it)
+static inline void callProcessPackets(ppaction_t *a, procPacket_t *pkts, int num)
+{
+#ifdef ENABLE_BUILTIN_MODULES
+#define CALL_BUILTIN_BATCH(m) \
+    case BUILTIN_PROC_ ## m: \
+        LTX_NAME(m, processPackets)(pkts, num); \
+        return;
+    switch (a->module->getBuiltin()) {
+    BUILTIN_PROC_MODULES(CALL_BUILTIN_BATCH)
+    default:
+        break;
+    }
+#endif
+    a->module->getBatchFunc()(pkts, num);
+}
 
-		flow = fi;
+
+/* ------------------------- processPacket ------------------------- */
+
+
+int PacketProcessor::processPacket(metaData_t *meta, int worker)
+{
+    // the flow tables of this worker
+    AUTOLOCK(threaded, &workers[worker].access);
+
+    processRules(meta, worker, 0);
+
+#ifdef PROFILING
+    {
+        static int n = 0;
+        if (++n == 100000) {
+            cerr << "process packet in " << perf->latest(MS_MODULE) << "(" <<
+              perf->avg(MS_MODULE) << ") ns " << endl;
+            n = 0;
+        }
+    }
+#endif
+    return 0;
+}
+
+
+void PacketProcessor::processRules(metaData_t *meta, int worker, int skipBatch)
+{
+
+#ifdef PROFILING
+    unsigned long long ini, end;
+#endif
+    ruleActions_t *ra;
+    ppactionList_t *acts;
+
+    // direction of the packet according to the classifier
+    int clreverse = meta->reverse;
+
+    // loop over all the rules matched
+    for (int i = 0; i<meta->match_cnt; i++) {
+        int ruleId = meta->match[i];
+
+        ra = &rules[ruleId];
+
+        // make sure the rule still exists (rules processed in batches are 
+        // applied by processBatch)
+        if (!ra->actions.empty() && !(skipBatch && ra->batch)) {
+	    flowInfo_t *flow = NULL;
+            //log->dlog(ch,"processing packet for Rule #%d", ruleId);
+
+            // rules without auto flows are shared by all workers
+            AUTOLOCK(threaded && !ra->auto_flows, &maccess);
+
+            if (ra->auto_flows) {
+                flow = lookupFlow(ra, meta, worker, clreverse);
+
+                acts = &flow->actions;
             } else {
+                // account number of packets and bytes for this task
+                ra->packets++;
+                ra->bytes += meta->cap_len;
+
                 acts = &ra->actions;
             }
 	    
@@ -588,10 +1094,12 @@ int PacketProcessor::processPacket(metaData_t *meta)
                 ini = PerfTimer::readTSC();
 #endif
 
-                int doExport = (i->mapi)->processPacket((char *)meta->payload, meta, i->flowData);
+                int doExport = callProcessPacket(&*i, meta);
 
 		// flow can trigger its immediate export
 		if (doExport == 1) {
+		  // modules may use a single export buffer
+		  AUTOLOCK(threaded && ra->auto_flows, &maccess);
 		  int            size = 0;
 		  unsigned char *data = NULL;
 		  FlowRecord *frec = new FlowRecord(ruleId, ra->rule->getRuleName(), 1);
@@ -607,7 +1115,9 @@ int PacketProcessor::processPacket(metaData_t *meta)
 		  
 		  if (ra->auto_flows) {
 		    assert(flow != NULL);
-		    md->addFlowData(size, data, ra->flowKeyLen, flow->keyData, 
+		    unsigned char kbuf[1024];
+
+		    md->addFlowData(size, data, flow->len, exportKey(ra, flow, kbuf), 
 				    flow->newFlow, flow->flowId);
 		  } else {
 		    md->addFlowData(size, data, ra->flowKeyLen, NULL, 0, 0);
@@ -647,52 +1157,134 @@ int PacketProcessor::processPacket(metaData_t *meta)
 		// delete flow
 		assert(flow != NULL);
 		flow->newFlow = 0;
-		ra->flows->deleteFlow(flow);
+		ra->flows[worker]->deleteFlow(flow);
 	      } else {
 		ra->newFlow = 0;
 	      }
 	    }
 	    // #endif
 	    
-            // save time for last packet of this flow (for idle flow detection)
-            ra->lastPkt = meta->tv_sec + 1; // (rounded up)
+            if (!ra->auto_flows) {
+                // save time for last packet of this flow (for idle flow detection)
+                ra->lastPkt = meta->tv_sec + 1; // (rounded up)
+            }
 
         }
     }
+}
 
+
+/* ------------------------- processBatch ------------------------- */
+
+void PacketProcessor::processBatch(metaData_t **metas, int num, int worker)
+{
 #ifdef PROFILING
-    {
-        static int n = 0;
-        if (++n == 100000) {
-            cerr << "process packet in " << perf->latest(MS_MODULE) << "(" <<
-              perf->avg(MS_MODULE) << ") ns " << endl;
-            n = 0;
+    unsigned long long ini, end;
+#endif
+    procWorker_t *w = &workers[worker];
+    unsigned char clreverse[PROC_BATCH];
+    flowInfo_t *fis[PROC_BATCH];
+    procPacket_t pkts[PROC_BATCH];
+
+    // the flow tables of this worker
+    AUTOLOCK(threaded, &w->access);
+
+    w->batchRules.clear();
+
+    for (int p = 0; p < num; p++) {
+        metaData_t *meta = metas[p];
+
+        // direction of the packet according to the classifier
+        clreverse[p] = meta->reverse;
+
+        for (int i = 0; i < meta->match_cnt; i++) {
+            unsigned int ruleId = meta->match[i];
+
+            if (rules[ruleId].batch && 
+                (find(w->batchRules.begin(), w->batchRules.end(), ruleId) == 
+                 w->batchRules.end())) {
+                w->batchRules.push_back(ruleId);
+            }
         }
+
+        // all other rules are applied packet by packet
+        processRules(meta, worker, 1);
     }
+
+    for (vector<unsigned int>::iterator r = w->batchRules.begin(); r != w->batchRules.end(); r++) {
+        ruleActions_t *ra = &rules[*r];
+        int cnt = 0;
+
+        // find the flows of all packets of the rule
+        for (int p = 0; p < num; p++) {
+            metaData_t *meta = metas[p];
+
+            for (int i = 0; i < meta->match_cnt; i++) {
+                if (meta->match[i] == *r) {
+                    meta->reverse = clreverse[p];
+                    fis[cnt] = lookupFlow(ra, meta, worker, clreverse[p]);
+                    pkts[cnt].packet = (char *) meta->payload;
+                    pkts[cnt].meta = meta;
+                    cnt++;
+                    break;
+                }
+            }
+        }
+
+        // one call per action module (modules in batch mode never export
+        // instantly, so the flows stay valid)
+        int n = 0;
+        for (ppactionListIter_t a = ra->actions.begin(); a != ra->actions.end(); a++, n++) {
+#ifdef PROFILING
+            ini = PerfTimer::readTSC();
 #endif
-    return 0;
+            for (int p = 0; p < cnt; p++) {
+                pkts[p].flowdata = fis[p]->actions[n].flowData;
+            }
+
+            callProcessPackets(&*a, pkts, cnt);
+#ifdef PROFILING
+            end = PerfTimer::readTSC();
+            perf->account(MS_MODULE, end - ini);
+#endif
+        }
+    }
 }
 
 
-int PacketProcessor::handleFDEvent(eventVec_t *e, fd_set *rset, fd_set *wset, fd_sets_t *fds)
+int PacketProcessor::processQueue(int worker)
 {
-    metaData_t *meta;
-
-    // get next entry from packet queue
-    meta = queue->readBuffer(threaded);
-    if (meta) {
-        processPacket(meta);
-        queue->releaseBuffer();
+    metaData_t *metas[PROC_BATCH];
+    PacketQueue *queue = workers[worker].queue;
+    int num, cnt = 0;
+
+    // get the next entries from packet queue, if not threaded process all queued
+    // entries (the classifier may put a whole batch of packets into the queue)
+    while ((num = queue->readBuffers(metas, PROC_BATCH, threaded)) > 0) {
+        processBatch(metas, num, worker);
+        queue->releaseBuffers(num);
+        cnt += num;
 	// restart waiting meter
 #if ENABLE_THREADS
 	if (threaded && (queue->getUsedBuffers() == 0)) {
+	  // signal under the lock so waitUntilDone cannot miss it
+	  mutexLock(&maccess);
 	  threadCondSignal(&doneCond);
+	  mutexUnlock(&maccess);
 	}
 #endif
-	return 1;
+        if (threaded) {
+            break;
+        }
     }
 
-    return 0;
+    return cnt;
+}
+
+
+int PacketProcessor::handleFDEvent(eventVec_t *e, fd_set *rset, fd_set *wset, fd_sets_t *fds)
+{
+    return (processQueue(0) > 0);
 }
 
 void PacketProcessor::main()
@@ -702,7 +1294,7 @@ void PacketProcessor::main()
     log->log(ch, "PacketProcessor thread running");
     
     for (;;) {
-        handleFDEvent(NULL, NULL,NULL, NULL);
+        processQueue(0);
     }
 }       
 
@@ -712,125 +1304,208 @@ void PacketProcessor::waitUntilDone(void)
     AUTOLOCK(threaded, &maccess);
 
     if (threaded) {
-      while (queue->getUsedBuffers() > 0) {
-        threadCondWait(&doneCond, &maccess);
+      for (int i = 0; i < numWorkers; i++) {
+        while (workers[i].queue->getUsedBuffers() > 0) {
+          threadCondWait(&doneCond, &maccess);
+        }
       }
     }
 #endif
 }
 
-// This functions triggers the export of all rules into the flow record
+FlowRecord *PacketProcessor::newFlowRecord(ruleActions_t *ra, int rid, string rname, MetricData **md)
+{
+    int cnt = 0;
+    FlowRecord *frec = new FlowRecord(rid, rname);
+
+    for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
+        md[cnt] = new MetricData(i->module->getModName(), i->module->getExportLists(), 
+                                 ra->flowKeyList, 0, NULL, 0, NULL);
+        frec->addData(md[cnt]);
+        cnt++;
+    }
+
+    return frec;
+}
+
+// This functions triggers the export of all rules into flow records
 // if now is > 0 only idle flows are exported and their flow data reset
 // assert: if now > 0 than at least one flow has timeout
-int PacketProcessor::exportRule( FlowRecord *frec, time_t now, unsigned long ival)
+int PacketProcessor::exportRule( FlowRecordSink *sink, int rid, string rname, time_t now, 
+                                 unsigned long ival)
 {
     int            size = 0;
     unsigned char *data = NULL;
     ruleActions_t *ra;
 
-    AUTOLOCK(threaded, &maccess);
-
-    ra = &rules[frec->getRuleId()];
+    ra = &rules[rid];
 
     if (ra->auto_flows) {
-        int cnt = 0, flow = 0;
+        int cnt = 0, flow = 0, recFlows = 0, records = 0;
         MetricData *md[ra->actions.size()];
+        FlowRecord *frec = NULL;
+        // flow key in direction of the first packet
+        unsigned char kbuf[1024];
+
+        // merge the flows of all workers into the flow records
+        for (unsigned int w = 0; w < ra->flows.size(); w++) {
+          FlowCreator *flows = ra->flows[w];
+          FlowRecord *full = NULL;
+          int first = 1, more = 1;
+
+          while (more) {
+            more = 0;
+            {
+              AUTOLOCK(threaded, &workers[w].access);
+              {
+                AUTOLOCK(threaded, &maccess);
+
+                // walk the flows from the least recently active one, if only 
+                // idle flows are exported we can stop at the first active flow
+                flowInfo_t *tmp;
+                flowInfo_t *f;
 
-         // fetch flow data from registered packet processing modules for this rule
-        for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
-            md[cnt] = new MetricData(i->module->getModName(), i->module->getExportLists(), 
-                                     ra->flowKeyList, 0, NULL, 0, NULL);
-            cnt++;
-        }
+                if (now > 0) {
+                    // the flows exported before have been deleted
+                    f = flows->getOldestFlow();
+                } else if (first) {
+                    f = flows->startExport();
+                } else {
+                    f = flows->resumeExport();
+                }
+                first = 0;
 
-        flowListIter_t tmp;
-        flowListIter_t f = ra->flows->getFlows()->begin();
-        while (f != ra->flows->getFlows()->end()) {
-            cnt = 0;
-            tmp = f;
-            f++;
+                while (f != NULL) {
+                    cnt = 0;
+                    tmp = f;
+                    f = f->next;
 	  
-	    if ((now == 0) || ((time_t)(tmp->second.lastPkt + ival) <= now)) { 
-	      for (ppactionListIter_t j = tmp->second.actions.begin(); j != tmp->second.actions.end(); ++j) {
+	            if ((now > 0) && ((time_t)(tmp->lastPkt + ival) > now)) {
+                        break;
+                    }
+
+                    // flows active while the table was unlocked come again
+                    if ((now == 0) && flows->exported(tmp)) {
+                        continue;
+                    }
+
+                    if (frec == NULL) {
+                        frec = newFlowRecord(ra, rid, rname, md);
+                    }
+
+	            for (ppactionListIter_t j = tmp->actions.begin(); j != tmp->actions.end(); ++j) {
 #ifdef DEBUG
-                log->dlog(ch, "querying processing module '%s' for rule %i and flow %i", 
-                          j->module->getModName().c_str(), frec->getRuleId(), flow);
+                        log->dlog(ch, "querying processing module '%s' for rule %i and flow %i", 
+                                  j->module->getModName().c_str(), rid, flow);
 #endif              
 		
-                // fetch export data from processing module
-                j->mapi->exportData((void* *)&data, &size, j->flowData);
+                        // fetch export data from processing module
+                        j->mapi->exportData((void* *)&data, &size, j->flowData);
 		
-                md[cnt]->addFlowData(size, data, ra->flowKeyLen, tmp->second.keyData, 
-                                     tmp->second.newFlow, tmp->second.flowId);
-                tmp->second.newFlow = 0;
+                        md[cnt]->addFlowData(size, data, tmp->len, exportKey(ra, tmp, kbuf), 
+                                             tmp->newFlow, tmp->flowId);
+                        tmp->newFlow = 0;
 
-                if (now > 0) {
-		  j->mapi->destroyFlowRec(j->flowData);
-                }
+                        if (now > 0) {
+		          j->mapi->destroyFlowRec(j->flowData);
+                        }
  
-                cnt++;
-	      }
+                        cnt++;
+	            }
+
+	            if (now > 0) {
+                        // delete flow
+                        flows->deleteFlow(tmp);
+	            }
+
+                    flow++;
+
+                    // hand over a full flow record before building the next one
+                    if (++recFlows == maxExportFlows) {
+                        full = frec;
+                        frec = NULL;
+                        recFlows = 0;
+                        records++;
+
+                        if (now == 0) {
+                            flows->suspendExport(f);
+                        }
+                        more = 1;
+                        break;
+                    }
+                }
+              }
+            }
 
-	      if (now > 0) {
-                // delete flow
-                ra->flows->deleteFlow(tmp);
-	      }
-	    }
+            // the sink may wait for the exporter, the workers must not
+            // wait for it as well
+            if (full != NULL) {
+                try {
+                    sink->putFlowRecord(full);
+                } catch (Error &e) {
+                    // do not leave the cursor in the activity list
+                    if (now == 0) {
+                        AUTOLOCK(threaded, &workers[w].access);
+                        flows->resumeExport();
+                    }
+                    throw e;
+                }
+                full = NULL;
+            }
+          }
+        }
 
-            flow++;
+        // an export without any flows still produces an (empty) flow record
+        if ((frec == NULL) && (records == 0)) {
+            frec = newFlowRecord(ra, rid, rname, md);
         }
 
-        cnt = 0;
-        for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
-            frec->addData(md[cnt]);
-            cnt++;
+        if (frec != NULL) {
+            sink->putFlowRecord(frec);
         }
     } else {
         MetricData *md;
+        FlowRecord *frec = new FlowRecord(rid, rname);
+
+        {
+            AUTOLOCK(threaded, &maccess);
 
-        // fetch flow data from registered packet processing modules for this rule
-        for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
+            // fetch flow data from registered packet processing modules for this rule
+            for (ppactionListIter_t i = ra->actions.begin(); i != ra->actions.end(); i++) {
 
 #ifdef DEBUG
-            log->dlog(ch, "querying processing module '%s' for rule %i", 
-                      i->module->getModName().c_str(), frec->getRuleId());
+                log->dlog(ch, "querying processing module '%s' for rule %i", 
+                          i->module->getModName().c_str(), rid);
 #endif
       
-            // fetch export data from processing module
-            i->mapi->exportData((void* *)&data, &size, i->flowData);
+                // fetch export data from processing module
+                i->mapi->exportData((void* *)&data, &size, i->flowData);
             
-            // store export data into flow record container object
-            md = new MetricData(i->module->getModName(), i->module->getExportLists(), 
-                                NULL, size, data, 0, NULL, ra->newFlow);
-
-            // if requested: reset intermediate flow data using processing module
-            // and reset flow to idle status 
-            if (now > 0) {
-                i->mapi->resetFlowRec(i->flowData);
-            }
-
-            frec->addData(md);
-        }  
+                // store export data into flow record container object
+                md = new MetricData(i->module->getModName(), i->module->getExportLists(), 
+                                    NULL, size, data, 0, NULL, ra->newFlow);
 
-        ra->newFlow = 0;
-    }
-
-    if ((time_t)(ra->lastPkt + ival) <= now) {
-        ra->lastPkt = 0;
-        ra->flowKeyLen = 0;
-    }
+                // if requested: reset intermediate flow data using processing module
+                // and reset flow to idle status 
+                if (now > 0) {
+                    i->mapi->resetFlowRec(i->flowData);
+                }
 
-    return 0;
-}
+                frec->addData(md);
+            }  
 
+            ra->newFlow = 0;
 
-FlowRecord *PacketProcessor::exportRule(int rid, string rname, time_t now, unsigned long ival)
-{
-  FlowRecord *f = new FlowRecord(rid, rname);
+            if ((time_t)(ra->lastPkt + ival) <= now) {
+                ra->lastPkt = 0;
+                ra->flowKeyLen = 0;
+            }
+        }
 
-  exportRule(f, now, ival);
+        sink->putFlowRecord(frec);
+    }
 
-  return f;
+    return 0;
 }
 
 /* ------------------------- ruleTimeout ------------------------- */
@@ -838,28 +1513,34 @@ FlowRecord *PacketProcessor::exportRule(int rid, string rname, time_t now, unsig
 // return 0 (if timeout), 1 (stays idle), >1 (active and no timeout yet)
 unsigned long PacketProcessor::ruleTimeout(int ruleID, unsigned long ival, time_t now)
 {
-    AUTOLOCK(threaded, &maccess);
+    ruleActions_t *ra = &rules[ruleID];
 
-    time_t last = rules[ruleID].lastPkt;
+    if (ra->auto_flows) {
+        for (unsigned int w = 0; w < ra->flows.size(); w++) {
+            AUTOLOCK(threaded, &workers[w].access);
+
+            // only the least recently active flow needs to be checked
+            flowInfo_t *f = ra->flows[w]->getOldestFlow();
 
-    if (last > 0) {
-        ruleActions_t *ra = &rules[ruleID];
+            if (f == NULL) {
+                continue;
+            }
 
-        if (ra->auto_flows) {
             // has any of the auto flows expired? (this is only accurate to +-1s)
-            flowListIter_t f = ra->flows->getFlows()->begin(); 
-            while (f != ra->flows->getFlows()->end()) {
-                if ((time_t)(f->second.lastPkt + ival) <= now) { 
-		  // expired -> export
+            if ((time_t)(f->lastPkt + ival) <= now) { 
+                // expired -> export
 #ifdef DEBUG
-		  log->dlog(ch,"auto flow idle, export: YES");
+                log->dlog(ch,"auto flow idle, export: YES");
 #endif
-                  return 0;
-                }
+                return 0;
+            }
+        }
+    } else {
+        AUTOLOCK(threaded, &maccess);
 
-		f++;
-            }		    
-        } else {
+        time_t last = ra->lastPkt;
+
+        if (last > 0) {
 	  // check if timeout hasn't expired for the rule
 	  if ((time_t)(last + ival) > now) {
             
@@ -938,17 +1619,21 @@ void PacketProcessor::timeout(int rid, int actid, unsigned int tmID)
     ppaction_t *a;
     ruleActions_t *ra;
 
-    AUTOLOCK(threaded, &maccess);
-
     ra = &rules[rid];
 
     if (!ra->auto_flows) {
+        AUTOLOCK(threaded, &maccess);
+
         a = &ra->actions[actid];
         a->mapi->timeout(tmID, a->flowData);
     } else {       
-        for (flowListIter_t f = ra->flows->getFlows()->begin(); f != ra->flows->getFlows()->end(); ++f) {
-            a = &f->second.actions[actid];
-            a->mapi->timeout(tmID, a->flowData);
+        for (unsigned int w = 0; w < ra->flows.size(); w++) {
+            AUTOLOCK(threaded, &workers[w].access);
+
+            for (flowInfo_t *f = ra->flows[w]->getOldestFlow(); f != NULL; f = f->next) {
+                a = &f->actions[actid];
+                a->mapi->timeout(tmID, a->flowData);
+            }
         }
     }
 }
@@ -45,13 +45,48 @@
 
 
 
+//! how a field is stored in an auto flow key
+typedef enum
+{
+    KF_PLAIN = 0,
+    KF_STRING,  //!< value followed by a terminating 0
+    KF_BINARY   //!< value preceded by its length
+} keyFieldType_t;
+
+/*! \short   extraction step for one field of an auto flow key
+
+    compiled from the rule's filter list when the rule is added, so building
+    a flow key does not need to look at the filter definitions
+*/
+typedef struct {
+    keyFieldType_t type;
+    //! position of the field in forward and reverse direction
+    refer_t refer, rrefer;
+    unsigned short offs, roffs;
+    unsigned short len;
+    //! position of the value in the key
+    unsigned short koffs;
+    //! field holding the value of the reverse direction (-1 if none)
+    short rfield;
+    //! shift for single byte fields (from filter definition mask)
+    unsigned char shift;
+    //! 1 if mask has all bits set
+    unsigned char full;
+    //! filter definition mask and rule mask combined
+    unsigned char mask[MAX_FILTER_LEN];
+} keyField_t;
+
+typedef vector<keyField_t>            keyProg_t;
+
+
 typedef struct {
     /*! time stamp of last packet seen for the packet flow of this task
          =0 indicates the flow was set to idle previously
+         (not used for auto flow rules, their flows are kept in order of activity)
      */
     time_t lastPkt;
 
-    //! number of packets and bytes seen by this rule/task
+    //! number of packets and bytes seen by this rule/task (not for auto flow rules)
     unsigned long long packets, bytes;
 
     // master list of action module data
@@ -73,16 +108,53 @@ typedef struct {
     unsigned short flowKeyLen;
     // pointer to filter list from rule description
     filterList_t *flist;
-
-    // hash map with flows
-    FlowCreator *flows;
+    // flow key extraction (auto flows only)
+    keyProg_t keyProg;
+    // 1 if bidir flow keys are stored in canonical endpoint order
+    int symmetric;
+    // 1 if all action modules process packets in batches (auto flows only)
+    int batch;
+
+    // hash maps with flows (one per worker)
+    vector<FlowCreator *> flows;
 } ruleActions_t;
 
+//! maximum number of packet processing workers
+const int MAX_WORKERS = 64;
+
+//! maximum number of packets taken from a worker's queue at once
+const int PROC_BATCH = 64;
+
 //! action list for each rule
 typedef vector<ruleActions_t>            ruleActionList_t;
 typedef vector<ruleActions_t>::iterator  ruleActionListIter_t;
 
 
+class PacketProcessor;
+
+/*! \short   packet processing worker
+
+    each worker reads packets from its own queue and keeps the flows of 
+    all auto flow rules it sees packets for in its own flow tables
+*/
+typedef struct {
+    PacketProcessor *proc;
+    int id;
+
+    //! packet queue to read packets from
+    PacketQueue *queue;
+
+#ifdef ENABLE_THREADS
+    thread_t thread;
+    //! protects the flow tables of the worker
+    mutex_t access;
+#endif
+
+    //! rules processed in batches seen in the current batch of packets
+    vector<unsigned int> batchRules;
+} procWorker_t;
+
+
 /*! \short   manage and apply Action Modules, retrieve flow data
 
     the PacketProcessor class allows to manage filter rules and their
@@ -103,17 +175,99 @@ class PacketProcessor : public MeterComponent
     //! action list for rules
     ruleActionList_t  rules;
 
-    //! packet queue to read packets from
-    PacketQueue *queue;
+    //! number of packet processing workers
+    int numWorkers;
+
+    //! 1 if the threads of workers 1..numWorkers-1 are running
+    int workersRunning;
+
+    //! packet processing workers (worker 0 runs in the component's thread)
+    procWorker_t *workers;
 
     //! reference to exporter
     Exporter *expt;
 
+    //! max number of flows in one flow record of an export (0 = no limit)
+    int maxExportFlows;
+
+    //! create a flow record with empty data containers md for all actions of a rule
+    FlowRecord *newFlowRecord(ruleActions_t *ra, int rid, string rname, MetricData **md);
+
+    //! lock the flow tables of all workers (before locking maccess)
+    void lockWorkers();
+
+    //! unlock the flow tables of all workers
+    void unlockWorkers();
+
+    //! process the packets in the queue of a worker
+    int processQueue(int worker);
+
+    /*! \short   apply the actions of the rules matched by a packet
+        \arg \c skipBatch  1 = leave out rules that are processed in batches
+        (the caller holds the lock of the worker)
+    */
+    void processRules(metaData_t *meta, int worker, int skipBatch);
+
+    /*! \short   process a batch of packets taken from the queue of a worker
+
+        rules whose action modules all support batches are applied to all
+        packets of the batch at once, one module call per action
+    */
+    void processBatch(metaData_t **metas, int num, int worker);
+
+    /*! \short   find or create the auto flow of a packet
+        (sets meta->reverse for bidir rules)
+        \arg \c clreverse  direction of the packet according to the classifier
+    */
+    flowInfo_t *lookupFlow(ruleActions_t *ra, metaData_t *meta, int worker, 
+                           int clreverse);
+
+    //! thread function of the workers other than worker 0
+    static void *workerThread(void *arg);
+
+    //! create the module configuration and flow record of a rule's action
+    int initRuleRec(ppaction_t *a);
+
+    /*! \short   destroy the flow record and configuration created by initRuleRec
+        (after the auto flows of the rule, they use the configuration)
+    */
+    void destroyRuleRec(ppaction_t *a);
+
     //! add timer events to scheduler
     void addTimerEvents( int ruleID, int actID, ppaction_t &act, EventScheduler &es );
 
     void createFlowKey(unsigned char *mvalues, unsigned short len, ruleActions_t *ra);
 
+    /*! \short   compile the flow key extraction for the filters of a rule
+        \returns 1 if the reverse key is a permutation of the fields of 
+                 the forward key (keys can be stored in canonical order)
+    */
+    static int compileKey(filterList_t *flist, keyProg_t &prog);
+
+    /*! \short   make sure the flows of an auto flow rule are not split across workers
+
+        The classifier distributes packets by their source and destination
+        address, so with several workers the flow key must contain both
+        addresses unmasked.
+        \throws Error if the rule's flow key lacks one of them
+    */
+    void checkWorkerKey(Rule *r);
+
+    //! get the reverse of a flow key by swapping the fields with their reverse fields
+    static inline void swapKey(keyProg_t &prog, const unsigned char *key, 
+                               unsigned char *rkey, int len);
+
+    //! get the key of a flow in the direction of its first packet
+    inline const unsigned char *exportKey(ruleActions_t *ra, flowInfo_t *fi, 
+                                          unsigned char *buf);
+
+    /*! \short   build the flow key of a packet
+        \arg \c reverse  1 = build the key for the reverse direction
+        \returns length of the key
+    */
+    static inline int buildKey(keyProg_t &prog, metaData_t *meta, 
+                               unsigned char *key, int reverse);
+
   public:
 
     /*! \short   construct and initialize a PacketProcessor object
@@ -127,8 +281,17 @@ class PacketProcessor : public MeterComponent
     //!   destroy a PacketProcessor object, to be overloaded
     virtual ~PacketProcessor();
 
-    //! get a link to the packet queue owned by the PacketProcessor
-    PacketQueue *getQueue() { return queue; }
+    //! get a link to the packet queue of a worker
+    PacketQueue *getQueue(int worker = 0) { return workers[worker].queue; }
+
+    //! get the number of packet processing workers
+    int getNumWorkers() { return numWorkers; }
+
+    //! start the worker threads (if threaded)
+    virtual void run();
+
+    //! stop the worker threads
+    virtual void stop();
 
     //! check a ruleset (the action part)
     virtual void checkRules( ruleDB_t *rules );
@@ -159,9 +322,10 @@ class PacketProcessor : public MeterComponent
         lookup actions and flow data associated with the flow indicated by
         RuleID and apply these actions successively upon the packet data
         \arg \c packet  - packet meta data (including matched rules)
+        \arg \c worker  - worker whose flow tables are used
         \returns 0 - on success, <0 - else
     */
-    int processPacket(metaData_t *packet);
+    int processPacket(metaData_t *packet, int worker = 0);
 
     //! handle file descriptor event
     virtual int handleFDEvent(eventVec_t *e, fd_set *rset, fd_set *wset, fd_sets_t *fds);
@@ -171,14 +335,22 @@ class PacketProcessor : public MeterComponent
 
     /*! \short   export measurement data for a given rule
 
-        \arg \c res - location data container object of type FlowRecord which stores all the data
-        \ arg \c now - if now>0 only idle flows are exported and reset
+        the flows are put into flow records of at most maxExportFlows
+        flows, each record is handed to the sink before the next one is
+        built. Meanwhile the flow table is unlocked so that its worker
+        keeps processing packets, and a cursor in the table's activity
+        list marks where the export goes on. Nothing else may walk the
+        activity list (timeout, ruleTimeout, delRule, deleting the table)
+        before the export is resumed; these run in the meter thread like
+        exportRule, which never returns with a suspended export.
+
+        \arg \c sink - receives the flow records
+        \arg \c rid - rule id
+        \arg \c rname - rule name
+        \arg \c now - if now>0 only idle flows are exported and reset
         \returns 0 - on success, <0 - else
     */
-    int exportRule( FlowRecord *res, time_t now=0, unsigned long ival=0 );
-
-    // exports rule into flow record (the above function is deprecated should not be used)
-    FlowRecord *exportRule(int rid, string rname, time_t now=0, unsigned long ival=0);
+    int exportRule( FlowRecordSink *sink, int rid, string rname, time_t now=0, unsigned long ival=0 );
 
     /*! \short return -1 (no packet seen), 0 (timeout), >0 (no timeout; adjust last time)
 
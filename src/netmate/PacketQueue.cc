@@ -34,10 +34,13 @@
 Logger* PacketQueue::s_log = NULL;
 int     PacketQueue::s_ch = -1;
 
+//! number of polls before the reader sleeps on an empty lock-free queue
+const int READER_SPIN = 100;
+
 
 PacketQueue::PacketQueue( int maxBufs, int thr,
-                          int guaranteedBuf, int avgBufSize ) 
-    : threaded(thr)
+                          int guaranteedBuf, int avgBufSize, int lf ) 
+    : threaded(thr), lockFree(thr && lf), readerWaiting(0)
 {
     if (s_log == NULL) {
         s_log = Logger::getInstance();
@@ -59,8 +62,13 @@ PacketQueue::PacketQueue( int maxBufs, int thr,
                maxMemory);
     s_log->log(s_ch, "each buffer request gives access to %d"
                " bytes of linear memory", guardBufLen);
+    if (lockFree) {
+        s_log->log(s_ch, "using lock-free queue");
+    }
     
     droppedPackets = 0;
+    batchBuffers = 0;
+    batchUsed = batchUsedMem = 0;
 
     // try to reserve the ring buffer memory
     rawData = new char[maxMemory];
@@ -130,6 +138,9 @@ PacketQueue::~PacketQueue()
 
 int PacketQueue::clearQueue()
 {
+    inBufs = outBufs = 0;
+    inMem = outMem = 0;
+    readableBufs = 0;
     freeBuffers = maxBuffers;
     freeMemory = maxMemory;
     endData = rawData + maxMemory;
@@ -141,10 +152,106 @@ int PacketQueue::clearQueue()
 }
 
 
-int PacketQueue::getBufferSpace( char **buf )
+void PacketQueue::updateFreeSpace()
+{
+    AUTOLOCK(threaded && !lockFree, &maccess);
+
+    // the reader counters only grow, so stale values are on the safe side
+    freeBuffers = maxBuffers - (int) (inBufs - outBufs);
+    freeMemory = maxMemory - (int) (inMem - outMem);
+
+    // do not write into buffers before the reader is done with them
+    memoryBarrier();
+}
+
+
+void PacketQueue::publish( int bufs, int mem )
 {
+    if (lockFree) {
+        // the packets must be visible before the counters are
+        memoryBarrier();
+        inMem += mem;
+        inBufs += bufs;
+        memoryBarrier();
+
+#ifdef ENABLE_THREADS
+        // either the reader sees the new counters or we see it waiting
+        if (readerWaiting) {
+            mutexLock(&maccess);
+            threadCondSignal(&freeBufCond);
+            mutexUnlock(&maccess);
+        }
+#endif
+        return;
+    }
+
     AUTOLOCK(threaded, &maccess);
 
+    inMem += mem;
+    inBufs += bufs;
+
+#ifdef ENABLE_THREADS
+    // if the queue was empty before
+    if (threaded && getUsedBuffers() == bufs) {
+        threadCondSignal(&freeBufCond);
+    }
+#endif
+}
+
+
+int PacketQueue::readable()
+{
+    if (!lockFree) {
+        return (int) (inBufs - outBufs);
+    }
+
+    // only look at the writer counters if all known buffers are read
+    if (readableBufs == outBufs) {
+        readableBufs = inBufs;
+        memoryBarrier();
+    }
+
+    return (int) (readableBufs - outBufs);
+}
+
+
+void PacketQueue::waitReadable()
+{
+#ifdef ENABLE_THREADS
+    if (lockFree) {
+        // the writer is usually just a few packets ahead, so poll a bit
+        // before going to sleep
+        for (int i = 0; i < READER_SPIN; i++) {
+            if (readable() > 0) {
+                return;
+            }
+            sched_yield();
+        }
+
+        mutexLock(&maccess);
+        readerWaiting = 1;
+        memoryBarrier();
+        while (readable() == 0) {
+            threadCondWait(&freeBufCond, &maccess);
+        }
+        readerWaiting = 0;
+        mutexUnlock(&maccess);
+    } else {
+        // called with maccess held
+        while (readable() == 0) {
+            threadCondWait(&freeBufCond, &maccess);
+        }
+    }
+#endif
+}
+
+
+int PacketQueue::getBufferSpace( char **buf )
+{
+    if (freeBuffers == 0 || freeMemory < guardBufLen) {
+        updateFreeSpace();
+    }
+
     if (freeBuffers == 0 || freeMemory < guardBufLen) {
         droppedPackets++;
         *buf = NULL;
@@ -155,15 +262,29 @@ int PacketQueue::getBufferSpace( char **buf )
     return 0;
 }
 
+
+void PacketQueue::waitBufferSpace( char **buf )
+{
+    updateFreeSpace();
+
+    while (freeBuffers == 0 || freeMemory < guardBufLen) {
+        sched_yield();
+        updateFreeSpace();
+    }
+
+    *buf = curData;
+}
+
 int PacketQueue::setBufferOccupied( int len )
 {
-    AUTOLOCK(threaded, &maccess);
+    int mem = len;
 
     if (len <= 0 || len > guardBufLen || 
         freeBuffers == 0 || freeMemory < len) {
         return -1;
     }
 
+    // the buffer is not seen by the reader before publish
     bufRecs[nextInBuf].pos = curData;
     bufRecs[nextInBuf].len = len;
 
@@ -177,7 +298,6 @@ int PacketQueue::setBufferOccupied( int len )
         nextInBuf = 0;
     }
 
-    freeMemory -= len;
     curData += len;
 
     // check if we _cannot_ guarantee guardBufLen bytes until end of 
@@ -185,10 +305,11 @@ int PacketQueue::setBufferOccupied( int len )
 
     if (curData + guardBufLen > endData) {
 
-        freeMemory -= endData - curData;
+        mem += endData - curData;
         curData = rawData;
     }
 
+    freeMemory -= mem;
     freeBuffers--;
 
 #ifdef DEBUG2
@@ -196,22 +317,111 @@ int PacketQueue::setBufferOccupied( int len )
             freeMemory, freeBuffers);
 #endif
 
-#ifdef ENABLE_THREADS
-    // if we go from 0 to 1 packet in the queue
-    if (threaded && getUsedBuffers() == 1) {
-        threadCondSignal(&freeBufCond);
+    publish(1, mem);
+
+    return 0;
+}
+
+
+int PacketQueue::reserveBatch( int maxPkts )
+{
+    updateFreeSpace();
+
+    // n packets need (n + 1) * guardBufLen bytes (see hasBatchSpace), so
+    // a tap reading up to the reserved number never runs out of memory
+    int memPkts = freeMemory / guardBufLen - 1;
+
+    if (freeBuffers == 0 || memPkts <= 0) {
+        droppedPackets++;
+        batchBuffers = 0;
+        return 0;
     }
-#endif
+
+    batchBuffers = (freeBuffers < maxPkts) ? freeBuffers : maxPkts;
+    if (batchBuffers > memPkts) {
+        batchBuffers = memPkts;
+    }
+    batchUsed = 0;
+    batchUsedMem = 0;
+
+    return batchBuffers;
+}
+
+
+char *PacketQueue::getBatchBuffer()
+{
+    if (batchUsed >= batchBuffers || freeMemory < guardBufLen) {
+        droppedPackets++;
+        return NULL;
+    }
+
+    return curData;
+}
+
+
+int PacketQueue::hasBatchSpace( int n )
+{
+    // each packet takes at most guardBufLen bytes, plus once the rest of
+    // the ring buffer when it wraps around
+    return (batchUsed + n <= batchBuffers) && (freeMemory >= (n + 1) * guardBufLen);
+}
+
+
+int PacketQueue::setBatchBufferOccupied( int len )
+{
+    int mem = len;
+
+    if (len <= 0 || len > guardBufLen || batchUsed >= batchBuffers ||
+        freeMemory < len) {
+        return -1;
+    }
+
+    // slots behind nextInBuf are not seen by the reader before commitBatch
+    bufRecs[nextInBuf].pos = curData;
+    bufRecs[nextInBuf].len = len;
+
+    nextInBuf += 1;
+    if (nextInBuf == maxBuffers) { // wrap around
+        nextInBuf = 0;
+    }
+
+    curData += len;
+
+    // same ring buffer wrap rule as in setBufferOccupied
+    if (curData + guardBufLen > endData) {
+        mem += endData - curData;
+        curData = rawData;
+    }
+
+    freeMemory -= mem;
+    freeBuffers--;
+    batchUsedMem += mem;
+    batchUsed++;
+
     return 0;
 }
 
 
+int PacketQueue::commitBatch()
+{
+    int cnt = batchUsed;
+
+    if (cnt > 0) {
+        publish(cnt, batchUsedMem);
+    }
+
+    batchBuffers = 0;
+    batchUsed = batchUsedMem = 0;
+
+    return cnt;
+}
+
+
 int PacketQueue::readBuffer( char **buf, int *len )
 {
-    AUTOLOCK(threaded, &maccess);
+    AUTOLOCK(threaded && !lockFree, &maccess);
 
-    if (buf == NULL || len == NULL ||
-        freeBuffers == maxBuffers) {
+    if (buf == NULL || len == NULL || readable() == 0) {
         return -1;
     }
 
@@ -224,10 +434,9 @@ int PacketQueue::readBuffer( char **buf, int *len )
 
 int PacketQueue::readBuffer( char **buf, int *len, metaData_t **meta )
 {
-    AUTOLOCK(threaded, &maccess);
+    AUTOLOCK(threaded && !lockFree, &maccess);
 
-    if (buf == NULL || len == NULL || meta == NULL ||
-        freeBuffers == maxBuffers) {
+    if (buf == NULL || len == NULL || meta == NULL || readable() == 0) {
         return -1;
     }
 
@@ -238,7 +447,7 @@ int PacketQueue::readBuffer( char **buf, int *len, metaData_t **meta )
     }
 
     *meta = (metaData_t *) bufRecs[nextOutBuf].pos;
-    *buf = bufRecs[nextOutBuf].pos + sizeof(metaData_t);
+    *buf = (char *) (*meta)->payload;
 
     return 0;
 }
@@ -246,67 +455,106 @@ int PacketQueue::readBuffer( char **buf, int *len, metaData_t **meta )
 
 metaData_t* PacketQueue::readBuffer(int block)
 {
-    AUTOLOCK(threaded, &maccess);
+    AUTOLOCK(threaded && !lockFree, &maccess);
+
+    if (readable() > 0) {
+        return (metaData_t *)bufRecs[nextOutBuf].pos;
+    }
 
 #ifdef ENABLE_THREADS
-    if (block) {     
-        while (getUsedBuffers() == 0) {
-            threadCondWait(&freeBufCond, &maccess);
-        }
+    if (block && threaded) {     
+        waitReadable();
         return (metaData_t *)bufRecs[nextOutBuf].pos;
-    } else {
+    }
 #endif
-        if (getUsedBuffers() > 0) {
-            return (metaData_t *)bufRecs[nextOutBuf].pos;
-        } else {
-            return NULL;
-        }
+
+    return NULL;
+}
+
+
+int PacketQueue::readBuffers( metaData_t **metas, int max, int block )
+{
+    int num, i, pos;
+
+    AUTOLOCK(threaded && !lockFree, &maccess);
+
+    num = readable();
+
 #ifdef ENABLE_THREADS
+    if ((num == 0) && block && threaded) {
+        waitReadable();
+        num = readable();
     }
 #endif
+
+    if (num > max) {
+        num = max;
+    }
+
+    pos = nextOutBuf;
+    for (i = 0; i < num; i++) {
+        metas[i] = (metaData_t *) bufRecs[pos].pos;
+        pos += 1;
+        if (pos == maxBuffers) { // wrap around
+            pos = 0;
+        }
+    }
+
+    return num;
 }
 
 
 int PacketQueue::releaseBuffer()
+{
+    return releaseBuffers(1);
+}
+
+
+int PacketQueue::releaseBuffers( int num )
 {
     char *pos;
-    int len;
+    int len, mem = 0;
 
-    AUTOLOCK(threaded, &maccess);
+    AUTOLOCK(threaded && !lockFree, &maccess);
 
-    if (freeBuffers == maxBuffers) {
+    if (readable() < num) {
         return -1;
     }
 
-    pos = bufRecs[nextOutBuf].pos;
-    len = bufRecs[nextOutBuf].len;
+    for (int i = 0; i < num; i++) {
+        pos = bufRecs[nextOutBuf].pos;
+        len = bufRecs[nextOutBuf].len;
 
 #ifdef DEBUG2
-    fprintf(stderr, "raw data from buffer %d, at position %d, len = %d ",
-            nextOutBuf, (unsigned int) pos - (unsigned int) rawData, len);
+        fprintf(stderr, "raw data from buffer %d, at position %d, len = %d\n",
+                nextOutBuf, (unsigned int) pos - (unsigned int) rawData, len);
 #endif
 
-    freeMemory += len;
-    pos += len;
+        mem += len;
+        pos += len;
 
-    nextOutBuf += 1;
-    if (nextOutBuf == maxBuffers) { // wrap around
-        nextOutBuf = 0;
-    }
+        nextOutBuf += 1;
+        if (nextOutBuf == maxBuffers) { // wrap around
+            nextOutBuf = 0;
+        }
 
-    // check if we had another guardBufLen bytes until end of 
-    // ringbuffer. If not, skip this memory rest
+        // check if we had another guardBufLen bytes until end of 
+        // ringbuffer. If not, skip this memory rest
 
-    if (pos + guardBufLen > endData) {
+        if (pos + guardBufLen > endData) {
 
-    	freeMemory += endData - pos;
+            mem += endData - pos;
+        }
     }
-   
-    freeBuffers++;
-#ifdef DEBUG2
-    fprintf(stderr, "   free mem = %d, free bufs = %d\n",
-            freeMemory, freeBuffers);
-#endif
+
+    if (lockFree) {
+        // we are done with the buffers before the writer may reuse them
+        memoryBarrier();
+    }
+
+    outMem += mem;
+    outBufs += num;
+
     return 0;
 }
 
@@ -314,7 +562,7 @@ int PacketQueue::releaseBuffer()
 
 int PacketQueue::getUsedBuffers()
 {
-    return maxBuffers - freeBuffers;
+    return (int) (inBufs - outBufs);
 }
 
 
@@ -326,7 +574,7 @@ int PacketQueue::getMaxBuffers()
 
 int PacketQueue::getUsedMemory()
 {
-    return maxMemory - freeMemory;
+    return (int) (inMem - outMem);
 }
 
 
@@ -71,34 +71,70 @@ class PacketQueue
     static int s_ch;      //!< logging channel used by objects of this class
 
     int   threaded;       //! flag which tells if threading was configured
+    int   lockFree;       //!< single producer/single consumer mode without locks
     
-    int   freeBuffers;    //!< number of packet buffers still unused
     int   maxBuffers;     //!< maximum number of buffers to be usable by queue
-
-    int   freeMemory;     //!< amount of unused buffer space in bytes
     int   maxMemory;      //!< maximum storage in buffer space in bytes
-
-    int   droppedPackets; //!< number of dropped packets so far
     int   guardBufLen;    //!< guaranteed buffer size for buffer returned by getBufferSpace
 
     char *rawData;    //!< memory space for storage of raw packet data
     char *endData;    //!< pointer to end of storage space + 1
 
-    int   nextInBuf;  //!< position of next free buffer (for incoming packets)
-    int   nextOutBuf; //!< position of next outgoing buffer (oldest packet in queue)
-    char *curData;    //!< current start of unused memory area
-
     /*! array storing (a) start locations of raw data in ring buffer, 
                       (b) packet lengths of raw data (as stored in ring buffer),
                       (c) associated packet meta data records
      */
     PktBufRec_t *bufRecs; 
 
+    /* The writer (classifier) and the reader (packet processor) each own
+       a set of counters on their own cache line. The number of packets
+       and the memory in the queue are the difference of the counters 
+       (which may wrap around). */
+
+    char  pad0[CACHE_LINE_SIZE];
+
+    // written by the writer only
+    volatile unsigned int inBufs; //!< number of buffers handed to the reader
+    volatile unsigned int inMem;  //!< memory handed to the reader (incl. skipped ring buffer ends)
+    int   nextInBuf;  //!< position of next free buffer (for incoming packets)
+    char *curData;    //!< current start of unused memory area
+    int   freeBuffers;    //!< packet buffers known to be unused (lower bound)
+    int   freeMemory;     //!< buffer space known to be unused (lower bound)
+    int   droppedPackets; //!< number of dropped packets so far
+    int   batchBuffers; //!< buffers usable by the batch currently being filled
+    int   batchUsed;    //!< buffers filled so far in the current batch
+    int   batchUsedMem; //!< memory consumed so far by the current batch
+
+    char  pad1[CACHE_LINE_SIZE];
+
+    // written by the reader only
+    volatile unsigned int outBufs; //!< number of buffers released by the reader
+    volatile unsigned int outMem;  //!< memory released by the reader
+    int   nextOutBuf; //!< position of next outgoing buffer (oldest packet in queue)
+    unsigned int readableBufs; //!< inBufs as last seen by the reader
+
+    char  pad2[CACHE_LINE_SIZE];
+
+    //! set by the reader while it sleeps on freeBufCond (lock-free mode)
+    volatile int readerWaiting;
+
 #ifdef ENABLE_THREADS
     mutex_t        maccess;     //!< semaphore for queue access
     thread_cond_t  freeBufCond; //!< condition semaphore for signalling
 #endif
 
+    //! update freeBuffers and freeMemory from the reader counters (writer)
+    void updateFreeSpace();
+
+    //! hand bufs buffers with mem bytes over to the reader (writer)
+    void publish( int bufs, int mem );
+
+    //! number of buffers available to the reader (reader)
+    int readable();
+
+    //! wait until the writer has published new buffers (reader)
+    void waitReadable();
+
   public:
 
     /*! \short  generate a new PacketQueue
@@ -106,10 +142,12 @@ class PacketQueue
         \arg \c maxBuf - maximum number of bytes to use for packet data
         \arg \c guaranteedBuf - size of guaranteed buffer size returned by call to getBufferSpace
         \arg \c avgBufferSize - average number of memory space to reserve for each buffer. A single buffer might hold more data (up to 'guaranteedBuf' bytes) but the queue will only store maxBuf * avgBufSize bytes overall.
+        \arg \c lockFree - if threaded do not lock the queue for every packet, only possible with a single writer and a single reader thread
     */
     PacketQueue( int maxBufs, int threaded = 0,
                  int guaranteedBuf = MIN_QUEUE_BUF,
-                 int avgBufSize = AVG_BUF_DATA  );
+                 int avgBufSize = AVG_BUF_DATA,
+                 int lockFree = 0 );
 
     /*! \short  destroy a packet queue object 
 
@@ -127,6 +165,15 @@ class PacketQueue
     */
     int getBufferSpace( char **buf );
 
+    /*! \short  like getBufferSpace but wait until the reader has freed space
+
+        Only for queues read by another thread. A full queue is not counted
+        as a dropped packet here.
+
+        \arg \c buf - location to store the free memory address into
+    */
+    void waitBufferSpace( char **buf );
+
     /*! \short  mark a portion of the memory area (which has been requested by 
                 a call to getBufferSpace before) as used
 
@@ -138,6 +185,45 @@ class PacketQueue
     */
     int setBufferOccupied( int len );
 
+    /*! \short  reserve queue space for a batch of packets
+
+        Takes a snapshot of the free buffers and memory so that up to 
+        maxPkts packets can be written with getBatchBuffer and 
+        setBatchBufferOccupied without locking the queue for every 
+        packet. The packets become visible to the reader only after 
+        commitBatch. Only the (single) writer of the queue may use this.
+
+        \arg \c maxPkts - maximum number of packets in the batch
+        \returns number of packets that fit into the batch (0 if queue is full)
+    */
+    int reserveBatch( int maxPkts );
+
+    /*! \short  get the buffer for the next packet of the current batch
+
+        \returns buffer with at least getMaxBufSize() bytes or NULL if 
+                 the reserved batch space is exhausted
+    */
+    char *getBatchBuffer();
+
+    /*! \short  test whether n more packets fit into the current batch
+
+        \returns 1 if getBatchBuffer succeeds for n more packets of any size
+    */
+    int hasBatchSpace( int n );
+
+    /*! \short  mark the buffer returned by getBatchBuffer as used 
+
+        \arg \c len - length of the packet which has been stored in the buffer
+        \returns 0 on success, !=0 else
+    */
+    int setBatchBufferOccupied( int len );
+
+    /*! \short  hand all packets of the current batch over to the reader
+
+        \returns number of packets committed
+    */
+    int commitBatch();
+
     /*! \short  get access to the first packet stored in the queue
 
         This function returns pointers for accessing the raw packet data 
@@ -167,6 +253,24 @@ class PacketQueue
     */
     int releaseBuffer();
 
+    /*! \short  get access to the oldest packets stored in the queue at once
+
+        The packets remain in the queue until they are released with
+        releaseBuffers.
+
+        \arg \c metas - array to store the meta data locations into
+        \arg \c max - maximum number of packets to return
+        \arg \c block - wait for packets if the queue is empty (threaded only)
+        \returns number of packets stored in metas
+    */
+    int readBuffers( metaData_t **metas, int max, int block=1 );
+
+    /*! \short  release the num oldest packets in the queue
+
+        \returns 0 on success, !=0 else (less than num packets in queue)
+    */
+    int releaseBuffers( int num );
+
     //!return the number of used buffers, i.e. number of packets in the queue
     int getUsedBuffers();
 
@@ -59,8 +59,8 @@ string ProcModule::INFOLABEL[] =
 /* ------------------------- ProcModule ------------------------- */
 
 ProcModule::ProcModule( string libname, string libfile, 
-                        libHandle_t libhandle ) :
-    Module( libname, libfile, libhandle )
+                        libHandle_t libhandle, builtinSymbol_t *symbols ) :
+    Module( libname, libfile, libhandle, symbols )
 {
     int res;
     
@@ -79,13 +79,25 @@ ProcModule::ProcModule( string libname, string libfile,
  
    setOwnName(libname); // TODO (change): read ownName from module properties XML file
 
-    if (dlsym(libhandle, "exportInfo") == NULL) {
+    if (getSymbol("exportInfo") == NULL) {
         s_log->elog(s_ch, "cannot find 'exportInfo' structure in module '%s'",
                     libname.c_str());
         throw Error("cannot find 'exportInfo' structure in module '%s'",
                     libname.c_str());
     }
 
+    // optional batch processing function
+    batchFunc = (proc_packets_func_t) getSymbol("processPackets");
+
+    builtin = BUILTIN_NONE;
+#ifdef ENABLE_BUILTIN_MODULES
+#define FIND_BUILTIN(m) \
+    if (funcList->processPacket == LTX_NAME(m, processPacket)) { \
+        builtin = BUILTIN_PROC_ ## m; \
+    }
+    BUILTIN_PROC_MODULES(FIND_BUILTIN)
+#endif
+
     res = funcList->initModule();
     if (res != 0) {
         s_log->elog(s_ch, "initialization for module '%s' failed: %s",
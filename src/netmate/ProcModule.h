@@ -38,6 +38,29 @@
 #include "ExportList.h"
 
 
+#ifdef ENABLE_BUILTIN_MODULES
+// processing functions of the modules linked into the meter
+#define DECLARE_PROC(m) \
+    int LTX_NAME(m, processPacket)( char *packet, metaData_t *meta, void *flowdata ); \
+    int LTX_NAME(m, processPackets)( procPacket_t *pkts, int num ) __attribute__((weak));
+extern "C" {
+    BUILTIN_PROC_MODULES(DECLARE_PROC)
+}
+#define BUILTIN_PROC_ID(m)  , BUILTIN_PROC_ ## m
+#else
+#define BUILTIN_PROC_ID(m)
+#endif
+
+//! initFlowRec of modules built for API version 3
+typedef int (*init_flow_rec_v3_func_t)( configParam_t *params, void **flowdata );
+
+//! modules linked into the meter that the packet processor calls directly
+typedef enum {
+    BUILTIN_NONE = 0
+    BUILTIN_PROC_MODULES(BUILTIN_PROC_ID)
+} builtinProc_t;
+
+
 
 /*! \short   container class that stores information about an evaluation module
   
@@ -60,6 +83,12 @@ class ProcModule : public Module
     //! struct of functions pointers for library
     ProcModuleInterface_t *funcList;
 
+    //! batch version of processPacket (NULL if the module has none)
+    proc_packets_func_t batchFunc;
+
+    //! which module linked into the meter this is (BUILTIN_NONE if none)
+    builtinProc_t builtin;
+
     //!< runtime type information list
     typeInfo_t *typeInfo;
 
@@ -102,6 +131,49 @@ class ProcModule : public Module
         return funcList->getModuleInfo(i); 
     }
 
+    //! parse the module parameters of a rule (none before API version 4)
+    int initRuleConfig( configParam_t *params, void **config )
+    {
+        if (funcList->version < 4) {
+            *config = NULL;
+            return 0;
+        }
+        return funcList->initRuleConfig(params, config);
+    }
+
+    //! free the configuration of a rule
+    int destroyRuleConfig( void *config )
+    {
+        return (funcList->version >= 4) ? funcList->destroyRuleConfig(config) : 0;
+    }
+
+    //! initialize a flow record, initFlowRec got no configuration before version 4
+    int initFlowRec( configParam_t *params, void *config, void **flowdata )
+    {
+        if (funcList->version < 4) {
+            return ((init_flow_rec_v3_func_t) funcList->initFlowRec)(params, flowdata);
+        }
+        return funcList->initFlowRec(params, config, flowdata);
+    }
+
+    //! size of flow records allocated by the meter, 0 if the module allocates them
+    int getFlowRecSize()
+    {
+        return (funcList->version >= 4) ? funcList->getFlowRecSize() : 0;
+    }
+
+    //! batch processing function of the module, NULL if not supported
+    proc_packets_func_t getBatchFunc()
+    {
+        return batchFunc;
+    }
+
+    //! module linked into the meter whose functions can be called directly
+    builtinProc_t getBuiltin()
+    {
+        return builtin;
+    }
+
     inline ExportList *getExportLists() 
     { 
         return expList; 
@@ -115,8 +187,10 @@ class ProcModule : public Module
         \arg \c libname - name of the evaluation module 
         \arg \c filename - name of module including path and extension
         \arg \c libhandle - system handle for loaded library (see dlopen)
+        \arg \c symbols - symbol table of a module linked into the meter
     */
-    ProcModule( string libname, string libfile, libHandle_t libhandle );
+    ProcModule( string libname, string libfile, libHandle_t libhandle,
+                builtinSymbol_t *symbols = NULL );
 
     //! destroy a ProcModule object
     ~ProcModule();
@@ -107,6 +107,11 @@ inline int threadCondSignal(thread_cond_t *cond)
 	return pthread_cond_signal(cond);
 }
 
+inline int threadCondBroadcast(thread_cond_t *cond)
+{
+	return pthread_cond_broadcast(cond);
+}
+
 inline int threadCondWait(thread_cond_t *cond, mutex_t *mutex)
 {
 	return pthread_cond_wait(cond, mutex);
@@ -167,4 +172,17 @@ struct autoLock
 #endif // ENABLE_THREADS
 
 
+//! cache line size, data written by different threads is kept apart by this
+const int CACHE_LINE_SIZE = 64;
+
+
+//! full memory barrier for data shared between threads without a mutex
+inline void memoryBarrier()
+{
+#ifdef ENABLE_THREADS
+    __sync_synchronize();
+#endif
+}
+
+
 #endif // _THREADS_H_
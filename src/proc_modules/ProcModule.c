@@ -41,10 +41,23 @@ $Id: ProcModule.c 748 2009-09-10 02:54:03Z szander $
 int magic = PROC_MAGIC;
 
 
+/*! \short   defaults for modules without rule configuration */
+int __attribute__((weak)) initRuleConfig( configParam_t *params, void **config )
+{
+    *config = NULL;
+    return 0;
+}
+
+int __attribute__((weak)) destroyRuleConfig( void *config )
+{
+    return 0;
+}
+
+
 /*! \short   declaration of struct containing all function pointers of a module */
 ProcModuleInterface_t func = 
 { 
-    3, 
+    PROC_API_VERSION, 
     initModule, 
     destroyModule, 
     initFlowRec, 
@@ -56,7 +69,27 @@ ProcModuleInterface_t func =
     exportData, 
     getModuleInfo, 
     getErrorMsg,
-    getTypeInfo };
+    getTypeInfo,
+    getFlowRecSize,
+    initRuleConfig,
+    destroyRuleConfig };
+
+
+#ifdef BUILTIN_MODULE
+
+/* the batch function is optional */
+int processPackets( procPacket_t *pkts, int num ) __attribute__((weak));
+
+/*! \short   symbols the meter looks up in a module linked into it */
+builtinSymbol_t builtinSymbols[] =
+{
+    { "magic", &magic },
+    { "func", &func },
+    { "exportInfo", exportInfo },
+    { "processPackets", (void *) processPackets },
+    { NULL, NULL } };
+
+#endif
 
 
 /*! \short   global state variable used within data export macros */
@@ -43,25 +43,53 @@
 
 
 
+/* a built-in module gets its own copies of the export functions under
+   prefixed names (see BuiltinModule.h), they are plain functions there */
+#ifdef BUILTIN_MODULE
+#define EXPORT_FUNC
+#else
+#define EXPORT_FUNC inline
+#endif
+
 /*! functions for exporting data */
-inline void STARTEXPORT(void *data);
-inline void ENDEXPORT(void **exp, int *len);
-inline void ADD_CHAR(char val);
-inline void ADD_INT8(char val);
-inline void ADD_INT16(short val);
-inline void ADD_INT32(int32_t val);
-inline void ADD_INT64(int64_t val);
-inline void ADD_UINT8(unsigned char val);
-inline void ADD_UINT16(unsigned short val);
-inline void ADD_UINT32(uint32_t val);
-inline void ADD_UINT64(uint64_t val);
-inline void ADD_FLOAT(float val);
-inline void ADD_DOUBLE(double val);
-inline void ADD_IPV4ADDR(unsigned int val);
-inline void ADD_LIST(unsigned int num);
-inline void END_LIST();
-inline void ADD_STRING(char *txt);
-inline void ADD_BINARY(unsigned int size, char *src);
+EXPORT_FUNC void STARTEXPORT(void *data);
+EXPORT_FUNC void ENDEXPORT(void **exp, int *len);
+EXPORT_FUNC void ADD_CHAR(char val);
+EXPORT_FUNC void ADD_INT8(char val);
+EXPORT_FUNC void ADD_INT16(short val);
+EXPORT_FUNC void ADD_INT32(int32_t val);
+EXPORT_FUNC void ADD_INT64(int64_t val);
+EXPORT_FUNC void ADD_UINT8(unsigned char val);
+EXPORT_FUNC void ADD_UINT16(unsigned short val);
+EXPORT_FUNC void ADD_UINT32(uint32_t val);
+EXPORT_FUNC void ADD_UINT64(uint64_t val);
+EXPORT_FUNC void ADD_FLOAT(float val);
+EXPORT_FUNC void ADD_DOUBLE(double val);
+EXPORT_FUNC void ADD_IPV4ADDR(unsigned int val);
+EXPORT_FUNC void ADD_LIST(unsigned int num);
+EXPORT_FUNC void END_LIST();
+EXPORT_FUNC void ADD_STRING(char *txt);
+EXPORT_FUNC void ADD_BINARY(unsigned int size, char *src);
+
+
+/*! \short   apply account( flowdata, meta ) to a batch of packets (for
+             processPackets), the flow records of packets PREFETCH_AHEAD
+             ahead in the batch are prefetched meanwhile
+*/
+#define PREFETCH_AHEAD 4
+
+static inline void processBatch( procPacket_t *pkts, int num,
+                                 void (*account)( void *flowdata, metaData_t *meta ) )
+{
+    int i;
+
+    for (i = 0; i < num; i++) {
+        if (i + PREFETCH_AHEAD < num) {
+            __builtin_prefetch(pkts[i + PREFETCH_AHEAD].flowdata, 1);
+        }
+        account(pkts[i].flowdata, pkts[i].meta);
+    }
+}
 
 
 /*! \short   declaration of struct containing all function pointers of a module */
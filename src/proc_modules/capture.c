@@ -171,7 +171,13 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
 /*
   initialize per-rule flow data for newly added rule
 */
-int initFlowRec( configParam_t *params, void **flowdata )
+int getFlowRecSize()
+{
+    /* records are allocated by the module */
+    return 0;
+}
+
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
 {
     struct moduleData *data;
     struct pcap_file_header *hdr; 
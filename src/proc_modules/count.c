@@ -50,7 +50,7 @@ struct accData_t {
     struct timeval last;
 };
 
-struct timeval zerotime = {0,0};
+static struct timeval zerotime = {0,0};
 
 
 int initModule()
@@ -65,7 +65,7 @@ int destroyModule()
     return 0;
 }
 
-int processPacket( char *packet, metaData_t *meta, void *flowdata )
+static inline void account( void *flowdata, metaData_t *meta )
 {
     struct accData_t *data = flowdata;
 
@@ -79,24 +79,32 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
 
     data->packets += 1;
     data->bytes   += meta->len;
+}
+
+int processPacket( char *packet, metaData_t *meta, void *flowdata )
+{
+    account(flowdata, meta);
 
     return 0;
 }
 
-
-int initFlowRec( configParam_t *params, void **flowdata )
+int processPackets( procPacket_t *pkts, int num )
 {
-    struct accData_t *data;
+    processBatch(pkts, num, account);
 
-    data = malloc( sizeof(struct accData_t) );
+    return 0;
+}
 
-    if (data == NULL ) {
-        return -1;
-    }
 
-    resetFlowRec( data );
+int getFlowRecSize()
+{
+    return sizeof(struct accData_t);
+}
+
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
+{
+    resetFlowRec( *flowdata );
 
-    *flowdata = data;
     return 0;
 }
 
@@ -128,8 +136,6 @@ int destroyFlowRec( void *flowdata )
       data->bytes );
     */
 
-    free(flowdata);
-    
     return 0;
 }
 
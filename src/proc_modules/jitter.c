@@ -123,15 +123,14 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
 /*
   initialize per-rule flow data for newly added rule
 */
-int initFlowRec( configParam_t *params, void **flowdata )
+int getFlowRecSize()
 {
-    flowdata_t *data;
-  
-    data = (flowdata_t*) malloc( sizeof(flowdata_t) );
+    return sizeof(flowdata_t);
+}
 
-    if (data == NULL ) {
-        return -1;
-    }
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
+{
+    flowdata_t *data = *flowdata;
 
     data->first_tstamp = 0;
     data->last_tstamp = 0;
@@ -141,7 +140,6 @@ int initFlowRec( configParam_t *params, void **flowdata )
     data->sum = 0;
     data->sqr_sum = 0;
 
-    *flowdata = data;
     return 0;
 }
 
@@ -151,8 +149,7 @@ int initFlowRec( configParam_t *params, void **flowdata )
 */
 int destroyFlowRec( void *flowdata )
 {
-    
-    free( flowdata );
+
     return 0;
 }
 
@@ -35,6 +35,7 @@ $Id: netai_flowstats.c 18 2006-01-23 01:43:50Z szander $
 
 #include "config.h"
 #include <stdio.h>
+#include <stddef.h>
 #include "ProcModule.h"
 #include <sys/types.h>
 #include <arpa/inet.h>
@@ -85,9 +86,9 @@ typeInfo_t exportInfo[] = {
 };
 
 
-const unsigned long long DEF_MIN_DURATION = 0ULL; // min duration in usecs
-const unsigned long long DEF_TIME_CAP = 0xFFFFFFFFFFFFFFFFULL; // ignore further packets after
-const unsigned long long DEF_IDLE_THRESHOLD = 62000000ULL; // in usecs (62s)
+static const unsigned long long DEF_MIN_DURATION = 0ULL; // min duration in usecs
+static const unsigned long long DEF_TIME_CAP = 0xFFFFFFFFFFFFFFFFULL; // ignore further packets after
+static const unsigned long long DEF_IDLE_THRESHOLD = 62000000ULL; // in usecs (62s)
 
 /* stuff for TCP connection tracking */
 
@@ -111,11 +112,19 @@ typedef enum {
 } tcp_state_t;
 
 
-int isSet(int bit, int test)
+static int isSet(int bit, int test)
 {
   return ((bit & test) == bit);
 }
 
+/* parameters of a rule, shared by all its flows */
+
+struct flowConfig_t {
+  uint64_t idle_threshold;
+  uint64_t min_duration;
+  uint64_t time_cap;
+};
+
 /* our main data structure */
 
 struct flowData_t {
@@ -183,10 +192,8 @@ struct flowData_t {
   uint32_t total_fhlen;
   uint32_t total_bhlen;
 
-  uint64_t idle_threshold;
-  uint64_t min_duration;
-
-  uint64_t time_cap;
+  /* everything from here on is kept on reset */
+  struct flowConfig_t *conf;
 };
 
 
@@ -205,7 +212,7 @@ int destroyModule()
 
 
 // get the timestamp of the last packet (which is either a forward pkt or a backward pkt)
-unsigned long long getLast(struct flowData_t *data)
+static unsigned long long getLast(struct flowData_t *data)
 {
   if (data->blast == 0ULL) {
     return data->flast;
@@ -218,7 +225,7 @@ unsigned long long getLast(struct flowData_t *data)
 
 
 /* dir is the direction of state, pdir is the direction of the packet */
-int updateState(tcp_state_t *state, int flags, int dir, int pdir)
+static int updateState(tcp_state_t *state, int flags, int dir, int pdir)
 {
   if (isSet(TCP_RST, flags)) {
     *state = STATE_CLOSED;
@@ -332,13 +339,13 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
       }
       
       // hacked for time cap (counters won't be increased after time cap
-      if (data->tcp_has_data && ( ((now - data->first) > data->time_cap) || ((data->fpackets > 0) && (data->bpackets > 0)) )) {
+      if (data->tcp_has_data && ( ((now - data->first) > data->conf->time_cap) || ((data->fpackets > 0) && (data->bpackets > 0)) )) {
         data->valid++;
       }
     }
     
     /* don't compute after time cap */
-    if ((data->first == 0) || ((now - data->first) <= data->time_cap)) {
+    if ((data->first == 0) || ((now - data->first) <= data->conf->time_cap)) {
       
       if (isSet(TCP_PSH, flags)) {
         if (meta->reverse == 0) {
@@ -369,7 +376,7 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
   } 
   
   /* must do this after valid check! */ 
-  if ((data->first > 0) && ((now - data->first) > data->time_cap)) {
+  if ((data->first > 0) && ((now - data->first) > data->conf->time_cap)) {
     /* ignore rest of the packets after time cap */
     goto exit;
   }
@@ -381,7 +388,7 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
   } else {
     /* check isub flow timeout */
     diff = now - getLast(data);
-    if ( diff > data->idle_threshold) {
+    if ( diff > data->conf->idle_threshold) {
       /* idle time */
       if (diff > data->max_idle) {
         data->max_idle = diff;
@@ -488,40 +495,61 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
 }
 
 
-int initFlowRec( configParam_t *params, void **flowdata )
+int initRuleConfig( configParam_t *params, void **config )
 {
-  struct flowData_t *data;
+  struct flowConfig_t *conf;
   
-  data = malloc( sizeof(struct flowData_t) );
+  conf = malloc( sizeof(struct flowConfig_t) );
   
-  if (data == NULL ) {
+  if (conf == NULL ) {
     return -1;
   }
   
-  resetFlowRec( data );
-  
-  data->idle_threshold = DEF_IDLE_THRESHOLD;
-  data->min_duration = DEF_MIN_DURATION;
-  data->time_cap = DEF_TIME_CAP;
+  conf->idle_threshold = DEF_IDLE_THRESHOLD;
+  conf->min_duration = DEF_MIN_DURATION;
+  conf->time_cap = DEF_TIME_CAP;
   
   while (params->name != NULL) {
     if (!strcmp(params->name, "Idle_Threshold")) {
-      data->idle_threshold = atoll(params->value);
-      /* fprintf(stdout, "flowstats module: using %lldus idle threshold\n", data->idle_threshold); */
+      conf->idle_threshold = atoll(params->value);
+      /* fprintf(stdout, "flowstats module: using %lldus idle threshold\n", conf->idle_threshold); */
     }
     else if (!strcmp(params->name, "Min_Duration")) {
-      data->min_duration = atoll(params->value);
-      /* fprintf(stdout, "flowstats module: using %lldus min duration\n", data->min_duration); */
+      conf->min_duration = atoll(params->value);
+      /* fprintf(stdout, "flowstats module: using %lldus min duration\n", conf->min_duration); */
     }
     else if (!strcmp(params->name, "Time_Cap")) {
-      data->time_cap = atoll(params->value);
-      /* fprintf(stdout, "flowstats module: using %lldus time cap\n", data->time_cap); */
+      conf->time_cap = atoll(params->value);
+      /* fprintf(stdout, "flowstats module: using %lldus time cap\n", conf->time_cap); */
     }
     
     params++;
   }
   
-  *flowdata = data;
+  *config = conf;
+  return 0;
+}
+
+int destroyRuleConfig( void *config )
+{
+  free(config);
+  
+  return 0;
+}
+
+int getFlowRecSize()
+{
+  return sizeof(struct flowData_t);
+}
+
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
+{
+  struct flowData_t *data = *flowdata;
+  
+  /* parameters were parsed by initRuleConfig */
+  data->conf = config;
+  resetFlowRec( data );
+  
   return 0;
 }
 
@@ -534,8 +562,8 @@ int resetFlowRec( void *flowdata )
     return -1;
   }
   
-  /* reset everything to 0 except the last 3 configuration parameters (bit hacky) */
-  memset(data, 0, sizeof(struct flowData_t) - sizeof(unsigned long long)*3);
+  /* reset everything to 0 except the configuration */
+  memset(data, 0, offsetof(struct flowData_t, conf));
   
   return 0;
 }
@@ -543,16 +571,13 @@ int resetFlowRec( void *flowdata )
 
 int destroyFlowRec( void *flowdata )
 {
-  struct flowData_t *data = (struct flowData_t*) flowdata;
-  
-  free(data);
   
   return 0;
 }
 
 
 /* compute standard deviation based on sum and square sum and number of elements */
-double stddev(double sqsum, double sum, unsigned long n)
+static double stddev(double sqsum, double sum, unsigned long n)
 {
   return (unsigned long) sqrt((sqsum - (sum*sum/n))/(n - 1));
 }
@@ -570,7 +595,7 @@ int exportData( void **exp, int *len, void *flowdata )
     goto exit;
   }
   
-  if ( ((unsigned long long) getLast(data) - data->first) < data->min_duration) {
+  if ( ((unsigned long long) getLast(data) - data->first) < data->conf->min_duration) {
     goto exit;
   }
   //if (data->fpackets > 1.0) printf("%d ", data->fpackets);
@@ -663,7 +688,7 @@ int exportData( void **exp, int *len, void *flowdata )
   ADD_UINT64( (data->activep < 2) ? 0LL : (unsigned long long) stddev(data->active_sqsum, data->activet, data->activep) );
   
   if (data->idlep > 0) {
-    assert((data->idlet/data->idlep) >= data->idle_threshold);
+    assert((data->idlet/data->idlep) >= data->conf->idle_threshold);
   }
   
   ADD_UINT64( data->min_idle );
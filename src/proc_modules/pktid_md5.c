@@ -235,7 +235,13 @@ int processPacket(char *packet, metaData_t *meta, void *flowdata )
 }
 
 
-int initFlowRec( configParam_t *params, void **flowdata )
+int getFlowRecSize()
+{
+    /* records are allocated by the module */
+    return 0;
+}
+
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
 {
     struct moduleData *data;
 
@@ -60,9 +60,9 @@ int destroyModule()
 }
 
 
-int processPacket( char *packet, metaData_t *meta, void *flowdata )
+static inline void account( void *flowdata, metaData_t *meta )
 {
-    struct moduleData *data = (struct moduleData*) flowdata;
+    struct moduleData *data = flowdata;
     unsigned short len;
 
     len = meta->len;
@@ -81,26 +81,35 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
 
     data->packets += 1;
     data->bytes += len;
+}
+
+int processPacket( char *packet, metaData_t *meta, void *flowdata )
+{
+    account(flowdata, meta);
 
     return 0;
 }
 
-int initFlowRec( configParam_t *params, void **flowdata )
+int processPackets( procPacket_t *pkts, int num )
 {
-    struct moduleData *data;
+    processBatch(pkts, num, account);
 
-    data = (struct moduleData*) malloc( sizeof( struct moduleData ) );
+    return 0;
+}
 
-    if (data == NULL ) {
-        return -1;
-    }
+int getFlowRecSize()
+{
+    return sizeof(struct moduleData);
+}
+
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
+{
+    struct moduleData *data = *flowdata;
 
     data->packets = 0;
     data->bytes = 0;
     data->min = 0;
     data->max = 0;
-    
-    *flowdata = data;
 
     return 0;
 }
@@ -113,9 +122,7 @@ int resetFlowRec( void *flowdata )
 
 int destroyFlowRec( void *flowdata )
 {
-   
-    free( flowdata );
-   
+
     return 0;
 }
 
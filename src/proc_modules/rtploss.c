@@ -222,20 +222,18 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
     return 0;
 }
 
-int initFlowRec( configParam_t *params, void **flowdata )
+int getFlowRecSize()
 {
-    struct rtpData *data;
-
-    data = malloc( sizeof( struct rtpData ) );
+    return sizeof(struct rtpData);
+}
 
-    if (data == NULL ) {
-        return -1;
-    }
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
+{
+    struct rtpData *data = *flowdata;
 
     memset( data, 0, sizeof(*data) );
     data->probation = 1;
 
-    *flowdata = data;
     return 0;
 }
 
@@ -248,8 +246,6 @@ int resetFlowRec( void *flowdata )
 
 int destroyFlowRec( void *flowdata )
 {
-   
-    free( flowdata );
 
     return 0;
 }
@@ -170,7 +170,13 @@ int processPacket( char *packet, metaData_t *meta, void *flowdata )
 	return 0;
 }
 
-int initFlowRec( configParam_t *params, void **flowdata )
+int getFlowRecSize()
+{
+    /* records are allocated by the module */
+    return 0;
+}
+
+int initFlowRec( configParam_t *params, void *config, void **flowdata )
 {
     struct moduleData *data;
 
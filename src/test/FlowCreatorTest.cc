@@ -0,0 +1,174 @@
+#include "stdincpp.h"
+#include "Error.h"
+#include "Logger.h"
+#include "FlowCreator.h"
+
+#define FLOWS 20000
+#define LONGKEY 64      // longer than FLOW_KEY_INLINE
+#define COLLISIONS 200
+#define SHARDS 3
+
+
+static int errors = 0;
+
+#define CHECK(cond, ...) \
+    if (!(cond)) { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); errors++; }
+
+
+/* keys look like a 5 tuple, every 10th key is longer than the inline
+   key buffer of a flow */
+
+static int makeKey( unsigned char *key, unsigned int i )
+{
+    int len = ((i % 10) == 0) ? LONGKEY : 13;
+
+    memset(key, 0, len);
+    memcpy(key, &i, sizeof(i));
+    key[len-1] = (unsigned char) i;
+
+    return len;
+}
+
+
+/* insert enough flows to resize the table many times, delete and
+   re-insert half of them */
+
+static void testInsertDelete()
+{
+    FlowCreator fc;
+    flowInfo_t **flows = new flowInfo_t*[FLOWS];
+    unsigned char key[LONGKEY];
+    set<unsigned long long> ids;
+    int len;
+
+    for (unsigned int i = 0; i < FLOWS; i++) {
+	len = makeKey(key, i);
+	CHECK(fc.getFlow(key, len) == NULL, "flow %u found before insert", i);
+	flows[i] = fc.addFlow(key, len);
+	CHECK(flows[i]->len == len && memcmp(flows[i]->keyData, key, len) == 0,
+	      "flow %u: wrong key", i);
+	CHECK(ids.insert(flows[i]->flowId).second, "flow %u: duplicate id", i);
+    }
+    CHECK(fc.getNumFlows() == FLOWS, "%u flows after insert", fc.getNumFlows());
+
+    // all flows are still found after the table has grown
+    for (unsigned int i = 0; i < FLOWS; i++) {
+	len = makeKey(key, i);
+	CHECK(fc.getFlow(key, len) == flows[i], "flow %u not found", i);
+    }
+    len = makeKey(key, FLOWS);
+    CHECK(fc.getFlow(key, len) == NULL, "unknown flow found");
+
+    for (unsigned int i = 0; i < FLOWS; i += 2) {
+	fc.deleteFlow(flows[i]);
+    }
+    CHECK(fc.getNumFlows() == FLOWS/2, "%u flows after delete", fc.getNumFlows());
+
+    for (unsigned int i = 0; i < FLOWS; i++) {
+	len = makeKey(key, i);
+	if (i % 2) {
+	    CHECK(fc.getFlow(key, len) == flows[i], "flow %u lost by delete", i);
+	} else {
+	    CHECK(fc.getFlow(key, len) == NULL, "deleted flow %u found", i);
+	}
+    }
+
+    for (unsigned int i = 0; i < FLOWS; i += 2) {
+	len = makeKey(key, i);
+	flows[i] = fc.addFlow(key, len);
+    }
+    CHECK(fc.getNumFlows() == FLOWS, "%u flows after re-insert", fc.getNumFlows());
+
+    for (unsigned int i = 0; i < FLOWS; i++) {
+	len = makeKey(key, i);
+	CHECK(fc.getFlow(key, len) == flows[i], "flow %u not found after re-insert", i);
+    }
+
+    delete[] flows;
+}
+
+
+/* flows with the same hash value form long probe sequences, deleting
+   from the middle of them must keep the others reachable */
+
+static void testCollisions()
+{
+    FlowCreator fc;
+    flowInfo_t *flows[COLLISIONS];
+    unsigned char key[LONGKEY];
+    int len;
+
+    for (unsigned int i = 0; i < COLLISIONS; i++) {
+	len = makeKey(key, i);
+	flows[i] = fc.addFlow(key, len, i % 4);
+    }
+
+    for (unsigned int i = 0; i < COLLISIONS; i += 3) {
+	fc.deleteFlow(flows[i]);
+	flows[i] = NULL;
+    }
+
+    for (unsigned int i = 0; i < COLLISIONS; i++) {
+	len = makeKey(key, i);
+	CHECK(fc.getFlow(key, len, i % 4) == flows[i], "colliding flow %u: wrong lookup", i);
+    }
+}
+
+
+/* the flows are kept in order of activity */
+
+static void testOldest()
+{
+    FlowCreator fc(1, SHARDS);
+    flowInfo_t *flows[10];
+    unsigned char key[LONGKEY];
+    flowInfo_t *fi;
+    int i, len;
+
+    for (i = 0; i < 10; i++) {
+	len = makeKey(key, i);
+	flows[i] = fc.addFlow(key, len);
+	CHECK((flows[i]->flowId % SHARDS) == 1, "flow id %llu not in shard",
+	      flows[i]->flowId);
+    }
+
+    fc.setLastTime(flows[0], 100);
+    fc.setLastTime(flows[5], 101);
+
+    fi = fc.getOldestFlow();
+    for (i = 1; i < 10; i++) {
+	if (i == 5) {
+	    continue;
+	}
+	CHECK(fi == flows[i], "flow %d not in activity order", i);
+	fi = fi->next;
+    }
+    CHECK(fi == flows[0] && fi->next == flows[5] && flows[5]->next == NULL,
+	  "active flows not at the end");
+
+    while ((fi = fc.getOldestFlow()) != NULL) {
+	fc.deleteFlow(fi);
+    }
+    CHECK(fc.getNumFlows() == 0, "%u flows left", fc.getNumFlows());
+}
+
+
+int main(int argc, char** argv)
+{
+    try {
+	cout << "------- testrun -------" << endl;
+
+	testInsertDelete();
+	testCollisions();
+	testOldest();
+
+    } catch (Error &e) {
+	cerr << e.getError() << endl;
+	cout << "------- catched exception -------" << endl;
+	errors++;
+    }
+
+    cout << "------- " << errors << " errors -------" << endl;
+
+    return (errors > 0) ? 1 : 0;
+}
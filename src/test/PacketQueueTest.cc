@@ -2,6 +2,7 @@
 #include "Error.h"
 #include "Logger.h"
 #include "PacketQueue.h"
+#include "Threads.h"
 
 #define LOG logger->log
 
@@ -11,6 +12,14 @@
 #define LENSTEP 20
 #define RUNS 100000
 
+// lock-free single producer / single consumer test
+#define SPSC_BUFFERS 64
+#define SPSC_AVGLEN 256
+#define SPSC_PKTS 2000000
+#define SPSC_BATCH 16
+#define SPSC_PAUSE 50000   // writer pauses every SPSC_PAUSE packets
+#define SPSC_TIMEOUT 120   // seconds, a missed reader wakeup hangs the test
+
 
 void writeData( char *buf, int lin, char in )
 {
@@ -19,8 +28,9 @@ void writeData( char *buf, int lin, char in )
     //    fprintf( stdout, "writing test data to %d, len = %d, c = %d \n",
     //     (int) buf, lin, in );
     
-    *((int*)pos)++ = lin;
-    *pos++         = in;
+    memcpy(pos, &lin, sizeof(int));
+    pos += sizeof(int);
+    *pos++ = in;
     
     for( ; pos < buf+lin-5 ; pos++ ) {
 	*pos = in++;
@@ -31,8 +41,12 @@ void writeData( char *buf, int lin, char in )
 int checkData( char *buf )
 {
     char *pos = buf;
-    int len = *((int*)pos)++;
-    char c  = *pos++;
+    int len;
+    char c;
+
+    memcpy(&len, pos, sizeof(int));
+    pos += sizeof(int);
+    c = *pos++;
 
     //fprintf( stdout, "reading test data from %d, len = %d, c = %d \n",
     //     (int) buf, len, c );
@@ -47,11 +61,175 @@ int checkData( char *buf )
 }
 
 
+#ifdef ENABLE_THREADS
+
+/* the packets of the lock-free test carry their sequence number, the length
+   and a pattern depending on both */
+
+static int spscLen( unsigned int seq )
+{
+    return 2*sizeof(unsigned int) + (seq * 7) % (MAXLEN - 2*sizeof(unsigned int));
+}
+
+
+static void spscWrite( char *buf, unsigned int seq )
+{
+    unsigned int len = spscLen(seq);
+
+    memcpy(buf, &seq, sizeof(seq));
+    memcpy(buf + sizeof(seq), &len, sizeof(len));
+    for (unsigned int i = 2*sizeof(unsigned int); i < len; i++) {
+	buf[i] = (char) (seq + i);
+    }
+}
+
+
+static int spscCheck( char *buf, unsigned int seq )
+{
+    unsigned int s, len;
+
+    memcpy(&s, buf, sizeof(s));
+    memcpy(&len, buf + sizeof(s), sizeof(len));
+
+    if (s != seq) {
+	fprintf(stderr, "packet %u: got packet %u instead\n", seq, s);
+	return -1;
+    }
+    if (len != (unsigned int) spscLen(seq)) {
+	fprintf(stderr, "packet %u: wrong length %u\n", seq, len);
+	return -1;
+    }
+    for (unsigned int i = 2*sizeof(unsigned int); i < len; i++) {
+	if (buf[i] != (char) (seq + i)) {
+	    fprintf(stderr, "packet %u: data verify error at byte %u\n", seq, i);
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+
+/* writes SPSC_PKTS packets, alternating between single packets and
+   batches, retries while the queue is full */
+
+static void *spscWriter( void *arg )
+{
+    PacketQueue *pq = (PacketQueue *) arg;
+    unsigned int seq = 0, pause = 0;
+    char *buf;
+
+    while (seq < SPSC_PKTS) {
+
+	// let the reader run out of packets and go to sleep
+	if (seq >= pause) {
+	    usleep(20000);
+	    pause += SPSC_PAUSE;
+	}
+
+	if ((seq / 1000) % 2 == 0) {
+	    if (pq->getBufferSpace(&buf) != 0) {
+		sched_yield();
+		continue;
+	    }
+	    spscWrite(buf, seq);
+	    if (pq->setBufferOccupied(spscLen(seq)) != 0) {
+		fprintf(stderr, "setBufferOccupied failed\n");
+		exit(1);
+	    }
+	    seq++;
+	} else {
+	    if (pq->reserveBatch(SPSC_BATCH) == 0) {
+		sched_yield();
+		continue;
+	    }
+	    while ((seq < SPSC_PKTS) && pq->hasBatchSpace(1)) {
+		buf = pq->getBatchBuffer();
+		spscWrite(buf, seq);
+		if (pq->setBatchBufferOccupied(spscLen(seq)) != 0) {
+		    fprintf(stderr, "setBatchBufferOccupied failed\n");
+		    exit(1);
+		}
+		seq++;
+	    }
+	    if (pq->commitBatch() == 0) {
+		sched_yield();
+	    }
+	}
+    }
+
+    return NULL;
+}
+
+
+/* reads all packets in a second thread and checks that they arrive in
+   order, none lost or duplicated and with intact data */
+
+static int spscTest()
+{
+    PacketQueue *pq;
+    thread_t writer;
+    metaData_t *metas[SPSC_BATCH];
+    unsigned int seq = 0;
+    int num, res = 0;
+
+    // small queue, so the ring wraps around all the time
+    pq = new PacketQueue(SPSC_BUFFERS, 1, MAXLEN, SPSC_AVGLEN, 1);
+
+    alarm(SPSC_TIMEOUT);
+
+    if (threadCreate(&writer, spscWriter, pq) != 0) {
+	fprintf(stderr, "cannot create writer thread\n");
+	return -1;
+    }
+
+    while ((seq < SPSC_PKTS) && (res == 0)) {
+	num = pq->readBuffers(metas, SPSC_BATCH, 1);
+
+	if (num <= 0) {
+	    fprintf(stderr, "blocking readBuffers returned %d\n", num);
+	    res = -1;
+	    break;
+	}
+
+	for (int i = 0; i < num; i++) {
+	    if (spscCheck((char *) metas[i], seq++) != 0) {
+		res = -1;
+		break;
+	    }
+	}
+
+	if (pq->releaseBuffers(num) != 0) {
+	    fprintf(stderr, "releaseBuffers failed\n");
+	    res = -1;
+	}
+    }
+
+    if (res != 0) {
+	// the writer may be waiting for space
+	exit(1);
+    }
+
+    threadJoin(writer);
+    alarm(0);
+
+    if (pq->getUsedBuffers() != 0 || pq->getUsedMemory() != 0) {
+	fprintf(stderr, "queue not empty after reading all packets\n");
+	res = -1;
+    }
+
+    delete pq;
+
+    return res;
+}
+
+#endif
+
 
 int main(int argc, char** argv)
 {
     Logger *logger = NULL;
-    int res, len;
+    int res, len, ret = 0;
     unsigned char in, out;
     int lin, lout;
     PacketQueue *pq;
@@ -126,6 +304,17 @@ int main(int argc, char** argv)
 
 	delete pq;
 
+#ifdef ENABLE_THREADS
+	printf( "\nlock-free queue: " );
+	fflush( stdout );
+	if (spscTest() == 0) {
+	    printf( "ok\n" );
+	} else {
+	    printf( "FAILED\n" );
+	    ret = 1;
+	}
+#endif
+
     } catch( Error &e ) {
 	cerr << e.getError() << "\n";
 	LOG( 0, "------- catched exception -------" );
@@ -135,5 +324,5 @@ int main(int argc, char** argv)
     LOG( 0, "------- shutdown -------" );
     delete logger;
 
-    return 0;
+    return ret;
 }